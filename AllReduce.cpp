@@ -0,0 +1,285 @@
+#include<cerrno>
+#include<cstring>
+#include<ctime>
+#include<netdb.h>
+#include<netinet/in.h>
+#include<netinet/tcp.h>
+#include<poll.h>
+#include<stdint.h>
+#include<sys/socket.h>
+#include<sys/types.h>
+#include<sys/un.h>
+#include<unistd.h>
+
+#include "AllReduce.h"
+
+#include "common.h"
+
+#ifndef MSG_NOSIGNAL
+// Systems without MSG_NOSIGNAL use SO_NOSIGPIPE (see noSigPipe()).
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace ns_allReduce {
+
+// Write/read whole buffer, restart after interrupts and partial transfers.
+// Writing to a closed connection fails with EPIPE instead of raising SIGPIPE,
+// which would kill the process.
+bool writeAll(int fd, const void *data, size_t bytes){//{{{
+   const char *p = (const char*)data;
+   while(bytes > 0){
+      ssize_t n = send(fd, p, bytes, MSG_NOSIGNAL);
+      if(n < 0){
+         if(errno == EINTR)continue;
+         return false;
+      }
+      p += n;
+      bytes -= n;
+   }
+   return true;
+}//}}}
+
+bool readAll(int fd, void *data, size_t bytes){//{{{
+   char *p = (char*)data;
+   while(bytes > 0){
+      ssize_t n = read(fd, p, bytes);
+      if(n < 0){
+         if(errno == EINTR)continue;
+         return false;
+      }
+      if(n == 0)return false;
+      p += n;
+      bytes -= n;
+   }
+   return true;
+}//}}}
+
+// Split host:port address, returns false for Unix socket paths.
+bool tcpAddress(const string &address, string *host, string *port){//{{{
+   size_t colon = address.rfind(':');
+   if((colon == string::npos) || (address.find('/') != string::npos))return false;
+   *host = address.substr(0, colon);
+   *port = address.substr(colon + 1);
+   if(host->empty())*host = "localhost";
+   return true;
+}//}}}
+
+void setNoDelay(int fd){//{{{
+   int one = 1;
+   setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}//}}}
+
+void noSigPipe(int fd){//{{{
+#ifdef SO_NOSIGPIPE
+   int one = 1;
+   setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+}//}}}
+
+} // namespace ns_allReduce
+
+using namespace ns_allReduce;
+
+AllReduce::AllReduce(){//{{{
+   rank = 0;
+   size = 1;
+   failed = false;
+   listenFd = -1;
+}//}}}
+
+AllReduce::~AllReduce(){//{{{
+   close();
+}//}}}
+
+bool AllReduce::listenOn(const string &address){//{{{
+   string host,port;
+   if(tcpAddress(address, &host, &port)){
+      struct addrinfo hints, *res;
+      memset(&hints, 0, sizeof(hints));
+      hints.ai_family = AF_UNSPEC;
+      hints.ai_socktype = SOCK_STREAM;
+      hints.ai_flags = AI_PASSIVE;
+      if(getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0)return false;
+      listenFd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+      int one = 1;
+      if(listenFd >= 0)setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+      bool ok = (listenFd >= 0) && (bind(listenFd, res->ai_addr, res->ai_addrlen) == 0);
+      freeaddrinfo(res);
+      if(!ok)return false;
+   }else{
+      struct sockaddr_un addr;
+      if(address.size() >= sizeof(addr.sun_path))return false;
+      memset(&addr, 0, sizeof(addr));
+      addr.sun_family = AF_UNIX;
+      strcpy(addr.sun_path, address.c_str());
+      unlink(address.c_str());
+      listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+      if((listenFd < 0) || (bind(listenFd, (struct sockaddr*)&addr, sizeof(addr)) != 0))return false;
+      socketPath = address;
+   }
+   return listen(listenFd, size) == 0;
+}//}}}
+
+int AllReduce::connectTo(const string &address, long timeoutS){//{{{
+   string host,port;
+   time_t start = time(NULL);
+   // Rank 0 might not be listening yet.
+   while(true){
+      int fd = -1;
+      if(tcpAddress(address, &host, &port)){
+         struct addrinfo hints, *res;
+         memset(&hints, 0, sizeof(hints));
+         hints.ai_family = AF_UNSPEC;
+         hints.ai_socktype = SOCK_STREAM;
+         if(getaddrinfo(host.c_str(), port.c_str(), &hints, &res) == 0){
+            fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+            if((fd >= 0) && (connect(fd, res->ai_addr, res->ai_addrlen) != 0)){
+               ::close(fd);
+               fd = -1;
+            }
+            freeaddrinfo(res);
+         }
+         if(fd >= 0)setNoDelay(fd);
+      }else{
+         struct sockaddr_un addr;
+         if(address.size() >= sizeof(addr.sun_path))return -1;
+         memset(&addr, 0, sizeof(addr));
+         addr.sun_family = AF_UNIX;
+         strcpy(addr.sun_path, address.c_str());
+         fd = socket(AF_UNIX, SOCK_STREAM, 0);
+         if((fd >= 0) && (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)){
+            ::close(fd);
+            fd = -1;
+         }
+      }
+      if(fd >= 0){
+         noSigPipe(fd);
+         return fd;
+      }
+      if(time(NULL) - start > timeoutS)return -1;
+      usleep(200000);
+   }
+}//}}}
+
+bool AllReduce::init(const string &address, long rank, long size, long timeoutS){//{{{
+   close();
+   failed = false;
+   this->rank = rank;
+   this->size = size;
+   if((size < 1) || (rank < 0) || (rank >= size)){
+      error("AllReduce: Invalid rank %ld of %ld processes.\n", rank, size);
+      failed = true;
+      return false;
+   }
+   if(size == 1)return true;
+   int64_t hello[2];
+   if(rank == 0){
+      if(!listenOn(address)){
+         error("AllReduce: Can not listen on %s (%s).\n", address.c_str(), strerror(errno));
+         failed = true;
+         return false;
+      }
+      fds.assign(size - 1, -1);
+      time_t start = time(NULL);
+      for(long i = 1; i < size; i++){
+         // Wait for the other processes at most timeoutS seconds in total.
+         struct pollfd pfd;
+         pfd.fd = listenFd;
+         pfd.events = POLLIN;
+         long waitS = timeoutS - (long)(time(NULL) - start);
+         int ready = (waitS > 0) ? poll(&pfd, 1, waitS * 1000) : 0;
+         if((ready < 0) && (errno == EINTR)){
+            i--;
+            continue;
+         }
+         if(ready == 0){
+            error("AllReduce: Only %ld of %ld processes connected in %ld seconds.\n", i, size, timeoutS);
+            failed = true;
+            close();
+            return false;
+         }
+         int fd = (ready > 0) ? accept(listenFd, NULL, NULL) : -1;
+         if(fd < 0){
+            error("AllReduce: Accepting connection failed (%s).\n", strerror(errno));
+            failed = true;
+            close();
+            return false;
+         }
+         noSigPipe(fd);
+         if((!readAll(fd, hello, sizeof(hello))) || (hello[0] < 1) || (hello[0] >= size) ||
+            (hello[1] != size) || (fds[hello[0] - 1] != -1)){
+            error("AllReduce: Invalid connection (process of different job or duplicate rank).\n");
+            ::close(fd);
+            failed = true;
+            return false;
+         }
+         if(socketPath.empty())setNoDelay(fd);
+         fds[hello[0] - 1] = fd;
+      }
+   }else{
+      int fd = connectTo(address, timeoutS);
+      if(fd < 0){
+         error("AllReduce: Can not connect to %s.\n", address.c_str());
+         failed = true;
+         return false;
+      }
+      fds.assign(1, fd);
+      hello[0] = rank;
+      hello[1] = size;
+      if(!writeAll(fd, hello, sizeof(hello))){
+         failed = true;
+         return false;
+      }
+   }
+   return true;
+}//}}}
+
+void AllReduce::close(){//{{{
+   for(long i = 0; i < (long)fds.size(); i++)if(fds[i] >= 0)::close(fds[i]);
+   fds.clear();
+   if(listenFd >= 0)::close(listenFd);
+   listenFd = -1;
+   if(!socketPath.empty())unlink(socketPath.c_str());
+   socketPath.clear();
+}//}}}
+
+bool AllReduce::reduce(double data[], long n, bool useMax){//{{{
+   if((size == 1) || (n == 0))return true;
+   if(failed)return false;
+   size_t bytes = n * sizeof(double);
+   long i,j;
+   if(rank == 0){
+      if((long)buffer.size() < n)buffer.resize(n);
+      for(i = 0; i < size - 1; i++){
+         if(!readAll(fds[i], &buffer[0], bytes)){
+            failed = true;
+            break;
+         }
+         if(useMax){
+            for(j = 0; j < n; j++)if(buffer[j] > data[j])data[j] = buffer[j];
+         }else{
+            for(j = 0; j < n; j++)data[j] += buffer[j];
+         }
+      }
+      // Send result (or close connections on failure so that others stop).
+      for(i = 0; (i < size - 1) && (!failed); i++){
+         if(!writeAll(fds[i], data, bytes))failed = true;
+      }
+   }else{
+      if((!writeAll(fds[0], data, bytes)) || (!readAll(fds[0], data, bytes)))failed = true;
+   }
+   if(failed){
+      error("AllReduce: Communication with other processes failed.\n");
+      close();
+      return false;
+   }
+   return true;
+}//}}}
+
+bool AllReduce::sum(double data[], long n){//{{{
+   return reduce(data, n, false);
+}//}}}
+
+bool AllReduce::max(double data[], long n){//{{{
+   return reduce(data, n, true);
+}//}}}
@@ -0,0 +1,50 @@
+#ifndef ALLREDUCE_H
+#define ALLREDUCE_H
+
+#include<string>
+#include<vector>
+
+using namespace std;
+
+// AllReduce combines arrays of doubles between several processes (possibly on
+// different nodes) which work on parts of the same data.
+// Process with rank 0 listens on the address and the other processes connect
+// to it; rank 0 combines the values of all processes in rank order and sends
+// the result back, so all processes get bit-identical results.
+// Address is either a path of a Unix domain socket or host:port for TCP.
+// All processes are expected to have the same byte order and call the
+// reductions in the same order.
+class AllReduce{
+ private:
+   long rank,size;
+   bool failed;
+   int listenFd;
+   string socketPath;
+   // Rank 0: sockets of ranks 1..size-1, other ranks: socket of rank 0.
+   vector<int> fds;
+   vector<double> buffer;
+
+   // Not copyable.
+   AllReduce(const AllReduce &);
+   AllReduce& operator=(const AllReduce &);
+
+   bool listenOn(const string &address);
+   int connectTo(const string &address, long timeoutS);
+   bool reduce(double data[], long n, bool useMax);
+ public:
+   AllReduce();
+   ~AllReduce();
+   // Connect size processes, waits at most timeoutS seconds for the others.
+   bool init(const string &address, long rank, long size, long timeoutS = 120);
+   void close();
+   long getRank() const { return rank; }
+   long getSize() const { return size; }
+   // Returns false if any communication failed.
+   bool good() const { return !failed; }
+   // Replace data with sum over all processes.
+   bool sum(double data[], long n);
+   // Replace data with maximum over all processes.
+   bool max(double data[], long n);
+};
+
+#endif
@@ -70,6 +70,11 @@ void ArgumentParser::updateS(const string &name, const string &value){
    if(mapS.find(name)!=mapS.end())
       mapS.find(name)->second = value;
 }//}}}
+void ArgumentParser::updateL(const string &name, long value){
+   if(!existsOption(name))error("ArgumentParser: argument name %s unknown.\n",name.c_str());
+   if(mapL.find(name)!=mapL.end())
+      mapL.find(name)->second = value;
+}//}}}
 bool ArgumentParser::parse(int argc,char * argv[]){//{{{
 //   for(long i=0;i<argc;i++)message("_%s_\n",(args[i]).c_str());
    // add verbose if  possible {{{
@@ -105,6 +105,8 @@ class ArgumentParser{
       void writeAll();
       // Update value of existing string option.
       void updateS(const string &name, const string &value);
+      // Update value of existing integer option.
+      void updateL(const string &name, long value);
 };
 
 #endif
@@ -0,0 +1,153 @@
+#include<algorithm>
+#include<cstring>
+
+#include "AsyncWriter.h"
+#include "fastFloat.h"
+#include "GzStream.h"
+
+#include "common.h"
+
+const size_t AsyncWriter::bufferSize;
+
+AsyncWriter::AsyncWriter(){//{{{
+   file = NULL;
+   bgzfFile = NULL;
+   failed = threadRunning = pending = finish = useScientific = false;
+   prec = 6;
+   buffer = pendingBuffer = NULL;
+   bufferN = pendingN = 0;
+   pthread_mutex_init(&lock, NULL);
+   pthread_cond_init(&cond, NULL);
+}//}}}
+AsyncWriter::~AsyncWriter(){//{{{
+   close();
+   pthread_mutex_destroy(&lock);
+   pthread_cond_destroy(&cond);
+}//}}}
+bool AsyncWriter::open(const string &name){//{{{
+   close();
+   fileName = name;
+   if(ns_gzStream::isGzName(name)){
+      bgzfFile = bgzf_open(name.c_str(), "w");
+      if(bgzfFile == NULL) return false;
+      if(ns_gzStream::getThreads() > 1) bgzf_mt(bgzfFile, ns_gzStream::getThreads(), 256);
+   }else{
+      file = fopen(name.c_str(), "w");
+      if(file == NULL) return false;
+      // Data is written in large blocks, no need for stdio buffering.
+      setvbuf(file, NULL, _IONBF, 0);
+   }
+   buffer = new char[bufferSize];
+   pendingBuffer = new char[bufferSize];
+   bufferN = pendingN = 0;
+   failed = pending = finish = false;
+   // If the thread can't be started, buffers are written directly.
+   threadRunning = (pthread_create(&thread, NULL, &AsyncWriter::writerThread, this) == 0);
+   return true;
+}//}}}
+bool AsyncWriter::close(){//{{{
+   if(!is_open()) return true;
+   flushBuffer();
+   if(threadRunning){
+      pthread_mutex_lock(&lock);
+      finish = true;
+      pthread_cond_broadcast(&cond);
+      pthread_mutex_unlock(&lock);
+      pthread_join(thread, NULL);
+      threadRunning = false;
+   }
+   if(bgzfFile != NULL){
+      if(bgzf_close(bgzfFile) != 0) failed = true;
+      bgzfFile = NULL;
+   }else{
+      if(fclose(file) != 0) failed = true;
+      file = NULL;
+   }
+   delete[] buffer;
+   delete[] pendingBuffer;
+   buffer = pendingBuffer = NULL;
+   if(failed){
+      error("AsyncWriter: Writing into file %s failed.\n", fileName.c_str());
+   }
+   return !failed;
+}//}}}
+void *AsyncWriter::writerThread(void *writer){//{{{
+   static_cast<AsyncWriter*>(writer)->writeLoop();
+   return NULL;
+}//}}}
+void AsyncWriter::writeLoop(){//{{{
+   bool ok;
+   pthread_mutex_lock(&lock);
+   while(true){
+      while((!pending) && (!finish)) pthread_cond_wait(&cond, &lock);
+      if(!pending) break;
+      pthread_mutex_unlock(&lock);
+      ok = writeData(pendingBuffer, pendingN);
+      pthread_mutex_lock(&lock);
+      if(!ok) failed = true;
+      pending = false;
+      pthread_cond_broadcast(&cond);
+   }
+   pthread_mutex_unlock(&lock);
+}//}}}
+bool AsyncWriter::writeData(const char *data, size_t n){//{{{
+   if(bgzfFile != NULL) return bgzf_write(bgzfFile, data, n) == (ssize_t)n;
+   return fwrite(data, 1, n, file) == n;
+}//}}}
+void AsyncWriter::flushBuffer(){//{{{
+   if((!is_open()) || (bufferN == 0)) return;
+   if(!threadRunning){
+      if(!writeData(buffer, bufferN)) failed = true;
+      bufferN = 0;
+      return;
+   }
+   pthread_mutex_lock(&lock);
+   while(pending) pthread_cond_wait(&cond, &lock);
+   swap(buffer, pendingBuffer);
+   pendingN = bufferN;
+   pending = true;
+   pthread_cond_broadcast(&cond);
+   pthread_mutex_unlock(&lock);
+   bufferN = 0;
+}//}}}
+void AsyncWriter::write(const char *str, size_t n){//{{{
+   if(!is_open()) return;
+   size_t chunk;
+   while(n > 0){
+      if(bufferN == bufferSize) flushBuffer();
+      chunk = min(n, bufferSize - bufferN);
+      memcpy(buffer + bufferN, str, chunk);
+      bufferN += chunk;
+      str += chunk;
+      n -= chunk;
+   }
+}//}}}
+AsyncWriter& AsyncWriter::operator<<(const char *str){//{{{
+   write(str, strlen(str));
+   return *this;
+}//}}}
+void AsyncWriter::writeUnsigned(unsigned long long val){//{{{
+   if(!is_open()) return;
+   char digits[24];
+   long n = 0;
+   do{
+      digits[n++] = '0' + val % 10;
+      val /= 10;
+   }while(val > 0);
+   reserve(n);
+   while(n > 0) buffer[bufferN++] = digits[--n];
+}//}}}
+void AsyncWriter::writeInteger(long long val){//{{{
+   if(!is_open()) return;
+   if(val < 0){
+      (*this)<<'-';
+      // Avoid overflow of -LLONG_MIN.
+      writeUnsigned(0ULL - (unsigned long long)val);
+   }else writeUnsigned(val);
+}//}}}
+AsyncWriter& AsyncWriter::operator<<(double val){//{{{
+   if(!is_open()) return *this;
+   reserve(prec + 32);
+   bufferN += ns_fastFloat::formatDouble(val, prec, useScientific, buffer + bufferN);
+   return *this;
+}//}}}
@@ -0,0 +1,90 @@
+#ifndef ASYNCWRITER_H
+#define ASYNCWRITER_H
+
+#include<cstdio>
+#include<pthread.h>
+#include<string>
+
+#include "samtools/bgzf.h"
+
+using namespace std;
+
+// AsyncWriter replaces ofstream for large text outputs (samples, alignment
+// probabilities).
+// Text is formatted into a large buffer which, once full, is handed over to
+// a background thread writing it into the file, so that the caller does not
+// wait for the disk.
+// Floating point numbers are formatted by ns_fastFloat::formatDouble, which
+// produces the same text as ofstream with the same precision and notation
+// (default or scientific), so the output files are unchanged.
+// Files with .gz suffix are written BGZF compressed.
+// One writer should be used only by one thread at a time.
+class AsyncWriter{
+ private:
+   string fileName;
+   FILE *file;
+   BGZF *bgzfFile;
+   bool failed, threadRunning, pending, finish, useScientific;
+   long prec;
+   char *buffer, *pendingBuffer;
+   size_t bufferN, pendingN;
+   pthread_t thread;
+   pthread_mutex_t lock;
+   pthread_cond_t cond;
+
+   // Not copyable.
+   AsyncWriter(const AsyncWriter &);
+   AsyncWriter& operator=(const AsyncWriter &);
+
+   static void *writerThread(void *writer);
+   // Body of the writer thread, writes pending buffers until close().
+   void writeLoop();
+   // Write data into file.
+   bool writeData(const char *data, size_t n);
+   // Hand over current buffer to the writer thread (waits for previous one).
+   void flushBuffer();
+   // Make sure there is space for n more characters in the buffer.
+   void reserve(size_t n){
+      if(bufferN + n > bufferSize) flushBuffer();
+   }
+   void writeInteger(long long val);
+   void writeUnsigned(unsigned long long val);
+ public:
+   // Size of each of the two buffers.
+   static const size_t bufferSize = 1 << 20;
+
+   AsyncWriter();
+   ~AsyncWriter();
+   // Open file for writing, start the writer thread.
+   bool open(const string &name);
+   bool is_open() const { return (file != NULL) || (bgzfFile != NULL); }
+   // Write all data, stop the writer thread and close file.
+   // Returns false if any write failed.
+   bool close();
+   // Set precision and notation used for floating point numbers, same
+   // defaults as ofstream (precision 6, default notation).
+   void precision(long p){ prec = p; }
+   void scientific(bool s = true){ useScientific = s; }
+   void write(const char *str, size_t n);
+
+   AsyncWriter& operator<<(const string &str){
+      write(str.c_str(), str.size());
+      return *this;
+   }
+   AsyncWriter& operator<<(const char *str);
+   AsyncWriter& operator<<(char c){
+      if(!is_open()) return *this;
+      reserve(1);
+      buffer[bufferN++] = c;
+      return *this;
+   }
+   AsyncWriter& operator<<(int val){ writeInteger(val); return *this; }
+   AsyncWriter& operator<<(long val){ writeInteger(val); return *this; }
+   AsyncWriter& operator<<(long long val){ writeInteger(val); return *this; }
+   AsyncWriter& operator<<(unsigned int val){ writeUnsigned(val); return *this; }
+   AsyncWriter& operator<<(unsigned long val){ writeUnsigned(val); return *this; }
+   AsyncWriter& operator<<(unsigned long long val){ writeUnsigned(val); return *this; }
+   AsyncWriter& operator<<(double val);
+};
+
+#endif
@@ -6,7 +6,7 @@
 #include "common.h"
 
 void CollapsedSampler::sampleZ(){//{{{
-   int_least32_t i,j,k;
+   long i,j,k;
    // Resize Z and initialize if not big enough. {{{
    if((long)Z.size() != Nmap){
       Z.assign(Nmap,0);
@@ -29,7 +29,7 @@ void CollapsedSampler::sampleZ(){//{{{
    // phi of size M should be enough 
    // because of summing the probabilities for each isoform when reading the data
    double probNorm,r,sum,const1a,const1b,const2a;
-   int_least32_t readsAlignmentsN;
+   long readsAlignmentsN;
 
    const1a = beta->beta + Nunmap;
    const1b = m * dir->alpha + Nmap - 1;
@@ -15,7 +15,7 @@ void FileHeader::skipEmptyLines() {//{{{
       file->get();
 }//}}}
 
-bool FileHeader::readValues(ofstream *outF){//{{{
+bool FileHeader::readValues(ostream *outF){//{{{
    if((file==NULL)||(!file->is_open())){
       error("FileHeader: Input file not opened for reading.\n");
       return false;
@@ -103,7 +103,7 @@ bool FileHeader::varianceHeader(long *m,bool *logged){//{{{
    return true;
 }//}}}
 
-bool FileHeader::paramsHeader(long *parN, ofstream *outF){//{{{
+bool FileHeader::paramsHeader(long *parN, ostream *outF){//{{{
    if(!readValues(outF)){
       *parN=0;
       return false;
@@ -1,12 +1,14 @@
 #ifndef FILEHEADER_H
 #define FILEHEADER_H
 
-#include<fstream>
 #include<map>
+#include<ostream>
 #include<vector>
 
 using namespace std;
 
+#include "GzStream.h"
+
 const long no_value = -4747;
 
 namespace ns_fileHeader {
@@ -19,16 +21,16 @@ enum AlignmentFileType { OLD_FORMAT, NEW_FORMAT, LOG_FORMAT };
 // The individual functions then just look whether FLAG was present, and in case of integers, whether it had some value assigned to it.
 class FileHeader {
  private:
-   ifstream *file;
+   IGzStream *file;
    map<string,long> values;
-   bool readValues(ofstream *outF = NULL);
+   bool readValues(ostream *outF = NULL);
 
    void skipEmptyLines();
  public:
-   FileHeader(ifstream *f = NULL) {
+   FileHeader(IGzStream *f = NULL) {
       file = f;
    }
-   void setFile(ifstream *f){
+   void setFile(IGzStream *f){
       file = f;
    }
    void close(){
@@ -39,7 +41,7 @@ class FileHeader {
    bool transcriptsHeader(long *m, long *colN);
    bool probHeader(long *Nmap, long *Ntotal, long *M, ns_fileHeader::AlignmentFileType *format);
    bool varianceHeader(long *m, bool *logged);
-   bool paramsHeader(long *parN, ofstream *outF);
+   bool paramsHeader(long *parN, ostream *outF);
 };
 
 #endif
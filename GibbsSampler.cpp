@@ -21,7 +21,7 @@ void GibbsSampler::sampleZ(){//{{{
    // phi of size M should be enough 
    // because of summing the probabilities for each isoform when reading the data
    double probNorm,r,sum;
-   int_least32_t readsAlignmentsN;
+   long readsAlignmentsN;
 
    // Reset C to zeros.
    C.assign(C.size(),0);
@@ -0,0 +1,164 @@
+#include<cstring>
+
+#include "GzStream.h"
+#include "Threads.h"
+
+#include "common.h"
+
+namespace ns_gzStream {
+
+bool isGzName(const string &name){//{{{
+   return (name.size() > 3) && (name.compare(name.size() - 3, 3, ".gz") == 0);
+}//}}}
+string gzName(const string &name, bool compress){//{{{
+   if(compress && (!isGzName(name))) return name + ".gz";
+   return name;
+}//}}}
+long getThreads(){//{{{
+   // Compression runs alongside the computation producing the output, use
+   // few of the program's threads.
+   long threadsN = ns_threads::threadsN();
+   return (threadsN > 4) ? 4 : threadsN;
+}//}}}
+
+} // namespace ns_gzStream
+
+GzStreamBuf::GzStreamBuf(){//{{{
+   inF = NULL;
+   outBgzf = NULL;
+   outF = NULL;
+   failed = false;
+   setg(buffer, buffer, buffer);
+   setp(NULL, NULL);
+}//}}}
+GzStreamBuf::~GzStreamBuf(){//{{{
+   close();
+}//}}}
+bool GzStreamBuf::openRead(const string &name){//{{{
+   if(is_open()) return false;
+   inF = gzopen(name.c_str(), "rb");
+   if(inF == NULL) return false;
+#if ZLIB_VERNUM >= 0x1240
+   gzbuffer(inF, bufferSize * 2);
+#endif
+   failed = false;
+   setg(buffer, buffer, buffer);
+   return true;
+}//}}}
+bool GzStreamBuf::openWrite(const string &name){//{{{
+   if(is_open()) return false;
+   if(ns_gzStream::isGzName(name)){
+      outBgzf = bgzf_open(name.c_str(), "w");
+      if(outBgzf == NULL) return false;
+      if(ns_gzStream::getThreads() > 1) bgzf_mt(outBgzf, ns_gzStream::getThreads(), 256);
+   }else{
+      outF = fopen(name.c_str(), "w");
+      if(outF == NULL) return false;
+   }
+   failed = false;
+   setp(buffer, buffer + bufferSize);
+   return true;
+}//}}}
+bool GzStreamBuf::flushBuffer(){//{{{
+   long n = pptr() - pbase();
+   if(n <= 0) return true;
+   if(outBgzf != NULL){
+      if(bgzf_write(outBgzf, pbase(), n) != n) failed = true;
+   }else if(outF != NULL){
+      if((long)fwrite(pbase(), 1, n, outF) != n) failed = true;
+   }else failed = true;
+   pbump(-n);
+   return !failed;
+}//}}}
+bool GzStreamBuf::close(){//{{{
+   bool ok = !failed;
+   if(inF != NULL){
+      gzclose(inF);
+      inF = NULL;
+   }
+   if((outBgzf != NULL) || (outF != NULL)){
+      if(!flushBuffer()) ok = false;
+      if(outBgzf != NULL){
+         if(bgzf_close(outBgzf) != 0) ok = false;
+         outBgzf = NULL;
+      }
+      if(outF != NULL){
+         if(fclose(outF) != 0) ok = false;
+         outF = NULL;
+      }
+   }
+   setg(buffer, buffer, buffer);
+   setp(NULL, NULL);
+   return ok;
+}//}}}
+GzStreamBuf::int_type GzStreamBuf::underflow(){//{{{
+   if(gptr() < egptr()) return traits_type::to_int_type(*gptr());
+   if(inF == NULL) return traits_type::eof();
+   int n = gzread(inF, buffer, bufferSize);
+   if(n <= 0){
+      setg(buffer, buffer, buffer);
+      return traits_type::eof();
+   }
+   setg(buffer, buffer, buffer + n);
+   return traits_type::to_int_type(*gptr());
+}//}}}
+GzStreamBuf::int_type GzStreamBuf::overflow(int_type c){//{{{
+   if((outBgzf == NULL) && (outF == NULL)) return traits_type::eof();
+   if(!flushBuffer()) return traits_type::eof();
+   if(!traits_type::eq_int_type(c, traits_type::eof())){
+      *pptr() = traits_type::to_char_type(c);
+      pbump(1);
+   }
+   return traits_type::not_eof(c);
+}//}}}
+int GzStreamBuf::sync(){//{{{
+   // Only hand over buffered data, flushing BGZF would create small blocks.
+   if((outBgzf != NULL) || (outF != NULL)) return flushBuffer() ? 0 : -1;
+   return 0;
+}//}}}
+GzStreamBuf::pos_type GzStreamBuf::seekoff(off_type off, ios_base::seekdir dir, ios_base::openmode which){//{{{
+   if((inF == NULL) || (!(which & ios_base::in))) return pos_type(off_type(-1));
+   // Position of the end of buffered data in uncompressed file.
+   off_type bufferEnd = gztell(inF);
+   if(bufferEnd < 0) return pos_type(off_type(-1));
+   off_type current = bufferEnd - (egptr() - gptr());
+   if(dir == ios_base::cur){
+      if(off == 0) return pos_type(current);
+      off += current;
+   }else if(dir != ios_base::beg) return pos_type(off_type(-1));
+   return seekpos(pos_type(off), which);
+}//}}}
+GzStreamBuf::pos_type GzStreamBuf::seekpos(pos_type pos, ios_base::openmode which){//{{{
+   if((inF == NULL) || (!(which & ios_base::in))) return pos_type(off_type(-1));
+   off_type target = pos;
+   off_type bufferEnd = gztell(inF);
+   off_type bufferStart = bufferEnd - (egptr() - eback());
+   if((bufferEnd >= 0) && (target >= bufferStart) && (target <= bufferEnd)){
+      // Target is within the current buffer.
+      setg(eback(), eback() + (target - bufferStart), egptr());
+      return pos;
+   }
+   if(gzseek(inF, target, SEEK_SET) < 0) return pos_type(off_type(-1));
+   setg(buffer, buffer, buffer);
+   return pos;
+}//}}}
+
+void IGzStream::open(const char *name){//{{{
+   if(buf.openRead(name)) clear();
+   else setstate(ios_base::failbit);
+}//}}}
+void IGzStream::close(){//{{{
+   if(!buf.close()) setstate(ios_base::failbit);
+}//}}}
+
+void OGzStream::open(const char *name){//{{{
+   if(buf.openWrite(name)) clear();
+   else setstate(ios_base::failbit);
+}//}}}
+void OGzStream::close(){//{{{
+   if(!buf.is_open()) return;
+   if(!buf.close()){
+      setstate(ios_base::failbit);
+      error("OGzStream: Writing output file failed.\n");
+   }
+}//}}}
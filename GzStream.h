@@ -0,0 +1,90 @@
+#ifndef GZSTREAM_H
+#define GZSTREAM_H
+
+#include<cstdio>
+#include<istream>
+#include<ostream>
+#include<string>
+#include<zlib.h>
+
+#include "samtools/bgzf.h"
+
+using namespace std;
+
+namespace ns_gzStream {
+
+// Output files with .gz suffix are BGZF compressed.
+bool isGzName(const string &name);
+// Return name with .gz suffix appended if compress is true.
+string gzName(const string &name, bool compress);
+// Number of threads used for compression of each output file: threads of the
+// program (ns_threads::threadsN(), i.e. --procN limited by available CPUs),
+// at most 4.
+long getThreads();
+
+} // namespace ns_gzStream
+
+// Stream buffer for (possibly) compressed files.
+// Input is read using zlib, which reads plain, gzip and BGZF files
+// transparently; seeking is supported but for compressed files it is slow.
+// Output is written either as plain file or, for .gz names, BGZF compressed
+// in blocks which are compressed by ns_gzStream::getThreads() threads.
+class GzStreamBuf : public streambuf {
+ private:
+   static const int bufferSize = 1 << 16;
+   gzFile inF;
+   BGZF *outBgzf;
+   FILE *outF;
+   char buffer[bufferSize];
+   bool failed;
+
+   bool flushBuffer();
+ protected:
+   virtual int_type underflow();
+   virtual int_type overflow(int_type c);
+   virtual int sync();
+   virtual pos_type seekoff(off_type off, ios_base::seekdir dir, ios_base::openmode which);
+   virtual pos_type seekpos(pos_type pos, ios_base::openmode which);
+ public:
+   GzStreamBuf();
+   ~GzStreamBuf();
+   bool openRead(const string &name);
+   bool openWrite(const string &name);
+   bool is_open() const { return (inF != NULL) || (outBgzf != NULL) || (outF != NULL); }
+   // Returns false if writing or closing failed.
+   bool close();
+};
+
+// Replacement of ifstream which also reads gzip/BGZF compressed files.
+class IGzStream : public istream {
+ private:
+   GzStreamBuf buf;
+ public:
+   IGzStream() : istream(NULL) { rdbuf(&buf); }
+   explicit IGzStream(const char *name) : istream(NULL) {
+      rdbuf(&buf);
+      open(name);
+   }
+   void open(const char *name);
+   bool is_open() const { return buf.is_open(); }
+   void close();
+};
+
+// Replacement of ofstream which writes BGZF compressed files if the name ends
+// with .gz.
+class OGzStream : public ostream {
+ private:
+   GzStreamBuf buf;
+ public:
+   OGzStream() : ostream(NULL) { rdbuf(&buf); }
+   explicit OGzStream(const char *name) : ostream(NULL) {
+      rdbuf(&buf);
+      open(name);
+   }
+   ~OGzStream() { close(); }
+   void open(const char *name);
+   bool is_open() const { return buf.is_open(); }
+   void close();
+};
+
+#endif
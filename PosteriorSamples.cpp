@@ -1,13 +1,32 @@
 #include<algorithm>
+#include<cmath>
+#include<cstdio>
 #include<cstdlib>
+#include<cstring>
+#include<stdint.h>
 #include<vector>
+#include<sys/stat.h>
+#include<fcntl.h>
+#include<zlib.h>
+#ifndef _WIN32
+#include<sys/mman.h>
+#include<unistd.h>
+#else
+#include<process.h>
+#define getpid _getpid
+#endif
+#ifdef _OPENMP
+#include<omp.h>
+#endif
 
 using namespace std;
 
 #include "PosteriorSamples.h"
 
+#include "fastFloat.h"
 #include "FileHeader.h"
 #include "misc.h"
+#include "Threads.h"
 
 #include "common.h"
    
@@ -18,6 +37,25 @@ using namespace std;
 #define MINUS_INF -47
 #define PLUS_INF 1e10
 
+namespace ns_posteriorSamples {
+const char indexMagic[8] = {'B','S','I','D','X','0','2','\n'};
+
+// Get size and modification time (in nanoseconds where available) of a file,
+// used to validate the index.
+bool fileStat(const string &name, int64_t *size, int64_t *mtime){//{{{
+   struct stat st;
+   if(stat(name.c_str(), &st) != 0) return false;
+   *size = (int64_t) st.st_size;
+   *mtime = (int64_t) st.st_mtime * 1000000000;
+#if defined(__APPLE__)
+   *mtime += (int64_t) st.st_mtimespec.tv_nsec;
+#elif defined(__linux__)
+   *mtime += (int64_t) st.st_mtim.tv_nsec;
+#endif
+   return true;
+}//}}}
+} // namespace ns_posteriorSamples
+
 void PosteriorSamples::clear(){//{{{
    N=0;
    M=0;
@@ -25,36 +63,143 @@ void PosteriorSamples::clear(){//{{{
    failed=true;
    transposed=true;
    areLogged=false;
+   data = NULL;
+   dataSize = 0;
+   mapped = false;
+   bgzfF = NULL;
 }//}}}
 bool PosteriorSamples::open(string fileName){//{{{
-   if(samplesF.is_open())samplesF.close();
-   samplesF.open(fileName.c_str());
-   if(!samplesF.is_open()){
+   close();
+   this->fileName = fileName;
+   int fd = ::open(fileName.c_str(), O_RDONLY);
+   if(fd == -1){
       error("PosterioSamples: File open failed: %s\n",(fileName).c_str());
       failed=true;
       return false;
    }
+   struct stat st;
+   if((fstat(fd, &st) != 0) || (st.st_size == 0)){
+      ::close(fd);
+      error("PosterioSamples: File is empty: %s\n",(fileName).c_str());
+      failed=true;
+      return false;
+   }
+   dataSize = st.st_size;
+#ifndef _WIN32
+   void *mem = mmap(NULL, dataSize, PROT_READ, MAP_SHARED, fd, 0);
+   if(mem != MAP_FAILED){
+      data = (const char*) mem;
+      mapped = true;
+      // The file is read mostly sequentially (index build & getTranscript).
+      madvise(mem, dataSize, MADV_WILLNEED);
+   }
+#endif
+   if(!mapped){
+      // Mapping is not possible, read the whole file into memory instead.
+      fileBuffer.resize(dataSize);
+      long got = 0, r;
+      while(got < dataSize){
+         r = ::read(fd, &fileBuffer[got], dataSize - got);
+         if(r <= 0)break;
+         got += r;
+      }
+      if(got != dataSize){
+         ::close(fd);
+         error("PosterioSamples: File read failed: %s\n",(fileName).c_str());
+         failed=true;
+         return false;
+      }
+      data = &fileBuffer[0];
+   }
+   ::close(fd);
+   if((dataSize >= 2) && ((unsigned char)data[0] == 0x1f) && ((unsigned char)data[1] == 0x8b)){
+      // Compressed file, BGZF can be accessed randomly, gzip has to be decompressed.
+      if(bgzf_is_bgzf(fileName.c_str()) == 1) bgzfF = bgzf_open(fileName.c_str(), "r");
+      if(bgzfF != NULL){
+#ifndef _WIN32
+         if(mapped)munmap((void*)data, dataSize);
+#endif
+         mapped = false;
+         data = NULL;
+         fileBuffer.clear();
+      }else if(!decompress()){
+         failed=true;
+         return false;
+      }
+   }
+   return true;
+}//}}}
+bool PosteriorSamples::decompress(){//{{{
+   if(bgzfF != NULL){
+      bgzf_close(bgzfF);
+      bgzfF = NULL;
+   }
+#ifndef _WIN32
+   if(mapped && data)munmap((void*)data, dataSize);
+#endif
+   mapped = false;
+   data = NULL;
+   dataSize = 0;
+   gzFile inF = gzopen(fileName.c_str(), "rb");
+   if(inF == NULL){
+      error("PosterioSamples: File open failed: %s\n",(fileName).c_str());
+      return false;
+   }
+   const long chunk = 1 << 20;
+   long got = 0;
+   int r;
+   while(true){
+      fileBuffer.resize(got + chunk);
+      r = gzread(inF, &fileBuffer[got], chunk);
+      if(r <= 0)break;
+      got += r;
+   }
+   gzclose(inF);
+   if(r < 0){
+      error("PosterioSamples: File decompression failed: %s\n",(fileName).c_str());
+      fileBuffer.clear();
+      return false;
+   }
+   fileBuffer.resize(got);
+   // Keep data valid even for empty file.
+   fileBuffer.push_back('\0');
+   dataSize = got;
+   data = &fileBuffer[0];
    return true;
 }//}}}
 bool PosteriorSamples::initSet(long *m,long *n, string fileName){//{{{
-   failed=false;
    if(! open(fileName))return false;
-   
-   FileHeader fh(&samplesF);
+   failed=false;
+   // Header is parsed using standard stream and the position of data is remembered.
+   IGzStream headerF(fileName.c_str());
+   FileHeader fh(&headerF);
    if(!fh.samplesHeader(n,m,&transposed,&areLogged)){
       error("PosteriorSamples: File header reading failed.\n");
       failed=true;
       return false;
    }
+   long dataStart = headerF.good() ? (long)headerF.tellg() : dataSize;
+   headerF.close();
    N=*n;
    M=*m;
-   return read();
+   if((bgzfF != NULL) && (!transposed)){
+      // All samples are stored in memory anyway.
+      if(!decompress()){
+         failed=true;
+         return false;
+      }
+   }
+   return read(dataStart);
 }//}}}
-bool PosteriorSamples::read(){//{{{
+bool PosteriorSamples::read(long dataStart){//{{{
    if(failed)return false;
    if(transposed){
-      lines=vector<long>(M,-1);
-      lines[0]=samplesF.tellg();
+      if(loadIndex(dataStart))return true;
+      if(!((bgzfF != NULL) ? buildIndexBgzf(dataStart) : buildIndex(dataStart))){
+         failed=true;
+         return false;
+      }
+      saveIndex(dataStart);
    }else{
       if(N*M > PS_maxStoredSamples){
          error("PosteriorSamples: Too many samples to store,use trasposed file.\n");
@@ -62,52 +207,150 @@ bool PosteriorSamples::read(){//{{{
          return false;
       }
       samples.resize(M,vector<double>(N,0));
+      const char *pos = data + dataStart, *end = data + dataSize;
       for(long i=0;i<N;i++)
-         for(long j=0;j<M;j++)
-            samplesF>>samples[j][i];
-      if(!samplesF.good()){
-         failed=true;
-         return false;
+         for(long j=0;j<M;j++){
+            pos = ns_fastFloat::parseDouble(pos, end, &samples[j][i]);
+            if(pos == NULL){
+               error("PosteriorSamples: Reading failed at position:  [sample:%ld,tr:%ld]\n",i,j);
+               failed=true;
+               return false;
+            }
+         }
+   }
+   return true;
+}//}}}
+bool PosteriorSamples::loadIndex(long dataStart){//{{{
+   int64_t fSize, fTime, header[5];
+   char magic[8];
+   if(!ns_posteriorSamples::fileStat(fileName, &fSize, &fTime))return false;
+   ifstream idxF((fileName+".idx").c_str(), ios::binary);
+   if(!idxF.is_open())return false;
+   idxF.read(magic, sizeof(magic));
+   idxF.read((char*)header, sizeof(header));
+   if((!idxF.good()) || (memcmp(magic, ns_posteriorSamples::indexMagic, sizeof(magic)) != 0))return false;
+   // Index is only valid for the same file and the same header.
+   if((header[0] != fSize) || (header[1] != fTime) || (header[2] != dataStart) ||
+      (header[3] != M) || (header[4] != N))return false;
+   vector<int64_t> offsets(M+1);
+   idxF.read((char*)&offsets[0], (M+1)*sizeof(int64_t));
+   if(!idxF.good())return false;
+   lines.assign(offsets.begin(), offsets.end());
+   return true;
+}//}}}
+void PosteriorSamples::saveIndex(long dataStart) const{//{{{
+   int64_t fSize, fTime, header[5];
+   if(!ns_posteriorSamples::fileStat(fileName, &fSize, &fTime))return;
+   header[0] = fSize;
+   header[1] = fTime;
+   header[2] = dataStart;
+   header[3] = M;
+   header[4] = N;
+   vector<int64_t> offsets(lines.begin(), lines.end());
+   // Failure to write the index (e.g. read-only directory) is not a problem.
+   // The index is written into a temporary file which then replaces it, so
+   // that other processes never read a partially written index.
+   char pidStr[32];
+   sprintf(pidStr, ".tmp.%ld", (long)getpid());
+   string idxName = fileName+".idx", tmpName = idxName+pidStr;
+   ofstream idxF(tmpName.c_str(), ios::binary | ios::trunc);
+   if(!idxF.is_open())return;
+   idxF.write(ns_posteriorSamples::indexMagic, sizeof(ns_posteriorSamples::indexMagic));
+   idxF.write((const char*)header, sizeof(header));
+   idxF.write((const char*)&offsets[0], offsets.size()*sizeof(int64_t));
+   idxF.close();
+   if(idxF.fail()){
+      remove(tmpName.c_str());
+      return;
+   }
+#ifdef _WIN32
+   // rename() does not replace existing files.
+   remove(idxName.c_str());
+#endif
+   if(rename(tmpName.c_str(), idxName.c_str()) != 0)remove(tmpName.c_str());
+}//}}}
+bool PosteriorSamples::buildIndex(long dataStart){//{{{
+   long chunksN = ns_threads::threadsN(), chunkSize, c;
+   chunkSize = (dataSize - dataStart) / chunksN + 1;
+   // Each thread records line starts within its part of the file.
+   vector<vector<long> > chunkLines(chunksN);
+   #pragma omp parallel for num_threads(chunksN)
+   for(c=0;c<chunksN;c++){
+      const char *pos = data + dataStart + c * chunkSize;
+      const char *end = pos + chunkSize;
+      if(end > data + dataSize) end = data + dataSize;
+      while(pos < end){
+         pos = (const char*) memchr(pos, '\n', end - pos);
+         if(pos == NULL)break;
+         pos++;
+         chunkLines[c].push_back(pos - data);
       }
    }
+   lines.clear();
+   lines.reserve(M+1);
+   lines.push_back(dataStart);
+   for(c=0;(c<chunksN) && (Sof(lines)<=M);c++){
+      for(long i=0;(i<Sof(chunkLines[c])) && (Sof(lines)<=M);i++)
+         lines.push_back(chunkLines[c][i]);
+   }
+   // The last line does not have to end with new line.
+   if((Sof(lines) == M) && (lines[M-1] < dataSize)) lines.push_back(dataSize);
+   if(Sof(lines) != M+1){
+      error("PosteriorSamples: File contains only %ld lines instead of %ld.\n",Sof(lines)-1,M);
+      return false;
+   }
+   return true;
+}//}}}
+bool PosteriorSamples::buildIndexBgzf(long dataStart){//{{{
+   // Virtual offsets can't be computed in parallel, the file is read sequentially.
+   vector<char> skipBuffer(1 << 16);
+   long skip = dataStart, r;
+   kstring_t line = {0, 0, NULL};
+   if(bgzf_seek(bgzfF, 0, SEEK_SET) < 0){
+      error("PosteriorSamples: Seeking in compressed file failed.\n");
+      return false;
+   }
+   while(skip > 0){
+      r = bgzf_read(bgzfF, &skipBuffer[0], min(skip, Sof(skipBuffer)));
+      if(r <= 0)break;
+      skip -= r;
+   }
+   lines.clear();
+   lines.reserve(M+1);
+   while(Sof(lines) < M){
+      lines.push_back(bgzf_tell(bgzfF));
+      if(bgzf_getline(bgzfF, '\n', &line) < 0){
+         lines.pop_back();
+         break;
+      }
+   }
+   lines.push_back(bgzf_tell(bgzfF));
+   free(line.s);
+   if(Sof(lines) != M+1){
+      error("PosteriorSamples: File contains only %ld lines instead of %ld.\n",Sof(lines)-1,M);
+      return false;
+   }
    return true;
 }//}}}
-bool PosteriorSamples::getTranscript(long tr,vector<double> &trSamples){//{{{
+bool PosteriorSamples::getTranscript(long tr,vector<double> &trSamples) const{//{{{
    if((tr>=M)||(failed))return false;
-   string str;
    bool good=true;
    if(Sof(trSamples)!=N)trSamples.resize(N);
    if(transposed){
-      long i;
-      if(lines[tr]==-1){
-         for(i=0;lines[i+1]!=-1;i++);
-         samplesF.seekg(lines[i]);
-         while((samplesF.good())&&(i<tr)){
-            i++;
-            samplesF.ignore(10000000,'\n');
-            lines[i]=samplesF.tellg();
+      if(bgzfF != NULL){
+         kstring_t line = {0, 0, NULL};
+         pthread_mutex_lock(&bgzfLock);
+         if((bgzf_seek(bgzfF, lines[tr], SEEK_SET) < 0) || (bgzf_getline(bgzfF, '\n', &line) < 0)){
+            pthread_mutex_unlock(&bgzfLock);
+            free(line.s);
+            error("PosteriorSamples: Reading failed at position:  [tr:%ld]\n",tr);
+            return false;
          }
+         pthread_mutex_unlock(&bgzfLock);
+         good = parseTranscript(tr, line.s, line.s + line.l, trSamples);
+         free(line.s);
       }else{
-         samplesF.seekg(lines[tr]);
-      }
-      for(i=0;(i<N)&&(samplesF.good());i++){
-         samplesF>>trSamples[i];
-         // apply normalisation.
-         trSamples[i] *= norm;
-         if(samplesF.eof())break;
-         if(samplesF.fail()){
-            samplesF.clear();
-            samplesF.seekg(-1,ios::cur);
-            samplesF>>str;
-            if(ns_misc::toLower(str)=="-inf")trSamples[i]=MINUS_INF;
-            else if(ns_misc::toLower(str)=="nan")trSamples[i]=PLUS_INF;
-            else error("PosteriorSamples: Unknown value: %s in [tr:%ld,pos:%ld]\n",(str).c_str(),tr,i);
-            good=false;
-         }
-      }
-      if(i!=N){
-         good=false;
-         error("PosteriorSamples: Reading failed at position:  [tr:%ld,pos:%ld]\n",tr,i);
+         good = parseTranscript(tr, data + lines[tr], data + lines[tr+1], trSamples);
       }
    }else{
       trSamples = samples[tr];
@@ -119,8 +362,49 @@ bool PosteriorSamples::getTranscript(long tr,vector<double> &trSamples){//{{{
    }
    return good;
 }//}}}
+bool PosteriorSamples::parseTranscript(long tr, const char *pos, const char *end, vector<double> &trSamples) const{//{{{
+   bool good=true;
+   long i;
+   const char *next;
+   for(i=0;i<N;i++){
+      next = ns_fastFloat::parseDouble(pos, end, &trSamples[i]);
+      if(next == NULL){
+         pos = ns_fastFloat::skipSpace(pos, end);
+         // End of line.
+         if(pos == end)break;
+         next = ns_fastFloat::skipWord(pos, end);
+         error("PosteriorSamples: Unknown value: %s in [tr:%ld,pos:%ld]\n",(string(pos, next - pos)).c_str(),tr,i);
+         good=false;
+      }else if(isnan(trSamples[i])){
+         trSamples[i]=PLUS_INF;
+         good=false;
+      }else if(isinf(trSamples[i])){
+         trSamples[i]=(trSamples[i]<0) ? MINUS_INF : PLUS_INF;
+         good=false;
+      }else{
+         // apply normalisation.
+         trSamples[i] *= norm;
+      }
+      pos = next;
+   }
+   if(i!=N){
+      good=false;
+      error("PosteriorSamples: Reading failed at position:  [tr:%ld,pos:%ld]\n",tr,i);
+   }
+   return good;
+}//}}}
 void PosteriorSamples::close(){//{{{
-   samplesF.close();
+#ifndef _WIN32
+   if(mapped && data)munmap((void*)data, dataSize);
+#endif
+   data = NULL;
+   dataSize = 0;
+   mapped = false;
+   if(bgzfF != NULL)bgzf_close(bgzfF);
+   bgzfF = NULL;
+   fileBuffer.clear();
+   lines.clear();
+   samples.clear();
    failed=true;
 }//}}}
 
@@ -190,7 +474,7 @@ bool Conditions::init(string trFileName, vector<string> filesGot, long *c, long
    }
    *n=N;
 
-   ifstream trFile(trFileName.c_str());
+   IGzStream trFile(trFileName.c_str());
    if(! trFile.is_open()){
    // if there is no transcript join file, the we have to make sure that Ms are the same
       if(sameMs){
@@ -242,7 +526,7 @@ bool Conditions::getTranscript(long cond, long rep, long tr, vector<double> &trS
 }//}}}
 bool Conditions::getTranscript(long cond, long tr, vector<double> &trSamples){//{{{
    bool status=false;
-   static vector<double> tmpSamples;
+   vector<double> tmpSamples;
    if(cond>=CN){
       error("Conditions: Wrong condition request.\n");
       return false;
@@ -263,7 +547,7 @@ bool Conditions::getTranscript(long cond, long tr, vector<double> &trSamples){//
 }//}}}
 bool Conditions::getTranscript(long cond, long tr, vector<double> &trSamples, long samplesN){//{{{
    bool status=false;
-   static vector<double> tmpSamples;
+   vector<double> tmpSamples;
    if(cond>=CN){
       error("Conditions: Wrong condition request.\n");
       return false;
@@ -1,30 +1,59 @@
 #ifndef POSTERIORSAMPLES_H
 #define POSTERIORSAMPLES_H
 
+#include<pthread.h>
 #include<vector>
 #include<fstream>
 #include<string>
 
 using namespace std;
 
+#include "samtools/bgzf.h"
+
 const long PS_maxStoredSamples = 100000000;
 
+// Samples file is memory mapped and offsets of lines (transcripts) in
+// transposed files are found in one (parallel) pass when the file is opened.
+// The offsets are cached in <fileName>.idx so that they do not have to be
+// recomputed next time.
+// BGZF compressed transposed files are not decompressed, the offsets are
+// BGZF virtual offsets and lines are decompressed on demand (under a lock);
+// other compressed files are decompressed into memory.
+// getTranscript() does not change the state of the class and can be called
+// concurrently from multiple threads.
 class PosteriorSamples{//{{{
    private:
       long N,M;
       double norm;
       bool transposed,failed,areLogged;
-      ifstream samplesF;
+      string fileName;
+      // File content: either memory mapped or read into fileBuffer.
+      const char *data;
+      long dataSize;
+      bool mapped;
+      vector<char> fileBuffer;
+      // BGZF compressed file, only used for transposed files.
+      BGZF *bgzfF;
+      mutable pthread_mutex_t bgzfLock;
+      // Offsets of transcript lines, lines[M] is the end of the last line.
       vector<long> lines;
       vector<vector<double> > samples;
 
       bool open(string fileName);
-      bool read();
+      // Decompress whole (gzip) file into fileBuffer.
+      bool decompress();
+      bool read(long dataStart);
+      bool loadIndex(long dataStart);
+      void saveIndex(long dataStart) const;
+      bool buildIndex(long dataStart);
+      bool buildIndexBgzf(long dataStart);
+      // Parse samples of transcript tr from line [pos,end).
+      bool parseTranscript(long tr, const char *pos, const char *end, vector<double> &trSamples) const;
    public:
-   PosteriorSamples() { clear(); }
-   ~PosteriorSamples() { close(); }
+   PosteriorSamples() { clear(); pthread_mutex_init(&bgzfLock, NULL); }
+   ~PosteriorSamples() { close(); pthread_mutex_destroy(&bgzfLock); }
    // Copy constructor and assginment. Both just create new class. For vectors only.
-   PosteriorSamples(const PosteriorSamples &other) { clear(); }
+   PosteriorSamples(const PosteriorSamples &other) { clear(); pthread_mutex_init(&bgzfLock, NULL); }
    PosteriorSamples& operator=(const PosteriorSamples & other) { //{{{
       close();
       clear();
@@ -32,7 +61,7 @@ class PosteriorSamples{//{{{
    } //}}}
    void clear();
    bool initSet(long *m, long *n, string fileName);
-   bool getTranscript(long tr, vector<double> &trSamples);
+   bool getTranscript(long tr, vector<double> &trSamples) const;
    void close();
    bool logged(){return areLogged;}
    void setNorm(double norm){this->norm = norm;}
@@ -1,5 +1,7 @@
 #include<algorithm>
 #include<cmath>
+#include<cstring>
+#include<stdint.h>
 #ifdef _OPENMP
 #include<omp.h>
 #endif
@@ -8,6 +10,7 @@
 
 #include "misc.h"
 #include "MyTimer.h"
+#include "Threads.h"
 
 #include "common.h"
 
@@ -81,6 +84,31 @@ inline bool getCigarOp(const bam1_t *samA, long cigarI, long *cigarOp, long *cig
    *cigarOpCount = (long)(bam1_cigar(samA)[cigarI]>>BAM_CIGAR_SHIFT);
    return true;
 }//}}}
+// Model files: {{{
+const char modelMagic[8] = {'B','S','R','D','M','0','1','\n'};
+// Values are stored in native byte order, the marker after the magic tells
+// it; the version is increased with every change of the format.
+const uint32_t modelByteOrder = 0x01020304;
+const uint32_t modelVersion = 1;
+// Maximal length of vector in model file (protects against corrupted files).
+const int64_t modelMaxVector = (int64_t)1<<32;
+template<class valT> inline void writeValue(ofstream &outF, valT val){//{{{
+   outF.write((const char*)&val, sizeof(val));
+}//}}}
+template<class valT> inline bool readValue(ifstream &inF, valT *val){//{{{
+   return !inF.read((char*)val, sizeof(*val)).fail();
+}//}}}
+void writeVector(ofstream &outF, const vector<double> &v){//{{{
+   writeValue(outF, (int64_t)v.size());
+   if(!v.empty())outF.write((const char*)&v[0], v.size()*sizeof(double));
+}//}}}
+bool readVector(ifstream &inF, vector<double> *v){//{{{
+   int64_t n;
+   if(!readValue(inF, &n) || (n < 0) || (n > modelMaxVector))return false;
+   v->resize(n);
+   return (n == 0) || (!inF.read((char*)&(*v)[0], n*sizeof(double)).fail());
+}//}}}
+// }}}
 } // namespace ns_rD
 
 using namespace ns_rD;
@@ -91,14 +119,12 @@ ReadDistribution::ReadDistribution(){ //{{{
    warnFirst = false;
    warnPos = warnTIDmismatch = warnUnknownTID = noteFirstMateDown = 0;
    procN = 1; 
-#ifdef _OPENMP
-   omp_set_num_threads(procN);
-#endif
    lMu=100;
    lSigma=10;
    verbose = true;
    singleReadLength = 0;
    minFragLen=10000;
+   weightNormLengths = WEIGHT_NORM_LENGTHS;
    lowProbMismatches = LOW_PROB_MISSES;
    lProbMis.resize(256,0);
    lProbHit.resize(256,0);
@@ -124,14 +150,7 @@ void ReadDistribution::writeWarnings() {//{{{
    warnPos = warnTIDmismatch = warnUnknownTID = noteFirstMateDown = 0;
 }//}}}
 void ReadDistribution::setProcN(long procN){//{{{
-   if(procN<0)procN=1;
-   if(procN>32)procN=4;
-#ifdef _OPENMP
-   this->procN = procN;
-   omp_set_num_threads(procN);
-#else
-   this->procN = 1;
-#endif
+   this->procN = ns_threads::setThreads(procN);
 }//}}}
 void ReadDistribution::showFirstWarnings(){//{{{
    warnFirst = true;
@@ -160,7 +179,8 @@ bool ReadDistribution::init(long m, TranscriptInfo* trI, TranscriptSequence* trS
    // Initialize tr - frag_length - expression maps:
    trFragSeen5.resize(M);
    trFragSeen3.resize(M);
-   weightNorms.resize(3,vector<map<long, double> >(M));
+   weightNorms.assign(3,vector<vector<double> >(M));
+   weightNormsReady.assign(3,vector<char>(M,0));
    // Initialize position bias matrices:
    posProb.resize( 6, vector<vector<double> >(trSizesN + 1, vector<double>(trNumberOfBins,0.01/trNumberOfBins)));
    // Initialize sequence bias VLMMs: 
@@ -298,6 +318,108 @@ bool ReadDistribution::observed(fragmentP frag){ //{{{
    }
    return true;
 }//}}}
+void ReadDistribution::initAccumulator(ReadDistribution *acc) const{ //{{{
+   acc->M = M;
+   acc->verbose = false;
+   acc->warnFirst = false;
+   acc->uniform = uniform;
+   acc->unstranded = unstranded;
+   acc->gotExpression = gotExpression;
+   acc->lowProbMismatches = lowProbMismatches;
+   acc->trInf = trInf;
+   acc->trSeq = trSeq;
+   acc->trExp = trExp;
+   acc->logLengthSum = acc->logLengthSqSum = 0;
+   acc->fragSeen = 0;
+   acc->singleReadLength = 0;
+   acc->minFragLen = minFragLen;
+   acc->warnPos = acc->warnTIDmismatch = acc->warnUnknownTID = acc->noteFirstMateDown = 0;
+   acc->fragLengths.clear();
+   acc->lFreqHit.clear();
+   acc->lFreqMis.clear();
+   if(uniform) return;
+   acc->trFragSeen5.assign(M, map<long,double>());
+   acc->trFragSeen3.assign(M, map<long,double>());
+   acc->posProb.assign(6, vector<vector<double> >(trSizesN + 1, vector<double>(trNumberOfBins,0)));
+   acc->seqProb = seqProb;
+   for(size_t i=0;i<acc->seqProb.size();i++)
+      for(size_t j=0;j<acc->seqProb[i].size();j++)
+         acc->seqProb[i][j].clear();
+}//}}}
+void ReadDistribution::merge(const ReadDistribution &acc){ //{{{
+   fragSeen += acc.fragSeen;
+   logLengthSum += acc.logLengthSum;
+   logLengthSqSum += acc.logLengthSqSum;
+   if(acc.minFragLen < minFragLen) minFragLen = acc.minFragLen;
+   if(acc.singleReadLength > 0) singleReadLength = acc.singleReadLength;
+   warnPos += acc.warnPos;
+   warnTIDmismatch += acc.warnTIDmismatch;
+   warnUnknownTID += acc.warnUnknownTID;
+   noteFirstMateDown += acc.noteFirstMateDown;
+   map<long,long>::const_iterator lIt;
+   for(lIt=acc.fragLengths.begin();lIt!=acc.fragLengths.end();lIt++)
+      mapAdd(fragLengths, lIt->first, lIt->second);
+   // Mismatch frequencies start with pseudocount 1 in both objects.
+   if(acc.lFreqHit.size()>lFreqHit.size()){
+      lFreqHit.resize(acc.lFreqHit.size(),1.0);
+      lFreqMis.resize(acc.lFreqMis.size(),1.0);
+   }
+   for(size_t i=0;i<acc.lFreqHit.size();i++){
+      lFreqHit[i] += acc.lFreqHit[i] - 1.0;
+      lFreqMis[i] += acc.lFreqMis[i] - 1.0;
+   }
+   if(uniform) return;
+   map<long,double>::const_iterator mIt;
+   for(long m=0;m<M;m++){
+      for(mIt=acc.trFragSeen5[m].begin();mIt!=acc.trFragSeen5[m].end();mIt++)
+         mapAdd(trFragSeen5[m], mIt->first, mIt->second);
+      for(mIt=acc.trFragSeen3[m].begin();mIt!=acc.trFragSeen3[m].end();mIt++)
+         mapAdd(trFragSeen3[m], mIt->first, mIt->second);
+   }
+   for(size_t i=0;i<posProb.size();i++)
+      for(size_t j=0;j<posProb[i].size();j++)
+         for(size_t k=0;k<posProb[i][j].size();k++)
+            posProb[i][j][k] += acc.posProb[i][j][k];
+   for(size_t i=0;i<seqProb.size();i++)
+      for(size_t j=0;j<seqProb[i].size();j++)
+         seqProb[i][j].merge(acc.seqProb[i][j]);
+}//}}}
+double ReadDistribution::profileChange(vector<double> *profile) const{ //{{{
+   vector<double> current;
+   long group,i,j;
+   double sum;
+   if(fragSeen>0){
+      double mu = logLengthSum/fragSeen;
+      current.push_back(mu);
+      current.push_back(sqrt(max(0.0, logLengthSqSum/fragSeen - mu*mu)));
+   }
+   if(!uniform){
+      const char bases[] = "ACGT";
+      biasT biases[] = {readM_5, readM_3};
+      for(long b=0;b<2;b++){
+         for(group=0;group<=trSizesN;group++){
+            const vector<double> &bins = posProb[biases[b]][group];
+            sum = 0;
+            for(i=0;i<trNumberOfBins;i++)sum += bins[i];
+            for(i=0;i<trNumberOfBins;i++)current.push_back(bins[i]/sum);
+         }
+         for(i=0;i<vlmmNodesN;i++){
+            VlmmNode node = seqProb[biases[b]][i];
+            node.normalize();
+            for(j=0;j<64;j++)
+               current.push_back(node.getP(bases[j%4], bases[(j/4)%4], bases[j/16]));
+         }
+      }
+   }
+   double change = 0;
+   if(current.size() != profile->size())change = HUGE_VAL;
+   else{
+      for(i=0;i<(long)current.size();i++)
+         if(abs(current[i] - (*profile)[i]) > change)change = abs(current[i] - (*profile)[i]);
+   }
+   profile->swap(current);
+   return change;
+}//}}}
 void ReadDistribution::normalize(){ //{{{
    // length distribution: {{{
    double newMu=0, newSigma=0;
@@ -519,22 +641,15 @@ void ReadDistribution::updateMismatchFreq(bam1_t *samA) {//{{{
       cigarOpCount --;
    }
 }//}}}
-pair<double,double> ReadDistribution::getSequenceLProb(bam1_t *samA) const{//{{{
-   if(! samA) return pair<double, double>(0,0);
-   double lProb=0,lowLProb=0, lPHit, lPMis;
-   bam1_core_t *samC = &samA->core;
-   uint8_t *qualP=bam1_qual(samA);
-   bool hasPhred = readHasPhred(samA);
-   long i,j,k,len=samC->l_qseq;
+void ReadDistribution::getSequenceMatches(const bam1_t *samA, vector<uint8_t> *bases) const{//{{{
+   const bam1_core_t *samC = &samA->core;
+   long i,j,len=samC->l_qseq;
    long deletionN = countDeletions(samA);
    string seq = trSeq->getSeq(samC->tid, samC->pos, len+deletionN, false);
-   long hitC, misC, addMisC;
    long cigarOp,cigarI,cigarOpCount;
-   bool reversed = (samC->flag & BAM_FREVERSE);
-
-   // First count the number fo misses to add for low probability. {{{
+   
+   bases->assign(len,0);
    cigarOp = cigarI = cigarOpCount = 0;
-   hitC = misC = 0;
    // i - iterates within reference sequence
    // j - iterates within read
    for(i=j=0;(i<len+deletionN) && (j<len);){
@@ -545,31 +660,35 @@ pair<double,double> ReadDistribution::getSequenceLProb(bam1_t *samA) const{//{{{
       switch(cigarOp){
          case BAM_CDEL: i+=cigarOpCount; cigarOpCount=0; continue;
          case BAM_CINS: j+=cigarOpCount; cigarOpCount=0; continue;
+         /*case BAM_CMATCH:
+         case BAM_CEQUAL:
+         case BAM_CDIFF:*/
       }
       if((base2int(seq[i]) == -1)||
-         (base2BAMint(seq[i]) != bam1_seqi(bam1_seq(samA),j)))misC++;
-      else hitC++;
+         (base2BAMint(seq[i]) != bam1_seqi(bam1_seq(samA),j)))(*bases)[j] = 2;
+      else (*bases)[j] = 1;
       i++;
       j++;
       cigarOpCount --;
    }
+}//}}}
+pair<double,double> ReadDistribution::getSequenceLProb(const vector<uint8_t> &bases, const uint8_t *qualP, bool reversed) const{//{{{
+   // Phred scores are used if qualP is not NULL.
+   double lProb=0,lowLProb=0, lPHit, lPMis;
+   long j,k,len=bases.size();
+   long hitC, misC, addMisC;
+
+   // First count the number fo misses to add for low probability.
+   hitC = misC = 0;
+   for(j=0;j<len;j++){
+      if(bases[j] == 2)misC++;
+      else if(bases[j] == 1)hitC++;
+   }
    addMisC = max((long)1, lowProbMismatches - misC);
-   // }}}
    
-   cigarOp = cigarI = cigarOpCount = 0;
-   for(i=j=0;(i<len+deletionN) && (j<len);){
-      if(cigarOpCount == 0){
-         if(! getCigarOp(samA, cigarI, &cigarOp, &cigarOpCount))break;
-         cigarI++;
-      }
-      switch(cigarOp){
-         case BAM_CDEL: i+=cigarOpCount; cigarOpCount=0; continue;
-         case BAM_CINS: j+=cigarOpCount; cigarOpCount=0; continue;
-         /*case BAM_CMATCH:
-         case BAM_CEQUAL:
-         case BAM_CDIFF:*/
-      }
-      if(hasPhred){
+   for(j=0;j<len;j++){
+      if(bases[j] == 0)continue;
+      if(qualP){
          lPHit = lProbHit[qualP[j]];
          lPMis = lProbMis[qualP[j]];
       }else{
@@ -582,8 +701,7 @@ pair<double,double> ReadDistribution::getSequenceLProb(bam1_t *samA) const{//{{{
             lPHit = lPMis = 0.5;
          }
       }
-      if((base2int(seq[i]) == -1) ||
-         (base2BAMint(seq[i]) != bam1_seqi(bam1_seq(samA),j))){
+      if(bases[j] == 2){
          // If bases don't match, multiply probability by probability of error.
          lProb += lPMis;
          lowLProb += lPMis;
@@ -598,59 +716,112 @@ pair<double,double> ReadDistribution::getSequenceLProb(bam1_t *samA) const{//{{{
             lowLProb += lPHit;
          }
       }
-      i++;
-      j++;
-      cigarOpCount --;
    }
    return pair<double, double>(lProb,lowLProb);
 }//}}}
+pair<double,double> ReadDistribution::getSequenceLProb(const mateRecordT &mate) const{//{{{
+   if(mate.bases.empty()) return pair<double, double>(mate.seqLP, mate.seqLowLP);
+   return getSequenceLProb(mate.bases, NULL, mate.flag & BAM_FREVERSE);
+}//}}}
+void ReadDistribution::getMateRecord(const bam1_t *samA, mateRecordT *mate) const{//{{{
+   mate->tid = samA->core.tid;
+   mate->pos = samA->core.pos;
+   mate->endPos = bam_calend(&samA->core, bam1_cigar(samA));
+   mate->flag = samA->core.flag;
+   mate->seqLP = mate->seqLowLP = 0;
+   mate->bases.clear();
+   // Sequence of unknown transcript is not available, getP() fails for these.
+   if((mate->tid < 0) || (mate->tid >= M))return;
+   if(readHasPhred(samA)){
+      vector<uint8_t> bases;
+      getSequenceMatches(samA, &bases);
+      pair<double, double> lpSeq =
+         getSequenceLProb(bases, bam1_qual(samA), samA->core.flag & BAM_FREVERSE);
+      mate->seqLP = lpSeq.first;
+      mate->seqLowLP = lpSeq.second;
+   }else{
+      getSequenceMatches(samA, &mate->bases);
+   }
+}//}}}
+void ReadDistribution::getRecord(const fragmentP frag, fragmentRecordT *rec) const{//{{{
+   rec->paired = frag->paired;
+   getMateRecord(frag->first, &rec->first);
+   if(frag->paired)getMateRecord(frag->second, &rec->second);
+}//}}}
 bool ReadDistribution::getP(fragmentP frag,double &lProb,double &lProbNoise){ //{{{
+   fragmentRecordT rec;
+   getRecord(frag, &rec);
+   return getP(rec, lProb, lProbNoise, bam1_qname(frag->first));
+}//}}}
+bool ReadDistribution::getP(const fragmentRecordT &frag, double &lProb, double &lProbNoise, const char *name){ //{{{
+   bool firstMateDown;
+   probStatusT status = computeP(frag, lProb, lProbNoise, &firstMateDown);
+   return noteP(frag, status, firstMateDown, name);
+}//}}}
+bool ReadDistribution::noteP(const fragmentRecordT &frag, probStatusT status, bool firstMateDown, const char *name){ //{{{
+   long tid = frag.first.tid;
+   if(firstMateDown)noteFirstMateDown ++;
+   switch(status){
+      case probValid: return true;
+      case probUnknownTID:
+         if(warnFirst && (warnUnknownTID==0))
+            warning("TID unknown: %s: %ld\n",name,tid);
+         warnUnknownTID++;
+         break;
+      case probTIDMismatch:
+         if(warnFirst && (warnTIDmismatch==0))
+            warning("TID mismatch: %s: %s %s\n",name,
+                    trInf->trName(tid).c_str(),
+                    trInf->trName(frag.second.tid).c_str());
+         warnTIDmismatch++;
+         break;
+      case probWrongStrand:
+         if(warnFirst && (warnPos==0))
+            warning("wrong strand: %s: %s\n",name,
+                    trInf->trName(tid).c_str());
+         warnPos ++;
+         break;
+   }
+   return false;
+}//}}}
+probStatusT ReadDistribution::computeP(const fragmentRecordT &frag, double &lProb, double &lProbNoise, bool *firstMateDown){ //{{{
    lProb = ns_misc::LOG_ZERO;
    lProbNoise = ns_misc::LOG_ZERO;
-   long tid = frag->first->core.tid;
-   long trLen = trInf->L(tid),len;
+   *firstMateDown = false;
+   long tid = frag.first.tid;
+   long trLen,len;
    // Check transcript IDs {{{
-   if((tid < 0)||(tid>=M)){
-      if(warnFirst && (warnUnknownTID==0))
-         warning("TID unknown: %s: %ld\n",bam1_qname(frag->first),tid);
-      warnUnknownTID++;
-      return false;
-   }
-   if((frag->paired)&&(tid!=frag->second->core.tid)){
-      if(warnFirst && (warnTIDmismatch==0))
-         warning("TID mismatch: %s: %s %s\n",bam1_qname(frag->first),
-                 trInf->trName(tid).c_str(),
-                 trInf->trName(frag->second->core.tid).c_str());
-      warnTIDmismatch++;
-      return false;
-   }
+   if((tid < 0)||(tid>=M))return probUnknownTID;
+   if((frag.paired)&&(tid!=frag.second.tid))return probTIDMismatch;
    //}}}
+   trLen = trInf->L(tid);
    double lP = 0;
    // Get probability based on base mismatches: {{{
    pair<double, double> lpSeq1(0,0),lpSeq2(0,0);
-   lpSeq1 = getSequenceLProb(frag->first);
-   if(frag->paired)lpSeq2 = getSequenceLProb(frag->second);
+   lpSeq1 = getSequenceLProb(frag.first);
+   if(frag.paired)lpSeq2 = getSequenceLProb(frag.second);
    // }}}
-   // Calculate reads' true end position: {{{
+   // Reads' true end position: {{{
    long frag_first_endPos, frag_second_endPos=0;
-   frag_first_endPos = bam_calend(&frag->first->core, bam1_cigar(frag->first));
-   if(frag->paired){
-      frag_second_endPos = bam_calend(&frag->second->core, bam1_cigar(frag->second));
+   frag_first_endPos = frag.first.endPos;
+   if(frag.paired){
+      frag_second_endPos = frag.second.endPos;
    }
    // }}}
-   if(frag->paired){
+   const mateRecordT *first = &frag.first, *second = &frag.second;
+   if(frag.paired){
    // Get probability of length {{{
-      if(frag->second->core.pos > frag->first->core.pos)
-         len = frag_second_endPos - frag->first->core.pos;
+      if(second->pos > first->pos)
+         len = frag_second_endPos - first->pos;
       else{
-         len = frag_first_endPos - frag->second->core.pos;
+         len = frag_first_endPos - second->pos;
       }
       // compute length probability and normalize by probability of all possible lengths (cdf):
       // P*=lengthP/lengthNorm
       // }}}
       if(validLength) lP += getLengthLP(len) - getLengthLNorm(trLen);
    }else{
-      len = frag_first_endPos - frag->first->core.pos;
+      len = frag_first_endPos - first->pos;
    }
    if(uniform){
       // Get probability of position for uniform distribution
@@ -659,37 +830,32 @@ bool ReadDistribution::getP(fragmentP frag,double &lProb,double &lProbNoise){ //
    }else{ // Positional & Sequence bias {{{
       // Get probability of position given read bias model
       // check mates' relative position:
-      if( frag->paired && (frag->first->core.pos > frag->second->core.pos)){
-         noteFirstMateDown ++;
-         bam1_t *tmp = frag->second;
-         frag->second = frag->first;
-         frag->first = tmp;
+      if( frag.paired && (first->pos > second->pos)){
+         *firstMateDown = true;
+         first = &frag.second;
+         second = &frag.first;
       }
-      if(!frag->paired){
-         if(frag->first->core.flag & BAM_FREVERSE){
+      if(!frag.paired){
+         if(first->flag & BAM_FREVERSE){
             // If read was reverse complement, then it's 3' mate.
             // P*=posBias3'*seqBias3'/weightNorm3'
-            lP += log(getPosBias(frag->first->core.pos, frag_first_endPos, 
+            lP += log(getPosBias(first->pos, frag_first_endPos, 
                                  mate_3, trLen)) +
                log(getSeqBias(frag_first_endPos , mate_3, tid )) -
                log(getWeightNorm( (long) len, mate_3, tid));
          }else{
             // P*=posBias5'*seqBias5'/weightNorm5'
-            lP += log(getPosBias(frag->first->core.pos, frag_first_endPos,
+            lP += log(getPosBias(first->pos, frag_first_endPos,
                                  mate_5, trLen)) +
-               log(getSeqBias(frag->first->core.pos, mate_5, tid )) -
+               log(getSeqBias(first->pos, mate_5, tid )) -
                log(getWeightNorm( (long) len, mate_5, tid));
          }
       }else{
          // check strand of the reads:
          if((!unstranded) && 
-            ((frag->first->core.flag & BAM_FREVERSE) ||
-            (! frag->second->core.flag & BAM_FREVERSE))){
-               if(warnFirst && (warnPos==0))
-                  warning("wrong strand: %s: %s\n",bam1_qname(frag->first),
-                          trInf->trName(tid).c_str());
-               warnPos ++;
-               return false;
+            ((first->flag & BAM_FREVERSE) ||
+            (! second->flag & BAM_FREVERSE))){
+               return probWrongStrand;
          }
 //#pragma omp parallel sections num_threads (2) reduction(*:P)
 //{
@@ -699,9 +865,9 @@ bool ReadDistribution::getP(fragmentP frag,double &lProb,double &lProbNoise){ //
 //   #pragma omp section
 //   {
          // P*=posBias5'*posBias3'*seqBias5'*seqBias3'
-         lP += log(getPosBias(frag->first->core.pos, frag_second_endPos,
+         lP += log(getPosBias(first->pos, frag_second_endPos,
                               FullPair, trLen))
-          + log(getSeqBias(frag->first->core.pos, mate_5, tid ))
+          + log(getSeqBias(first->pos, mate_5, tid ))
           + log(getSeqBias(frag_second_endPos , mate_3, tid )); 
 //   }
 //}
@@ -709,7 +875,7 @@ bool ReadDistribution::getP(fragmentP frag,double &lProb,double &lProbNoise){ //
    } //}}}
    lProb = lP + lpSeq1.first+lpSeq2.first;
    lProbNoise = lP + lpSeq1.second+lpSeq2.second;
-   return true;
+   return probValid;
 }//}}}
 void ReadDistribution::updatePosBias(long pos, biasT bias, long tid, double Iexp){ //{{{
    if(bias == readM_3)pos--;
@@ -829,31 +995,119 @@ double ReadDistribution::getSeqBias(long start, long end, readT read, const stri
 }//}}} */
 double ReadDistribution::getWeightNorm(long len, readT read, long tid){ //{{{
    if(len == 0)return 1;
-   if(weightNorms[read][tid].count(len) == 0){
-      const string &trS = trSeq->getTr(tid);
-      // We are not complementing.
-      //for(size_t i=0;i<trRS.size();i++)trRS[i] = complementBase(trRS[i]);
-      long trLen = trInf->L(tid), pos;
-      double norm = 0,w;
-      #pragma omp parallel for \
-         private(w) \
-         reduction(+:norm)
-      for(pos = 0;pos <= trLen-len;pos++){
-         w = getPosBias(pos, pos + len, read, trLen) *
-             getSeqBias(pos, pos + len, read, trS);
-         norm+=w;
+   char ready;
+   #pragma omp atomic read
+   ready = weightNormsReady[read][tid];
+   if(!ready){
+      // Threads do not wait for each other, a table can be computed by more
+      // threads at the same time, only the first one is stored.
+      vector<double> norms;
+      computeWeightNorms(read, tid, &norms);
+      #pragma omp critical(weightNormCache)
+      if(!weightNormsReady[read][tid]){
+         weightNorms[read][tid].swap(norms);
+         #pragma omp flush
+         #pragma omp atomic write
+         weightNormsReady[read][tid] = 1;
+      }
+   }
+   #pragma omp flush
+   const vector<double> &norms = weightNorms[read][tid];
+   if(len < (long)norms.size())return norms[len];
+   // Fragments longer than the table are unlikely, their norm is computed
+   // directly.
+   // This is computed for every such read, reads are already processed in
+   // parallel.
+   const string &trS = trSeq->getTr(tid);
+   long trLen = trInf->L(tid), pos;
+   double w, norm = 0;
+   for(pos = 0;pos <= trLen-len;pos++){
+      w = getPosBias(pos, pos + len, read, trLen) *
+          getSeqBias(pos, pos + len, read, trS);
+      norm+=w;
+   }
+   return norm;
+}//}}}
+void ReadDistribution::computeWeightNorms(readT read, long tid, vector<double> *norms) const{ //{{{
+   const string &trS = trSeq->getTr(tid);
+   // Tables of single reads are computed in linear time, for pairs the time
+   // grows with the number of lengths.
+   long trLen = trInf->L(tid), len, pos, first;
+   long lenN = min(trLen, weightNormLengths);
+   double sum;
+   // Tables are computed by the threads processing reads, where nested
+   // parallel regions run serially (ns_threads::setThreads()). Tasks of long
+   // transcripts are run also by the threads which have finished their reads
+   // and wait at the end of the parallel region. Each value is computed by
+   // one task, so the result does not depend on the number of threads.
+   bool useTasks = (trLen > WEIGHT_NORM_PARALLEL);
+   // Bias of 5' end depends only on fragment's start and bias of 3' end only
+   // on its end, so they are computed once for every position.
+   // w3[pos] is bias of fragment ending at pos.
+   vector<double> w5, w3;
+   if(read != mate_3)w5.resize(trLen);
+   if(read != mate_5)w3.resize(trLen);
+   for(first = 0;first<trLen;first+=WEIGHT_NORM_TASK){
+      #pragma omp task if(useTasks) default(shared) firstprivate(first) private(pos)
+      for(pos = first;(pos<first+WEIGHT_NORM_TASK) && (pos<trLen);pos++){
+         if(read != mate_3)
+            w5[pos] = getPosBias(pos, trLen, mate_5, trLen) *
+                      getSeqBias(pos, trLen, mate_5, trS);
+         if(read != mate_5)
+            w3[pos] = getPosBias(0, pos+1, mate_3, trLen) *
+                      getSeqBias(0, pos+1, mate_3, trS);
+      }
+   }
+   #pragma omp taskwait
+   norms->assign(lenN + 1, 0);
+   (*norms)[0] = 1;
+   if(lenN == 0)return;
+   if(read == mate_5){
+      // Norm is sum of w5 over starts 0..trLen-len, which grows with
+      // decreasing length.
+      sum = 0;
+      for(pos = 0;pos <= trLen-lenN;pos++)sum += w5[pos];
+      (*norms)[lenN] = sum;
+      for(len = lenN-1;len>0;len--){
+         sum += w5[trLen-len];
+         (*norms)[len] = sum;
+      }
+   }else if(read == mate_3){
+      // Norm is sum of w3 over ends len-1..trLen-1.
+      sum = 0;
+      for(pos = lenN-1;pos < trLen;pos++)sum += w3[pos];
+      (*norms)[lenN] = sum;
+      for(len = lenN-1;len>0;len--){
+         sum += w3[len-1];
+         (*norms)[len] = sum;
+      }
+   }else{
+      // Norm of pairs is correlation of w5 and w3.
+      for(first = 1;first<=lenN;first+=WEIGHT_NORM_TASK_LENGTHS){
+         #pragma omp task if(useTasks) default(shared) firstprivate(first) private(len, pos, sum)
+         for(len = first;(len<first+WEIGHT_NORM_TASK_LENGTHS) && (len<=lenN);len++){
+            sum = 0;
+            for(pos = 0;pos <= trLen-len;pos++)sum += w5[pos] * w3[pos+len-1];
+            (*norms)[len] = sum;
+         }
       }
-      weightNorms[read][tid][len] = norm;
-//      message("w: %ld %ld %ld  %ld%lf\n",read,tid,len,trLen<"   ",norm);
-      return norm;
+      #pragma omp taskwait
    }
-   return weightNorms[read][tid][len];
+}//}}}
+void ReadDistribution::computeWeightNormLengths(){ //{{{
+   // Longest fragment with likely length (within the bounds).
+   weightNormLengths = WEIGHT_NORM_LENGTHS;
+   for(long len = min((long)lLengthP.size()-1, WEIGHT_NORM_MAX_LENGTHS);len > weightNormLengths;len--)
+      if(lLengthP[len] > ns_misc::LOG_ZERO){
+         weightNormLengths = len;
+         break;
+      }
 }//}}}
 long ReadDistribution::getWeightNormCount() const{//{{{
    long length_sum=0;
    for(size_t i=0;i<weightNorms.size();i++)
       for(size_t j=0;j<weightNorms[i].size();j++)
-         length_sum+=weightNorms[i][j].size();
+         if(!weightNorms[i][j].empty())length_sum+=weightNorms[i][j].size()-1;
    return length_sum;
 }//}}}
 double ReadDistribution::getLengthLP(long len) const{//{{{
@@ -908,9 +1162,11 @@ void ReadDistribution::computeLengthProb() {//{{{
          normIsOne=true;
       }
    }
+   computeWeightNormLengths();
    if(verbose)timer.current();
 }//}}}
 vector<double> ReadDistribution::getEffectiveLengths(){ //{{{
+   if(!effLengths.empty())return effLengths;
    vector<double> effL(M,0);
    long m,len,trLen,pos;
    double eL, lCdfNorm,lenP, wNorm;
@@ -920,7 +1176,7 @@ vector<double> ReadDistribution::getEffectiveLengths(){ //{{{
    MyTimer timer;
    timer.start();
    DEBUG(message("Eff length: validLength %d ; minFragLen: %ld.\n",(int)validLength,minFragLen));
-   #pragma omp parallel for \
+   #pragma omp parallel for num_threads(procN) \
       schedule (dynamic,5) \
       private (len,trLen,pos,eL,lenP,wNorm,lCdfNorm,trRS)
    for(m=0;m<M;m++){
@@ -1000,8 +1256,149 @@ vector<double> ReadDistribution::getEffectiveLengths(){ //{{{
    }
    DEBUG(message(" same: %ld.\n",same));
    for(m=0;m<M;m++)if(effL[m]<=0) effL[m]=trInf->L(m);
+   effLengths = effL;
    return effL;
 }//}}}
+bool ReadDistribution::saveModel(const string &fileName) const{ //{{{
+   ofstream outF(fileName.c_str(), ios::binary | ios::trunc);
+   if(!outF.is_open()){
+      error("ReadDistribution: Unable to open model file: %s\n",fileName.c_str());
+      return false;
+   }
+   long m,i,j;
+   // Total length of transcripts is used to check that the model is used with the same transcripts.
+   int64_t lengthSum = 0;
+   for(m=0;m<M;m++)lengthSum += trInf->L(m);
+   outF.write(modelMagic, sizeof(modelMagic));
+   writeValue(outF, modelByteOrder);
+   writeValue(outF, modelVersion);
+   writeValue(outF, (int64_t)M);
+   writeValue(outF, lengthSum);
+   writeValue(outF, (int8_t)uniform);
+   writeValue(outF, (int8_t)unstranded);
+   writeValue(outF, (int8_t)validLength);
+   writeValue(outF, (int64_t)singleReadLength);
+   writeValue(outF, (int64_t)minFragLen);
+   writeValue(outF, lMu);
+   writeValue(outF, lSigma);
+   writeVector(outF, lLengthP);
+   writeVector(outF, lLengthNorm);
+   writeVector(outF, lFreqHit);
+   writeVector(outF, lFreqMis);
+   writeVector(outF, effLengths);
+   writeValue(outF, (int64_t)fragLengths.size());
+   for(map<long,long>::const_iterator it=fragLengths.begin();it!=fragLengths.end();it++){
+      writeValue(outF, (int64_t)it->first);
+      writeValue(outF, (int64_t)it->second);
+   }
+   if(!uniform){
+      for(i=0;i<6;i++)
+         for(j=0;j<=trSizesN;j++)writeVector(outF, posProb[i][j]);
+      for(i=0;i<4;i++)
+         for(j=0;j<vlmmNodesN;j++)seqProb[i][j].write(outF);
+   }
+   outF.close();
+   if(outF.fail()){
+      error("ReadDistribution: Writing model file %s failed.\n",fileName.c_str());
+      return false;
+   }
+   return true;
+}//}}}
+bool ReadDistribution::loadModel(const string &fileName, TranscriptInfo* trI, TranscriptSequence* trS, bool verb){ //{{{
+   verbose = verb;
+   if(trI==NULL){
+      error("ReadDistribution: Missing TranscriptInfo.\n");
+      return false;
+   }
+   ifstream inF(fileName.c_str(), ios::binary);
+   if(!inF.is_open()){
+      error("ReadDistribution: Unable to open model file: %s\n",fileName.c_str());
+      return false;
+   }
+   char magic[8];
+   uint32_t byteOrder, version;
+   int64_t modelM, lengthSum, singleLen, minLen, lengthsN, len, count;
+   int8_t flags[3];
+   long m,i,j;
+   inF.read(magic, sizeof(magic));
+   if(inF.fail() || (memcmp(magic, modelMagic, sizeof(magic)) != 0) ||
+      (!readValue(inF, &byteOrder)) || (!readValue(inF, &version))){
+      error("ReadDistribution: File %s is not a read distribution model.\n",fileName.c_str());
+      return false;
+   }
+   if(byteOrder != modelByteOrder){
+      if(byteOrder == 0x04030201){
+         error("ReadDistribution: Model %s was saved on a machine with different byte order.\n",fileName.c_str());
+      }else{
+         error("ReadDistribution: Model %s has invalid byte order marker (older format?).\n",fileName.c_str());
+      }
+      return false;
+   }
+   if(version != modelVersion){
+      error("ReadDistribution: Model %s has format version %u, this version of BitSeq reads version %u.\n",fileName.c_str(),(unsigned)version,(unsigned)modelVersion);
+      return false;
+   }
+   bool ok = readValue(inF, &modelM) && readValue(inF, &lengthSum);
+   if(ok){
+      for(m=0;m<trI->getM();m++)lengthSum -= trI->L(m);
+      if((modelM != trI->getM()) || (lengthSum != 0)){
+         error("ReadDistribution: Model %s was estimated for different transcripts.\n",fileName.c_str());
+         return false;
+      }
+   }
+   ok = ok && readValue(inF, &flags[0]) && readValue(inF, &flags[1]) && readValue(inF, &flags[2]) &&
+      readValue(inF, &singleLen) && readValue(inF, &minLen) &&
+      readValue(inF, &lMu) && readValue(inF, &lSigma) &&
+      readVector(inF, &lLengthP) && readVector(inF, &lLengthNorm) &&
+      readVector(inF, &lFreqHit) && readVector(inF, &lFreqMis) && (lFreqHit.size() == lFreqMis.size()) &&
+      readVector(inF, &effLengths) && (effLengths.empty() || ((long)effLengths.size() == modelM)) &&
+      readValue(inF, &lengthsN) && (lengthsN >= 0);
+   fragLengths.clear();
+   for(i=0;ok && (i<lengthsN);i++){
+      ok = readValue(inF, &len) && readValue(inF, &count);
+      if(ok)fragLengths[(long)len] = (long)count;
+   }
+   if(ok){
+      M = modelM;
+      uniform = flags[0];
+      unstranded = flags[1];
+      validLength = flags[2];
+      singleReadLength = singleLen;
+      minFragLen = minLen;
+   }
+   if(ok && !uniform){
+      if(trS==NULL){
+         error("ReadDistribution: Missing TranscriptSequence.\n");
+         return false;
+      }
+      posProb.assign(6, vector<vector<double> >(trSizesN + 1));
+      for(i=0;ok && (i<6);i++)
+         for(j=0;ok && (j<=trSizesN);j++)
+            ok = readVector(inF, &posProb[i][j]) && ((long)posProb[i][j].size() == trNumberOfBins);
+      seqProb.assign(4, vector<VlmmNode>(vlmmNodesN));
+      for(i=0;ok && (i<4);i++)
+         for(j=0;ok && (j<vlmmNodesN);j++)
+            ok = seqProb[i][j].read(inF);
+      trFragSeen5.assign(M, map<long,double>());
+      trFragSeen3.assign(M, map<long,double>());
+      weightNorms.assign(3, vector<vector<double> >(M));
+      weightNormsReady.assign(3, vector<char>(M,0));
+      computeWeightNormLengths();
+   }
+   if(!ok){
+      error("ReadDistribution: Reading model file %s failed.\n",fileName.c_str());
+      return false;
+   }
+   trInf = trI;
+   trSeq = trS;
+   trExp = NULL;
+   gotExpression = false;
+   lengthSet = false;
+   logLengthSum = logLengthSqSum = 0;
+   fragSeen = 0;
+   if(verbose)message("ReadDistribution: Loaded %s model, fragment length mu: %lg sigma: %lg\n",uniform ? "uniform" : "non-uniform",lMu,lSigma);
+   return true;
+}//}}}
 
 double VlmmNode::getPsum(char b) const{//{{{
    if(base2int(b) == -1) return 1/4;
@@ -1021,6 +1418,9 @@ void VlmmNode::setParentsN(long p) {//{{{
    // initialize probability matrix, set pseudocount:
    probs.assign(pows4[parentsN+1], 0.01/pows4[parentsN+1]);
 }//}}}
+void VlmmNode::clear() {//{{{
+   probs.assign(probs.size(), 0);
+}//}}}
 void VlmmNode::update(double Iexp, char b, char bp, char bpp) {//{{{
    double expDiv = 1.0;
    if(base2int(b) == -1)expDiv *=4.0;
@@ -1062,6 +1462,19 @@ void VlmmNode::update(double Iexp, char b, char bp, char bpp) {//{{{
       }
    }
 }//}}}
+void VlmmNode::merge(const VlmmNode &node) {//{{{
+   for(size_t i=0;i<probs.size() && i<node.probs.size();i++)probs[i] += node.probs[i];
+}//}}}
+void VlmmNode::write(ofstream &outF) const{//{{{
+   writeValue(outF, (int64_t)parentsN);
+   writeVector(outF, probs);
+}//}}}
+bool VlmmNode::read(ifstream &inF){//{{{
+   int64_t p;
+   if(!readValue(inF, &p) || (p < 0) || (p > 2))return false;
+   parentsN = p;
+   return readVector(inF, &probs) && ((long)probs.size() == pows4[parentsN+1]);
+}//}}}
 void VlmmNode::normalize() {//{{{
    double sum=0;
    long i,j,k,index;
@@ -1,6 +1,7 @@
 #ifndef READDISTRIBUTION_H
 #define READDISTRIBUTION_H
 
+#include<fstream>
 #include<vector>
 #include<map>
 
@@ -25,6 +26,18 @@ const char vlmmNodeDependence [] = { 0, 0, 0, 0, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2
 const char vlmmNodesN = 21;
 const char vlmmStartOffset = 8;
 const long pows4 [] = {1,4,16,64,256,1024,4096};
+// Minimal number of positions for computing weight norm in parallel. Weight
+// norms are computed by OpenMP tasks of WEIGHT_NORM_TASK positions (or
+// WEIGHT_NORM_TASK_LENGTHS fragment lengths of pairs).
+const long WEIGHT_NORM_PARALLEL = 4096;
+const long WEIGHT_NORM_TASK = 1024;
+const long WEIGHT_NORM_TASK_LENGTHS = 16;
+// Weight norms are tabulated for lengths up to the longest likely fragment
+// length, but at least up to WEIGHT_NORM_LENGTHS and at most up to
+// WEIGHT_NORM_MAX_LENGTHS (table of pairs takes O(transcript length * lengths)
+// time). Norms of longer fragments are computed directly.
+const long WEIGHT_NORM_LENGTHS = 1000;
+const long WEIGHT_NORM_MAX_LENGTHS = 5000;
 //}}}
 
 struct fragmentT{//{{{
@@ -47,6 +60,30 @@ struct fragmentT{//{{{
 };
 
 typedef fragmentT *fragmentP;
+
+// Alignment of one read reduced to the information needed by getP().
+struct mateRecordT{
+   int32_t tid,pos,endPos;
+   uint16_t flag;
+   // Log probability and 'low' probability of read's sequence, used for reads
+   // with Phred scores.
+   double seqLP,seqLowLP;
+   // Reads without Phred scores depend on mismatch frequencies known only after
+   // normalization, for these store for every base of the read:
+   // 0 (not aligned), 1 (match) or 2 (mismatch).
+   vector<uint8_t> bases;
+   mateRecordT(){
+      tid = pos = endPos = 0;
+      flag = 0;
+      seqLP = seqLowLP = 0;
+   }
+};
+
+struct fragmentRecordT{
+   mateRecordT first,second;
+   bool paired;
+   fragmentRecordT(){ paired = false; }
+};
 //}}}
 
 class VlmmNode{//{{{
@@ -58,20 +95,29 @@ class VlmmNode{//{{{
       VlmmNode(){parentsN = 0;}
       VlmmNode(long p);
       void setParentsN(long p);
+      // Set all counts to zero (no pseudocounts).
+      void clear();
       void update(double Iexp, char b, char bp, char bpp);
+      // Add counts of node with the same number of parents.
+      void merge(const VlmmNode &node);
       void normalize();
       double getP(char b, char bp, char bpp) const;
       double getPsum(char b) const;
+      // Binary save/load of the node (used by saveModel/loadModel).
+      void write(ofstream &outF) const;
+      bool read(ifstream &inF);
 };//}}}
 
 enum biasT { readM_5, readM_3, uniformM_5, uniformM_3, weight_5, weight_3};
 enum readT { mate_5, mate_3, FullPair };
+// Result of computing alignment probability.
+enum probStatusT { probValid, probUnknownTID, probTIDMismatch, probWrongStrand };
 
 } // namespace ns_rD
 
 class ReadDistribution{
    private:
-      long procN,M,fragSeen,singleReadLength,minFragLen;
+      long procN,M,fragSeen,singleReadLength,minFragLen,weightNormLengths;
       double lMu,lSigma,logLengthSum,logLengthSqSum;
       long lowProbMismatches;
       bool verbose,warnFirst,uniform,unstranded,lengthSet,gotExpression,normalized;
@@ -82,9 +128,12 @@ class ReadDistribution{
       TranscriptExpression* trExp;
       // for each transcript, remember seen fragments in map: length->(sum of probs)
       vector<map<long,double> > trFragSeen5,trFragSeen3;
-      // cache for already computed weight norms for:
-      //    (single reads 5',3', Pair) x Transcript x Length
-      vector<vector<map<long, double> > > weightNorms;
+      // Tables of weight norms for lengths 0..min(transcript length,
+      // weightNormLengths) for: (single reads 5',3', Pair) x Transcript
+      // Table of a transcript is computed at once when it is first needed and
+      // can be used without locking once its flag in weightNormsReady is set.
+      vector<vector<vector<double> > > weightNorms;
+      vector<vector<char> > weightNormsReady;
       // position probability arrays (RE-FACTOR to array of 4 vectors)
       vector<vector<vector<double> > > posProb;
       vector<vector<ns_rD::VlmmNode> > seqProb;
@@ -97,6 +146,8 @@ class ReadDistribution{
       // Cache length probabilities.
       vector<double> lLengthP,lLengthNorm;
       map<long,long> fragLengths;
+      // Effective lengths computed by getEffectiveLengths() or loaded with model.
+      vector<double> effLengths;
    
       double getLengthLP(long len) const;
       double computeLengthLP(double len) const;
@@ -113,7 +164,13 @@ class ReadDistribution{
                         const string &fSeq) const;
       //inline char complementBase(char base) const;
       double getWeightNorm(long len, ns_rD::readT read, long tid);
-      pair<double, double> getSequenceLProb(bam1_t *samA) const;
+      void computeWeightNorms(ns_rD::readT read, long tid, vector<double> *norms) const;
+      void computeWeightNormLengths();
+      void getSequenceMatches(const bam1_t *samA, vector<uint8_t> *bases) const;
+      pair<double, double> getSequenceLProb(const vector<uint8_t> &bases,
+                                            const uint8_t *qualP, bool reversed) const;
+      pair<double, double> getSequenceLProb(const ns_rD::mateRecordT &mate) const;
+      void getMateRecord(const bam1_t *samA, ns_rD::mateRecordT *mate) const;
    public:
       ReadDistribution();
       void setProcN(long procN);
@@ -124,11 +181,45 @@ class ReadDistribution{
       void setLowProbMismatches(long m);
       void setLength(double mu, double sigma);
       bool observed(ns_rD::fragmentP frag);
+      // Prepare acc for observing fragments in parallel: acc gets the same
+      // settings and empty statistics (without pseudocounts). Each thread
+      // observes fragments with its own accumulator, which are then added
+      // into this object by merge() before normalize().
+      // Accumulators do not print first warnings.
+      void initAccumulator(ReadDistribution *acc) const;
+      void merge(const ReadDistribution &acc);
+      // Replace profile with normalized statistics observed so far (mean and
+      // standard deviation of log fragment length, positional and sequence
+      // bias of read ends) and return maximal absolute change of its values
+      // (HUGE_VAL if the sizes differ), used for detecting convergence.
+      double profileChange(vector<double> *profile) const;
       void normalize();
       void logProfiles(string logFileName = "");
       bool getP(ns_rD::fragmentP frag,double &prob,double &probNoise);
+      // Store information about fragment's alignment needed by getP, so that
+      // probabilities can be computed after normalize() without the alignment.
+      void getRecord(const ns_rD::fragmentP frag, ns_rD::fragmentRecordT *rec) const;
+      bool getP(const ns_rD::fragmentRecordT &frag, double &prob, double &probNoise,
+                const char *name);
+      // Compute probabilities without updating warning counters, this can be
+      // called from multiple threads. Sets firstMateDown for pairs with first
+      // mate downstream.
+      ns_rD::probStatusT computeP(const ns_rD::fragmentRecordT &frag, double &prob,
+                                  double &probNoise, bool *firstMateDown);
+      // Update warning counters with the result of computeP() (not thread safe).
+      // Returns true for valid probabilities.
+      bool noteP(const ns_rD::fragmentRecordT &frag, ns_rD::probStatusT status,
+                 bool firstMateDown, const char *name);
       long getWeightNormCount() const;
+      // Computed only once, later calls (or calls after loadModel()) return
+      // the same lengths.
       vector<double> getEffectiveLengths();
+      // Save normalized model (and effective lengths if computed) into binary
+      // file, which can be loaded instead of observing fragments and calling
+      // normalize() when processing reads aligned to the same transcripts.
+      // The file is only portable between machines with the same byte order.
+      bool saveModel(const string &fileName) const;
+      bool loadModel(const string &fileName, TranscriptInfo* trI, TranscriptSequence* trS, bool verb = true);
 }; 
 
 #endif
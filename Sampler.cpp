@@ -122,7 +122,7 @@ void Sampler::appendFile(){//{{{
    if((!save) || (outFile == NULL))return;
    thetaActLog.push_back(theta[0]);
    outFile->precision(9);
-   (*outFile)<<scientific;
+   outFile->scientific();
    if(saveType == "counts"){
       if(norm == 0)norm = Nmap;
       for(i=1;i<m;i++)
@@ -145,7 +145,7 @@ void Sampler::appendFile(){//{{{
       for(i=1;i<m;i++)
          (*outFile)<<tau[i]<<" ";
    }
-   (*outFile)<<endl;
+   (*outFile)<<"\n";
 }//}}}
 void Sampler::updateSums(){//{{{
    long i;
@@ -165,7 +165,7 @@ void Sampler::updateSums(){//{{{
    sumNorm.second++;
    //}
 }//}}}
-void Sampler::saveSamples(ofstream *outFile, const vector<double> *isoformLengths, const string &saveType, double norm){//{{{
+void Sampler::saveSamples(AsyncWriter *outFile, const vector<double> *isoformLengths, const string &saveType, double norm){//{{{
    this->outFile = outFile;
    this->isoformLengths = isoformLengths;
    this->saveType = saveType;
@@ -2,13 +2,13 @@
 #define SAMPLER_H
 
 #include<vector>
-#include<fstream>
 #include "boost/random/mersenne_twister.hpp"
 #include "boost/random/gamma_distribution.hpp"
 #include "boost/random/uniform_01.hpp"
 
 using namespace std;
 
+#include "AsyncWriter.h"
 #include "GibbsParameters.h"
 #include "TagAlignments.h"
 
@@ -32,7 +32,7 @@ class Sampler{
    
    bool doLog,save;
    string saveType;
-   ofstream *outFile;
+   AsyncWriter *outFile;
    double saveNorm,logRate;
 #ifdef DoSTATS   
    long long nT,nZ,nTa;
@@ -82,7 +82,7 @@ class Sampler{
    // Return norms for theta sums.
    pairD getSumNorms() const { return sumNorm; }
    // Set sampler into state where samples are saved into the outFile.
-   void saveSamples(ofstream *outFile, const vector<double> *isoformLengths,
+   void saveSamples(AsyncWriter *outFile, const vector<double> *isoformLengths,
                     const string &saveType, double norm = 0);
    // Stop saving samples into the file.
    void noSave();
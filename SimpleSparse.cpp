@@ -1,23 +1,29 @@
+#include<algorithm>
 #include<cmath>
 #include<cstring>
+#include<vector>
 #ifdef _OPENMP
 #include<omp.h>
 #endif
 
+using namespace std;
+
 #include "SimpleSparse.h"
 
-double SimpleSparse::logSumExpVal(long st, long en) const{//{{{
+#include "VecMath.h"
+
+template<typename Real>
+double SimpleSparseT<Real>::logSumExpVal(long st, long en) const{//{{{
    if(st<0)st = 0;
    if((en == -1) || (en > T)) en = T;
    if(st >= en) return 0;
    long i;
-   double sumE = 0, m = val[st];
+   double m = val[st];
    for(i = st; i < en; i++)if(val[i] > m)m = val[i];
-   for(i = st; i < en; i++)
-      sumE += exp(val[i] - m);
-   return  m + log(sumE);
+   return  m + log(ns_vecMath::expSum(val + st, en - st, m));
 }//}}}
-void SimpleSparse::sumRows(double res[]) const{//{{{
+template<typename Real>
+void SimpleSparseT<Real>::sumRows(double res[]) const{//{{{
    long i,r;
    for(r=0;r<N;r++){
       res[r]=0;
@@ -26,11 +32,107 @@ void SimpleSparse::sumRows(double res[]) const{//{{{
       }
    }
 }//}}}
-void SimpleSparse::sumCols(double res[]) const{//{{{
-   memset(res,0,M*sizeof(double));
-   for(long i=0;i<T;i++)res[col[i]]+=val[i];
+template<typename Real>
+void SimpleSparseT<Real>::sumCols(double res[]) const{//{{{
+   long threadsN = 1, m, t;
+#ifdef _OPENMP
+   threadsN = omp_get_max_threads();
+#endif
+   // Each thread sums its rows into its own partial sums, which are then
+   // reduced in parallel over columns.
+   vector<double> partial(threadsN * M, 0);
+   #pragma omp parallel
+   {
+      long thread = 0, i, r;
+#ifdef _OPENMP
+      thread = omp_get_thread_num();
+#endif
+      double *part = &partial[thread * M];
+      #pragma omp for schedule(static)
+      for(r=0;r<N;r++)
+         for(i=rowStart[r];i<rowStart[r+1];i++)part[col[i]]+=rowWeight[r]*val[i];
+   }
+   #pragma omp parallel for private(t)
+   for(m=0;m<M;m++){
+      res[m] = 0;
+      for(t=0;t<threadsN;t++)res[m] += partial[t * M + m];
+   }
+}//}}}
+template<typename Real>
+double SimpleSparseT<Real>::weightSum() const{//{{{
+   double sum = 0;
+   for(long r=0;r<N;r++)sum += rowWeight[r];
+   return sum;
+}//}}}
+template<typename Real>
+bool SimpleSparseT<Real>::sameRows(long r1, long r2) const{//{{{
+   long len = rowStart[r1+1] - rowStart[r1];
+   if(len != rowStart[r2+1] - rowStart[r2])return false;
+   return (memcmp(col + rowStart[r1], col + rowStart[r2], len * sizeof(int_least32_t)) == 0) &&
+          (memcmp(val + rowStart[r1], val + rowStart[r2], len * sizeof(Real)) == 0);
+}//}}}
+template<typename Real>
+long SimpleSparseT<Real>::collapseRows(){//{{{
+   if(!base)return N;
+   long r,i,g,k;
+   // Hash rows and sort them so that identical rows are next to each other.
+   vector<pair<uint64_t,long> > keys(N);
+   #pragma omp parallel for private(i)
+   for(r=0;r<N;r++){
+      // FNV-1a over columns and values.
+      uint64_t h = 14695981039346656037ULL;
+      const unsigned char *bytes;
+      for(i=rowStart[r];i<rowStart[r+1];i++){
+         bytes = (const unsigned char*)&col[i];
+         for(k=0;k<(long)sizeof(int_least32_t);k++)h = (h ^ bytes[k]) * 1099511628211ULL;
+         bytes = (const unsigned char*)&val[i];
+         for(k=0;k<(long)sizeof(Real);k++)h = (h ^ bytes[k]) * 1099511628211ULL;
+      }
+      keys[r] = pair<uint64_t,long>(h, r);
+   }
+   sort(keys.begin(), keys.end());
+   // For each row find its representative: first identical row in the file.
+   vector<long> repr(N);
+   for(g=0;g<N;){
+      for(k=g+1;(k<N) && (keys[k].first == keys[g].first);k++);
+      // Rows g..k-1 have the same hash (sorted by row index), compare them.
+      for(i=g;i<k;i++){
+         repr[keys[i].second] = keys[i].second;
+         for(r=g;r<i;r++)
+            if((repr[keys[r].second] == keys[r].second) && sameRows(keys[r].second, keys[i].second)){
+               repr[keys[i].second] = keys[r].second;
+               break;
+            }
+      }
+      g = k;
+   }
+   vector<pair<uint64_t,long> >().swap(keys);
+   // Compact rows in place, keeping the original order of representatives.
+   vector<long> newRow(N);
+   long newN = 0, newT = 0, st, en;
+   for(r=0;r<N;r++){
+      if(repr[r] != r){
+         rowWeight[newRow[repr[r]]] += 1.0;
+         continue;
+      }
+      newRow[r] = newN;
+      st = rowStart[r];
+      en = rowStart[r+1];
+      rowStart[newN] = newT;
+      rowWeight[newN] = 1.0;
+      for(i=st;i<en;i++,newT++){
+         col[newT] = col[i];
+         val[newT] = val[i];
+      }
+      newN++;
+   }
+   rowStart[newN] = newT;
+   N = newN;
+   T = newT;
+   return N;
 }//}}}
-long SimpleSparse::countAboveDelta(double delta) const{//{{{
+template<typename Real>
+long SimpleSparseT<Real>::countAboveDelta(double delta) const{//{{{
    long i,count=0;
    #pragma omp parallel for reduction(+:count)
    for(i=0;i<T;i++){
@@ -39,7 +141,8 @@ long SimpleSparse::countAboveDelta(double delta) const{//{{{
    return count;
 }//}}}
 
-void SimpleSparse::softmaxInplace(SimpleSparse *res){//{{{
+template<typename Real>
+void SimpleSparseT<Real>::softmaxInplace(SimpleSparseT *res){//{{{
    double logRowSum = 0;
    long i,r;
    #pragma omp parallel for private(i,logRowSum)
@@ -47,40 +150,48 @@ void SimpleSparse::softmaxInplace(SimpleSparse *res){//{{{
       logRowSum = logSumExpVal(rowStart[r],rowStart[r+1]);
       for(i=rowStart[r];i<rowStart[r+1];i++){
          val[i] = val[i] - logRowSum;
-         res->val[i] = exp( val[i] );
+         res->val[i] = val[i];
       }
+      ns_vecMath::expArray(res->val + rowStart[r], rowStart[r+1] - rowStart[r]);
    }
 }//}}}
-void SimpleSparse::softmax(SimpleSparse *res) const{//{{{
+template<typename Real>
+void SimpleSparseT<Real>::softmax(SimpleSparseT *res) const{//{{{
    double logRowSum = 0;
    long i,r;
    #pragma omp parallel for private(i,logRowSum)
    for(r=0;r<N;r++){
       logRowSum = logSumExpVal(rowStart[r],rowStart[r+1]);
       for(i=rowStart[r];i<rowStart[r+1];i++){
-         res->val[i] = exp(val[i] - logRowSum);
+         res->val[i] = val[i] - logRowSum;
       }
+      ns_vecMath::expArray(res->val + rowStart[r], rowStart[r+1] - rowStart[r]);
    }
 }//}}}
 
-SimpleSparse::SimpleSparse(long n,long m, long t){//{{{
+template<typename Real>
+SimpleSparseT<Real>::SimpleSparseT(long n,long m, long t){//{{{
    N=n;
    M=m;
    T=t;
-   val = new double[T];
+   val = new Real[T];
    base = true; // base matrix with it's own col & rowStart information
    col = new int_least32_t[T];
-   rowStart = new int_least32_t[N+1];
+   rowStart = new int_least64_t[N+1];
+   rowWeight = new double[N];
+   for(long r=0;r<N;r++)rowWeight[r] = 1.0;
    //colStart = new long[M+1];
 }//}}}
-SimpleSparse::SimpleSparse(SimpleSparse *m0){//{{{
+template<typename Real>
+SimpleSparseT<Real>::SimpleSparseT(SimpleSparseT *m0){//{{{
    N=m0->N;
    M=m0->M;
    T=m0->T;
-   val = new double[T];
    base = false; // use col & rowStart information from the base matrix m0
    col = m0->col;
    rowStart = m0->rowStart;
+   rowWeight = m0->rowWeight;
+   val = newRowArray();
    /*col = new long[T];
    rowStart = new long[N+1];
    memcpy(col, m0->col, T*sizeof(long));
@@ -88,11 +199,55 @@ SimpleSparse::SimpleSparse(SimpleSparse *m0){//{{{
    */
 }//}}}
 
-SimpleSparse::~SimpleSparse(){//{{{
+template<typename Real>
+Real *SimpleSparseT<Real>::newRowArray() const{//{{{
+   Real *arr = new Real[T];
+   long r,i;
+   #pragma omp parallel for private(i) schedule(static)
+   for(r=0;r<N;r++)
+      for(i=rowStart[r];i<rowStart[r+1];i++)arr[i] = 0;
+   return arr;
+}//}}}
+template<typename Real>
+void SimpleSparseT<Real>::placeRows(){//{{{
+   if(!base)return;
+   long r,i;
+   int_least64_t *newStart = new int_least64_t[N+1];
+   double *newWeight = new double[N];
+   #pragma omp parallel for schedule(static)
+   for(r=0;r<N;r++){
+      newStart[r] = rowStart[r];
+      newWeight[r] = rowWeight[r];
+   }
+   newStart[N] = rowStart[N];
+   Real *newVal = new Real[T];
+   int_least32_t *newCol = new int_least32_t[T];
+   #pragma omp parallel for private(i) schedule(static)
+   for(r=0;r<N;r++)
+      for(i=rowStart[r];i<rowStart[r+1];i++){
+         newVal[i] = val[i];
+         newCol[i] = col[i];
+      }
+   delete[] val;
+   delete[] col;
+   delete[] rowStart;
+   delete[] rowWeight;
+   val = newVal;
+   col = newCol;
+   rowStart = newStart;
+   rowWeight = newWeight;
+}//}}}
+
+template<typename Real>
+SimpleSparseT<Real>::~SimpleSparseT(){//{{{
    delete[] val;
    if(base){
       // BEWARE there could be other matrices using this data 
       delete[] col;
       delete[] rowStart;
+      delete[] rowWeight;
    }
 }//}}}
+
+template class SimpleSparseT<double>;
+template class SimpleSparseT<float>;
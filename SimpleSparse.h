@@ -5,23 +5,50 @@
 
 //#define setVal(x,i,y) {for(i=0;i<x->T;i++)x->val[i]=y;}
 
-class SimpleSparse {
+// Sparse matrix (rows are reads, columns transcripts) with values stored in
+// double or, to halve the memory, in single precision (Real = float).
+template<typename Real>
+class SimpleSparseT {
    private:
    bool base;
+   bool sameRows(long r1, long r2) const;
    public:
    long N,M,T; // reads, transcripts, total
-   int_least32_t *rowStart,*colStart,*col;
-   double *val;
+   // Row offsets are 64 bit as the number of alignments can exceed 2^31.
+   int_least64_t *rowStart;
+   int_least32_t *col;
+   Real *val;
+   // Number of reads represented by each row (1 unless rows were collapsed).
+   double *rowWeight;
 
-   SimpleSparse(long n,long m, long t);
-   SimpleSparse(SimpleSparse *m0);
-   ~SimpleSparse();
-   void softmax(SimpleSparse *res) const;
-   void softmaxInplace(SimpleSparse *res);
+   SimpleSparseT(long n,long m, long t);
+   // Matrix sharing col & rowStart with m0; values are initialised in
+   // parallel over rows (see newRowArray()).
+   SimpleSparseT(SimpleSparseT *m0);
+   ~SimpleSparseT();
+   // Merge identical rows (same columns and values) into one row with
+   // weight equal to the number of merged rows. Only for base matrix.
+   // Returns number of rows after collapsing.
+   long collapseRows();
+   // Sum of row weights, i.e. number of reads.
+   double weightSum() const;
+   void softmax(SimpleSparseT *res) const;
+   void softmaxInplace(SimpleSparseT *res);
    long countAboveDelta(double delta = 0.99) const;
+   // Weighted sum of columns.
    void sumCols(double res[]) const;
    void sumRows(double res[]) const;
    double logSumExpVal(long st, long en) const;
+   // Allocate array of T values set to zero in parallel (static schedule over
+   // rows), so that with first-touch NUMA policy the memory of each row block
+   // is placed on the node of the thread processing it.
+   Real *newRowArray() const;
+   // Move arrays of base matrix into new memory, copied in parallel as in
+   // newRowArray(). Use before creating matrices sharing the columns.
+   void placeRows();
 };
 
+typedef SimpleSparseT<double> SimpleSparse;
+typedef SimpleSparseT<float> SimpleSparseF;
+
 #endif
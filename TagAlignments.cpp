@@ -5,15 +5,33 @@
 #include "misc.h"
 
 #include "common.h"
+#include "VecMath.h"
 
 //#define MEM_USAGE
 
-TagAlignments::TagAlignments(bool storeL){//{{{
+TagAlignments::TagAlignments(bool storeL, ns_tagAlignments::ProbStorage storage){//{{{
    knowNtotal=false;
    knowNreads=false;
    Ntotal=0;
    Nreads=0;
    storeLog = storeL;
+   this->storage = storage;
+   if(storage == ns_tagAlignments::QUANTISED_STORAGE){
+      quantTable.resize(ns_tagAlignments::quantZero + 1);
+      for(long q=0;q<ns_tagAlignments::quantZero;q++){
+         if(storeLog) quantTable[q] = - q / ns_tagAlignments::quantScale;
+         else quantTable[q] = exp(- q / ns_tagAlignments::quantScale);
+      }
+      quantTable[ns_tagAlignments::quantZero] = storeLog ? ns_misc::LOG_ZERO : 0;
+   }
+}//}}}
+void TagAlignments::reserveAlignments(long n){//{{{
+   trIds.reserve(n);
+   switch(storage){
+      case ns_tagAlignments::FLOAT_STORAGE: probsF.reserve(n); break;
+      case ns_tagAlignments::QUANTISED_STORAGE: probsQ.reserve(n); break;
+      default: probs.reserve(n);
+   }
 }//}}}
 void TagAlignments::init(long Nreads,long Ntotal, long M){//{{{
    currentRead = 0;
@@ -29,8 +47,7 @@ void TagAlignments::init(long Nreads,long Ntotal, long M){//{{{
       this->Ntotal=Ntotal;
       knowNtotal=true;
       reservedN = Ntotal+1;
-      trIds.reserve(reservedN);
-      probs.reserve(reservedN);
+      reserveAlignments(reservedN);
    }
    if(M>0){
       this->M=M;
@@ -53,69 +70,86 @@ void TagAlignments::pushAlignmentL(long trId, double lProb){//{{{
       // The read has already one alignment to this transcript.
      for(long i=readIndex[currentRead];i<(long)trIds.size();i++)
         if(trIds[i] == trId){
-           probs[i] = ns_math::logAddExp(probs[i], lProb);
+           readProbs[i-readIndex[currentRead]] = ns_math::logAddExp(readProbs[i-readIndex[currentRead]], lProb);
            break;
         }
    }else{
       if(! knowNtotal){
          // the size of arrays is unknown try to reserve sensible amount of space if we know Nreads
-         if(knowNreads && reservedN && ((long)probs.size() == reservedN)){
+         if(knowNreads && reservedN && ((long)trIds.size() == reservedN)){
             // we reached the size of reserved space
-            double dens = (double)probs.size() / currentRead; 
+            double dens = (double)trIds.size() / currentRead; 
             dens *= 1.05; //increase it by 5%
             reservedN =(long)( reservedN + (dens) * (Nreads - currentRead + 1000.0) );
          #ifdef MEM_USAGE
-            message("TagAlignments:\n   size: %ld  reserving: %ld  capacity before: %ld\n",probs.size(),reservedN,probs.capacity());
+            message("TagAlignments:\n   size: %ld  reserving: %ld  capacity before: %ld\n",trIds.size(),reservedN,trIds.capacity());
          #endif
-            trIds.reserve(reservedN);
-            probs.reserve(reservedN);
+            reserveAlignments(reservedN);
          #ifdef MEM_USAGE
-            message("   capacity after: %ld\n",probs.capacity());
+            message("   capacity after: %ld\n",trIds.capacity());
          #endif
          }else if(knowNreads && (! reservedN) && (currentRead == Nreads / 4 )){
             // one quarter in, try to reserve sensible amount of space
-            double dens = (double)probs.size() / currentRead; 
+            double dens = (double)trIds.size() / currentRead; 
             dens *= 1.05; //increase it by 5%
             reservedN =(long)((dens) * (Nreads));
          #ifdef MEM_USAGE
-            message("TagAlignments:\n   size: %ld  reserving: %ld  capacity before: %ld\n",probs.size(),reservedN,probs.capacity());
+            message("TagAlignments:\n   size: %ld  reserving: %ld  capacity before: %ld\n",trIds.size(),reservedN,trIds.capacity());
          #endif
-            trIds.reserve(reservedN);
-            probs.reserve(reservedN);
+            reserveAlignments(reservedN);
          #ifdef MEM_USAGE
-            message("   capacity after: %ld\n",probs.capacity());
+            message("   capacity after: %ld\n",trIds.capacity());
          #endif
          }
       }
       trIds.push_back(trId);
-      probs.push_back(lProb);
+      readProbs.push_back(lProb);
       // Mark that transcript trId already has alignment from this read.
       readsInIsoform[trId] = currentRead;
    }
 }//}}}
 void TagAlignments::pushRead(){//{{{
    // Check whether there were any valid alignments added for this read:
-   if(readIndex[currentRead] == (int_least32_t) probs.size()){
+   if(readProbs.empty()){
       // If no new alignments, do nothing.
       return;
    }
-   // If there are alignments transform from log space if necessary and move to next read.
-   if(!storeLog){
-      double logSum = ns_math::logSumExp(probs, readIndex[currentRead], probs.size());
-      for(long i = readIndex[currentRead]; i<(long)probs.size(); i++)
-         probs[i] = exp(probs[i]-logSum);
+   // If there are alignments transform from log space if necessary and store them.
+   long i, n = readProbs.size();
+   if((!storeLog) || (storage == ns_tagAlignments::QUANTISED_STORAGE)){
+      double logSum = ns_math::logSumExp(readProbs);
+      for(i = 0; i < n; i++) readProbs[i] -= logSum;
+      if(!storeLog) ns_vecMath::expArray(&readProbs[0], n);
    }
+   switch(storage){
+      case ns_tagAlignments::FLOAT_STORAGE:
+         for(i = 0; i < n; i++) probsF.push_back((float)readProbs[i]);
+         break;
+      case ns_tagAlignments::QUANTISED_STORAGE:{
+         // Quantise normalised log probability.
+         double lProb, q;
+         for(i = 0; i < n; i++){
+            lProb = storeLog ? readProbs[i] : log(readProbs[i]);
+            q = floor(- lProb * ns_tagAlignments::quantScale + 0.5);
+            if((q >= ns_tagAlignments::quantZero) || (q != q)) probsQ.push_back(ns_tagAlignments::quantZero);
+            else probsQ.push_back((uint_least16_t)(q < 0 ? 0 : q));
+         }
+         break;}
+      default:
+         probs.insert(probs.end(), readProbs.begin(), readProbs.end());
+   }
+   readProbs.clear();
    // Move to the next read.
    currentRead++;
-   readIndex.push_back(probs.size());
+   readIndex.push_back(trIds.size());
 }//}}}
 void TagAlignments::finalizeRead(long *M, long *Nreads, long *Ntotal){//{{{
    *M = this->M = readsInIsoform.size();
    *Nreads = this->Nreads = readIndex.size() - 1;
-   *Ntotal = this->Ntotal = probs.size();
+   *Ntotal = this->Ntotal = trIds.size();
 #ifdef MEM_USAGE
    message("TagAlignments: readIndex size: %ld  capacity %ld\n",readIndex.size(),readIndex.capacity());
-   message("TagAlignments: probs size: %ld  capacity %ld\n",probs.size(),probs.capacity());
+   message("TagAlignments: trIds size: %ld  capacity %ld\n",trIds.size(),trIds.capacity());
 #endif
 }//}}}
 int_least32_t TagAlignments::getTrId(long i) const {//{{{
@@ -123,10 +157,14 @@ int_least32_t TagAlignments::getTrId(long i) const {//{{{
    return 0;
 }//}}}
 double TagAlignments::getProb(long i) const {//{{{
-   if(i<Ntotal)return probs[i];
-   return 0;
+   if(i>=Ntotal)return 0;
+   switch(storage){
+      case ns_tagAlignments::FLOAT_STORAGE: return probsF[i];
+      case ns_tagAlignments::QUANTISED_STORAGE: return quantTable[probsQ[i]];
+      default: return probs[i];
+   }
 }//}}}
-int_least32_t TagAlignments::getReadsI(long i) const {//{{{
+int_least64_t TagAlignments::getReadsI(long i) const {//{{{
    if(i<=Nreads)return readIndex[i];
    return 0;
 }//}}}
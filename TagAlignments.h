@@ -8,18 +8,45 @@ using namespace std;
 
 // Probabilities are stored in log scale.
 
+namespace ns_tagAlignments {
+// Precision of stored probabilities:
+// DOUBLE_STORAGE - double (default)
+// FLOAT_STORAGE - float
+// QUANTISED_STORAGE - logarithm of probability normalised within read, quantised
+//   into 16 bits with step 1/quantScale; the smallest representable
+//   probability is about exp(-64), smaller probabilities are stored as zero
+enum ProbStorage { DOUBLE_STORAGE, FLOAT_STORAGE, QUANTISED_STORAGE };
+const double quantScale = 1024;
+const uint_least16_t quantZero = 65535;
+} // namespace ns_tagAlignments
+
 class TagAlignments{
    private:
       vector<int_least32_t> trIds;
+      // Only one of the probability arrays is used, based on storage.
       vector<double> probs;
-      vector<int_least32_t> readIndex;
-      vector<int_least32_t> readsInIsoform;
+      vector<float> probsF;
+      vector<uint_least16_t> probsQ;
+      // Values of quantised probabilities.
+      vector<double> quantTable;
+      // Log-probabilities of alignments of current read, moved into storage by pushRead().
+      vector<double> readProbs;
+      ns_tagAlignments::ProbStorage storage;
+      // Offsets of reads' alignments; 64 bit as the number of alignments can exceed 2^31.
+      vector<int_least64_t> readIndex;
+      vector<int_least64_t> readsInIsoform;
 
       bool storeLog,knowNtotal,knowNreads;
       long M,Ntotal,Nreads,currentRead,reservedN;
+
+      // Reserve space for n alignments.
+      void reserveAlignments(long n);
    public:
-      // Constructor, can specify whether the probabilities should be stored in log space.
-      TagAlignments(bool storeL = true);
+      // Constructor, can specify whether the probabilities should be stored in log space
+      // and the precision of storage.
+      // With QUANTISED_STORAGE the probabilities are always normalised within each read
+      // (this does not change relative probabilities of read's alignments).
+      TagAlignments(bool storeL = true, ns_tagAlignments::ProbStorage storage = ns_tagAlignments::DOUBLE_STORAGE);
       // Initialize reader. For non-zero arguments, also reserves some memory.
       void init(long Nreads = 0,long Ntotal = 0,long M = 0);
       // Add alignment for currently processed read.
@@ -36,7 +63,7 @@ class TagAlignments{
       // (if it is stored in log space, return log-probability)
       double getProb(long i) const;
       // Get index for i-th read's alignments.
-      int_least32_t getReadsI(long i) const;
+      int_least64_t getReadsI(long i) const;
       // Get number of reads.
       long getNreads() const { return Nreads;}
 }; 
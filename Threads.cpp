@@ -0,0 +1,260 @@
+#ifdef __linux__
+// for sched_getcpu and CPU_SET
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include<sched.h>
+#endif
+#include<cmath>
+#include<cstdio>
+#include<cstdlib>
+#include<fstream>
+#include<vector>
+#ifdef _OPENMP
+#include<omp.h>
+#endif
+
+#include "Threads.h"
+
+#include "common.h"
+
+namespace ns_threads {
+
+// NUMA node of every CPU, read from sysfs once.
+static const vector<long> &cpuNodes(){//{{{
+   static vector<long> nodes;
+   static bool loaded = false;
+   #pragma omp critical(threadsCpuNodes)
+   if(!loaded){
+#ifdef __linux__
+      char name[64];
+      long node, first, last, cpu;
+      for(node = 0; ; node++){
+         sprintf(name, "/sys/devices/system/node/node%ld/cpulist", node);
+         FILE *f = fopen(name, "r");
+         if(f == NULL)break;
+         // Format: 0-3,8-11
+         while(fscanf(f, "%ld", &first) == 1){
+            last = first;
+            int c = fgetc(f);
+            if(c == '-'){
+               if(fscanf(f, "%ld", &last) != 1)break;
+               c = fgetc(f);
+            }
+            if(last >= (long)nodes.size())nodes.resize(last + 1, 0);
+            for(cpu = first; cpu <= last; cpu++)nodes[cpu] = node;
+            if(c != ',')break;
+         }
+         fclose(f);
+      }
+#endif
+      loaded = true;
+   }
+   return nodes;
+}//}}}
+
+// Threads set by setThreads(), 0 if not set.
+static long threadsSet = 0;
+
+// CPUs allowed by quota in files (quota and period in microseconds), 0 for
+// no limit or missing files.
+static double cgroupQuota(const string &quotaFile, const string &periodFile){//{{{
+   ifstream qF(quotaFile.c_str());
+   if(!qF.is_open())return 0;
+   string quota;
+   double period = 0;
+   qF>>quota;
+   if(periodFile.empty()){
+      // cgroup v2 cpu.max: "<quota|max> <period>"
+      qF>>period;
+   }else{
+      ifstream pF(periodFile.c_str());
+      pF>>period;
+   }
+   if((quota == "max") || (quota.empty()) || (quota[0] == '-') || (period <= 0))return 0;
+   return atof(quota.c_str()) / period;
+}//}}}
+
+long cgroupCPUs(const string &root, const string &cgroupFile){//{{{
+   // Find process' cgroups (v2 line "0::<path>", v1 line "<id>:<controllers>:<path>").
+   string line, v2Path, v1Path;
+   ifstream cgF(cgroupFile.c_str());
+   while(getline(cgF, line)){
+      size_t c1 = line.find(':'), c2 = line.find(':', c1 + 1);
+      if((c1 == string::npos) || (c2 == string::npos))continue;
+      string controllers = line.substr(c1 + 1, c2 - c1 - 1);
+      if(line.substr(0, c1) == "0")v2Path = line.substr(c2 + 1);
+      else if((controllers == "cpu") || (controllers.find("cpu,") == 0) || (controllers.find(",cpu") != string::npos))
+         v1Path = line.substr(c2 + 1);
+   }
+   double quota = cgroupQuota(root + v2Path + "/cpu.max", "");
+   if(quota <= 0)quota = cgroupQuota(root + "/cpu.max", "");
+   const char *v1Dirs[] = {"/cpu", "/cpu,cpuacct"};
+   for(long d = 0; (d < 2) && (quota <= 0); d++){
+      string dir = root + v1Dirs[d];
+      quota = cgroupQuota(dir + v1Path + "/cpu.cfs_quota_us", dir + v1Path + "/cpu.cfs_period_us");
+      if(quota <= 0)quota = cgroupQuota(dir + "/cpu.cfs_quota_us", dir + "/cpu.cfs_period_us");
+   }
+   return (quota > 0) ? (long)ceil(quota) : 0;
+}//}}}
+
+long availableCPUs(){//{{{
+   long cpus = 1;
+#ifdef _OPENMP
+   cpus = omp_get_num_procs();
+#endif
+#ifdef __linux__
+   cpu_set_t allowed;
+   if(sched_getaffinity(0, sizeof(allowed), &allowed) == 0)cpus = CPU_COUNT(&allowed);
+   long quota = cgroupCPUs("/sys/fs/cgroup", "/proc/self/cgroup");
+   if((quota > 0) && (quota < cpus))cpus = quota;
+#endif
+   return (cpus < 1) ? 1 : cpus;
+}//}}}
+
+long setThreads(long procN, bool verbose){//{{{
+   long available = availableCPUs(), threads = procN;
+   if((threads <= 0) || (threads > available))threads = available;
+#ifdef _OPENMP
+   omp_set_num_threads(threads);
+   if(!omp_in_parallel()){
+      omp_set_dynamic(0);
+      omp_set_max_active_levels(1);
+      threadsSet = threads;
+   }
+#else
+   threads = 1;
+   threadsSet = 1;
+#endif
+   if(verbose)message("Using %ld threads (%ld CPUs available).\n", threads, available);
+   return threads;
+}//}}}
+
+long threadsN(){//{{{
+#ifdef _OPENMP
+   if(threadsSet > 0)return threadsSet;
+   long threads = availableCPUs();
+   if(threads > omp_get_max_threads())threads = omp_get_max_threads();
+   return threads;
+#else
+   return 1;
+#endif
+}//}}}
+
+long numaNodes(){//{{{
+   const vector<long> &nodes = cpuNodes();
+   long n = 1;
+   for(long i = 0; i < (long)nodes.size(); i++)if(nodes[i] >= n)n = nodes[i] + 1;
+   return n;
+}//}}}
+
+long currentNode(){//{{{
+#ifdef __linux__
+   const vector<long> &nodes = cpuNodes();
+   int cpu = sched_getcpu();
+   if((cpu >= 0) && (cpu < (long)nodes.size()))return nodes[cpu];
+#endif
+   return 0;
+}//}}}
+
+bool pinThreads(const string &mode, bool verbose){//{{{
+   if(mode == "none")return true;
+   if((mode != "close") && (mode != "spread")){
+      error("Threads: Unknown pinning mode '%s' (use none, close or spread).\n", mode.c_str());
+      return false;
+   }
+#if defined(__linux__) && defined(_OPENMP)
+   cpu_set_t allowed;
+   if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0){
+      warning("Threads: Can not get CPU affinity, threads are not pinned.\n");
+      return false;
+   }
+   const vector<long> &nodes = cpuNodes();
+   long nodesN = numaNodes(), cpu, i, n;
+   // CPUs the process may use, by node.
+   vector<vector<long> > nodeCpus(nodesN);
+   for(cpu = 0; cpu < CPU_SETSIZE; cpu++){
+      if(!CPU_ISSET(cpu, &allowed))continue;
+      nodeCpus[(cpu < (long)nodes.size()) ? nodes[cpu] : 0].push_back(cpu);
+   }
+   vector<long> order;
+   if(mode == "close"){
+      for(n = 0; n < nodesN; n++)order.insert(order.end(), nodeCpus[n].begin(), nodeCpus[n].end());
+   }else{
+      for(i = 0; ; i++){
+         long added = 0;
+         for(n = 0; n < nodesN; n++)
+            if(i < (long)nodeCpus[n].size()){
+               order.push_back(nodeCpus[n][i]);
+               added++;
+            }
+         if(added == 0)break;
+      }
+   }
+   if(order.empty())return false;
+   long failed = 0;
+   #pragma omp parallel reduction(+:failed) private(i)
+   {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      long thread = omp_get_thread_num(), threadCpu = order[thread % order.size()];
+      if(thread == 0){
+         // Threads created later by the main thread (writers, BGZF workers)
+         // inherit its mask, so it is bound to all CPUs of its node instead
+         // of a single CPU.
+         const vector<long> &node = nodeCpus[(threadCpu < (long)nodes.size()) ? nodes[threadCpu] : 0];
+         for(i = 0; i < (long)node.size(); i++)CPU_SET(node[i], &set);
+      }else{
+         CPU_SET(threadCpu, &set);
+      }
+      if(sched_setaffinity(0, sizeof(set), &set) != 0)failed++;
+   }
+   if(failed > 0){
+      warning("Threads: Pinning of %ld threads failed.\n", failed);
+      return false;
+   }
+   if(verbose)message("Threads pinned (%s) to %ld CPUs on %ld NUMA nodes.\n", mode.c_str(), (long)order.size(), nodesN);
+   return true;
+#else
+   if(verbose)message("Threads: Pinning is not supported on this system.\n");
+   return true;
+#endif
+}//}}}
+
+ThreadShare::ThreadShare(long procN, long jobsN){//{{{
+   this->procN = (procN < 1) ? 1 : procN;
+   running.assign(jobsN, false);
+}//}}}
+
+void ThreadShare::start(long job){//{{{
+   #pragma omp critical(threadsShare)
+   running[job] = true;
+   update(job);
+}//}}}
+
+void ThreadShare::finish(long job){//{{{
+   #pragma omp critical(threadsShare)
+   running[job] = false;
+}//}}}
+
+long ThreadShare::threads(long job){//{{{
+   long runningN = 0, before = 0, j;
+   #pragma omp critical(threadsShare)
+   {
+      for(j = 0; j < (long)running.size(); j++)
+         if(running[j]){
+            if(j < job)before++;
+            runningN++;
+         }
+   }
+   if(runningN == 0)return procN;
+   // First procN % runningN jobs get one thread more.
+   long threads = procN / runningN + ((before < procN % runningN) ? 1 : 0);
+   return (threads < 1) ? 1 : threads;
+}//}}}
+
+long ThreadShare::update(long job){//{{{
+   return setThreads(threads(job));
+}//}}}
+
+} // namespace ns_threads
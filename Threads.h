@@ -0,0 +1,73 @@
+#ifndef THREADS_H
+#define THREADS_H
+
+#include<string>
+#include<vector>
+
+using namespace std;
+
+// Number of OpenMP threads used by the programs and placement of threads on
+// NUMA machines (CPU quotas and NUMA are detected on Linux only, other systems
+// behave as a single node without pinning and quota).
+namespace ns_threads {
+
+// Number of CPUs the process can use: CPUs in its affinity mask limited by
+// cgroup (v1 or v2) CPU quota rounded up.
+long availableCPUs();
+
+// CPUs allowed by cgroup CPU quota (rounded up) of the process whose cgroups
+// are listed in cgroupFile (format of /proc/self/cgroup), with cgroup file
+// systems mounted under root (v2 cpu.max, v1 cpu.cfs_quota_us and
+// cpu.cfs_period_us under cpu or cpu,cpuacct). Returns 0 if there is no quota.
+long cgroupCPUs(const string &root, const string &cgroupFile);
+
+// Set number of threads of following parallel regions to procN limited by
+// available CPUs (procN <= 0 means all available CPUs). Outside of parallel
+// regions it also makes nested parallel regions run serially, so that
+// parallel functions called from parallel code do not oversubscribe CPUs.
+// Returns the number of threads.
+long setThreads(long procN, bool verbose = false);
+
+// Number of threads set by setThreads() (available CPUs if not called).
+long threadsN();
+
+// Number of NUMA nodes (1 if unknown).
+long numaNodes();
+
+// NUMA node of the CPU the calling thread is running on (0 if unknown).
+long currentNode();
+
+// Pin each thread of the OpenMP team (of current size) to one CPU:
+//  "close"  - consecutive CPUs (fill node after node),
+//  "spread" - CPUs alternating between NUMA nodes,
+//  "none"   - do not pin.
+// The main thread is bound to all CPUs of the node of its CPU, so that helper
+// threads it creates later are not confined to one CPU.
+// Threads stay pinned for following parallel regions with the same number of
+// threads. Returns false for unknown mode or if pinning failed.
+bool pinThreads(const string &mode, bool verbose = false);
+
+// Threads shared by jobs running concurrently, each job being a thread of an
+// outer parallel region which runs its own (nested) parallel regions. procN
+// threads are split evenly between running jobs; when a job finishes its
+// threads are handed to the running jobs at their next update().
+class ThreadShare{
+   private:
+      long procN;
+      vector<bool> running;
+   public:
+      ThreadShare(long procN, long jobsN);
+      // Mark job as running and update() its threads.
+      void start(long job);
+      // Mark job as finished.
+      void finish(long job);
+      // Number of threads of job: procN split between running jobs.
+      long threads(long job);
+      // Set threads of the following parallel regions of the calling job
+      // (see setThreads()). Returns the number of threads.
+      long update(long job);
+};
+
+} // namespace ns_threads
+
+#endif
@@ -26,7 +26,7 @@ TranscriptExpression::TranscriptExpression(const string &fileName, TE_FileType f
 bool TranscriptExpression::readExpression(const string &fileName, TE_FileType fileType){//{{{
    long i;
    if(fileType == GUESS)fileType = guessFileType(fileName);
-   ifstream varFile(fileName.c_str());
+   IGzStream varFile(fileName.c_str());
    FileHeader fh(&varFile);
    if((!fh.varianceHeader(&M,&logged))||(M==0)){
       error("TranscriptExpression: Problem loading variance file %s\n",(fileName).c_str());
@@ -1,6 +1,7 @@
 #include<fstream>
 #include<set>
 
+#include "GzStream.h"
 #include"TranscriptInfo.h"
 
 #include "common.h"
@@ -121,7 +122,7 @@ TranscriptInfo::TranscriptInfo(string fileName){//{{{
 }//}}}
 bool TranscriptInfo::readInfo(string fileName){//{{{
    clearTranscriptInfo();
-   ifstream trFile(fileName.c_str());
+   IGzStream trFile(fileName.c_str());
    if(!trFile.is_open()){
       error("TranscriptInfo: problem reading transcript file.\n");
       return false;
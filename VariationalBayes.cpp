@@ -1,3 +1,4 @@
+#include<algorithm>
 #include<fstream>
 #include<iomanip>
 #include<cmath>
@@ -5,40 +6,58 @@
 #ifdef _OPENMP
 #include<omp.h>
 #endif
-#include "asa103/asa103.hpp"
 #include "boost/random/normal_distribution.hpp"
 #include "boost/random/gamma_distribution.hpp"
 
 #include "VariationalBayes.h"
 
 #include "common.h"
+#include "VecMath.h"
 
 #define SWAPD(x,y) {tmpD=x;x=y;y=tmpD;}
 #define ZERO_LIMIT 1e-12
+// Number of transcripts in one call of digamma kernel.
+const long DIGAMMA_BLOCK = 1024;
+// Number of rows for which exp is computed in one call in unpack.
+const long UNPACK_BLOCK = 256;
 
 typedef boost::random::gamma_distribution<double>::param_type gDP;
 
-void VariationalBayes::setLog(string logFileName,MyTimer *timer){//{{{
+// Write samplesN samples from Dirichlet(dirAlpha) into outF (without the
+// noise transcript 0). Deletes isoformLengths.
+static void sampleDirichlet(const vector<double> &dirAlpha, long Nreads, long samplesN, const string &outTypeS, const vector<double> *isoformLengths, AsyncWriter *outF, boost::random::mt11213b &rng_mt);
+
+template<typename Real>
+void VariationalBayesT<Real>::setLog(string logFileName,MyTimer *timer){//{{{
    this->logFileName=logFileName;
    this->logTimer=timer;
 }//}}}
-VariationalBayes::VariationalBayes(SimpleSparse *_beta,double *_alpha,long seed,long procN){//{{{
+template<typename Real>
+VariationalBayesT<Real>::VariationalBayesT(SimpleSparseT<Real> *_beta,double *_alpha,long seed,bool lean){//{{{
 /*
  As bitseq_vb::__init__(self, alpha, beta) in python
  Python difference:
   - python version excludes beta.data <= 1e-40
 */
    quiet = false;
+   this->lean = lean;
+   activeSet = false;
+   activeTol = 0;
+   activeCheck = 20;
+   frozenAB = 0;
+   reducer = NULL;
+   threadShare = NULL;
+   threadJob = 0;
    logFileName = "tmp.convLog";
    logTimer = NULL;
-#ifdef SUPPORT_OPENMP
-   omp_set_num_threads(procN);
-#endif
    long i;
    beta=_beta;
    N=beta->N;
    M=beta->M;
    T=beta->T;
+   // Rows of beta can represent multiple identical reads, all reads of one
+   // row share phi; per read terms are weighted by the row weight.
+   Nreads=(long)floor(beta->weightSum()+0.5);
    
    //logBeta= new SimpleSparse(beta);
    //beta already contains log probabilities.
@@ -57,88 +76,332 @@ VariationalBayes::VariationalBayes(SimpleSparse *_beta,double *_alpha,long seed,
    //typedef boost::random::normal_distribution<long double>::param_type nDP;
    //normalD.param(nDP(0,1));
 
-   phi_sm = new SimpleSparse(beta);
+   phi_sm = new SimpleSparseT<Real>(beta);
    for(i=0;i<T;i++)phi_sm->val[i] = normalD(rng_mt);
-   phi = new SimpleSparse(beta);
+   // In lean mode phi is not stored, it is computed as exp(phi_sm) when needed.
+   phi = lean ? NULL : new SimpleSparseT<Real>(beta);
    // PyDif make phi a copy of phi_sm <- not important because of unpack() coming up next
    
    unpack(phi_sm->val); //unpack(pack()); 
 
+   setBoundConstant();
+}//}}}
+template<typename Real>
+void VariationalBayesT<Real>::setBoundConstant(){//{{{
    double alphaS=0,gAlphaS=0;
-   for(i=0;i<M;i++){
+   for(long i=0;i<M;i++){
       alphaS+=alpha[i];
       gAlphaS+=lgamma(alpha[i]);
    }
-   boundConstant = lgamma(alphaS) - gAlphaS - lgamma(alphaS+N);
+   boundConstant = lgamma(alphaS) - gAlphaS - lgamma(alphaS+Nreads);
+}//}}}
+template<typename Real>
+void VariationalBayesT<Real>::setReducer(AllReduce *reducer){//{{{
+   this->reducer = reducer;
+   Nreads = (long)floor(globalSum(beta->weightSum()) + 0.5);
+   setBoundConstant();
+   // Get phiHat and bound of all reads.
+   unpack(phi_sm->val);
+}//}}}
+
+template<typename Real>
+void VariationalBayesT<Real>::setThreadShare(ns_threads::ThreadShare *share, long job){//{{{
+   threadShare = share;
+   threadJob = job;
+}//}}}
+template<typename Real>
+void VariationalBayesT<Real>::initPhi(const double initAlpha[]){//{{{
+/*
+ phi_nm is proportional to beta_nm * exp(digamma(initAlpha_m)), which is the
+ optimal phi for q(theta) = Dirichlet(initAlpha).
+*/
+   long i;
+   vector<double> digInit(initAlpha, initAlpha + M);
+   ns_vecMath::digammaArray(&digInit[0], M);
+   for(i=0;i<T;i++)phi_sm->val[i] = (Real)(beta->val[i] + digInit[beta->col[i]]);
+   unpack(phi_sm->val);
+}//}}}
+template<typename Real>
+long VariationalBayesT<Real>::memoryEstimate(long T, OPT_TYPE method, bool lean){//{{{
+   // beta and phi_sm values and shared column indices
+   long arrays = 2;
+   if(lean){
+      // search direction only (steepest and FR)
+      arrays += 1;
+   }else{
+      // phi
+      arrays += 1;
+      switch(method){
+         case OPTT_SQUAREM: arrays += 5; break;
+         case OPTT_HS: arrays += 4; break;
+         default: arrays += 3;
+      }
+   }
+   return T * (arrays * (long)sizeof(Real) + (long)sizeof(int_least32_t));
 }//}}}
-VariationalBayes::~VariationalBayes(){//{{{
+template<typename Real>
+VariationalBayesT<Real>::~VariationalBayesT(){//{{{
    delete[] alpha;
    delete[] phiHat;
    delete[] digA_pH;
    delete phi_sm;
    delete phi;
 }//}}}
-void VariationalBayes::unpack(double vals[],double adds[]){//{{{
-   if(adds==NULL){
-      if(vals!=phi_sm->val)memcpy(phi_sm->val,vals,T*sizeof(double));
-   }else{
-      long i;
-      #pragma omp parallel for
-      for(i=0;i<T;i++)phi_sm->val[i] = vals[i]+adds[i];
+template<typename Real>
+void VariationalBayesT<Real>::unpack(Real vals[],Real adds[]){//{{{
+/*
+ Single pass over rows which sets phi_sm = vals + adds, phi = softmax(phi_sm)
+ and phi_sm = log(phi), accumulates row contributions to the bound and
+ per-thread partial sums of phiHat, which are reduced afterwards.
+ In lean mode phi is not stored.
+*/
+   long threadsN = 1, teamN = 1;
+#ifdef _OPENMP
+   threadsN = omp_get_max_threads();
+#endif
+   if((long)phiHatPart.size() < threadsN * M)phiHatPart.resize(threadsN * M);
+   double A=0,B=0;
+   Real *phiV = lean ? NULL : phi->val;
+   // In active set mode only active rows are updated.
+   const long *rows = activeSet ? activeRowsPtr() : NULL;
+   long rowsN = activeSet ? (long)activeRows.size() : N;
+   #pragma omp parallel reduction(+:A,B)
+   {
+      long thread = 0, i, k, r, b, bEnd, st, en, len;
+#ifdef _OPENMP
+      thread = omp_get_thread_num();
+#endif
+      double *partial = &phiHatPart[thread * M];
+      double maxV[UNPACK_BLOCK], sumE, logRowSum, normE, A_r, B_r, w_r, phi_i;
+      long exStart[UNPACK_BLOCK];
+      vector<Real> buffer;
+      Real *ex, *exR;
+      memset(partial, 0, M * sizeof(double));
+      // The team can be smaller than threadsN, only partials of the threads
+      // in the team are cleared and reduced.
+#ifdef _OPENMP
+      #pragma omp master
+      teamN = omp_get_num_threads();
+#endif
+      #pragma omp for schedule(static)
+      for(b=0;b<rowsN;b+=UNPACK_BLOCK){
+         // Rows are processed in blocks so that exp is evaluated for all
+         // alignments of the block in one (vectorised) call. Exponentials are
+         // written directly into phi if the rows are consecutive, otherwise
+         // (lean mode, active set) into buffer.
+         bEnd = min(b + UNPACK_BLOCK, rowsN);
+         if((phiV != NULL) && (rows == NULL)){
+            ex = phiV + beta->rowStart[b];
+         }else{
+            len = 0;
+            for(k=b;k<bEnd;k++){
+               r = (rows == NULL) ? k : rows[k];
+               len += beta->rowStart[r+1] - beta->rowStart[r];
+            }
+            if((long)buffer.size() < len)buffer.resize(len);
+            ex = &buffer[0];
+         }
+         len = 0;
+         for(k=b;k<bEnd;k++){
+            r = (rows == NULL) ? k : rows[k];
+            st = beta->rowStart[r];
+            en = beta->rowStart[r+1];
+            exStart[k-b] = len;
+            len += en - st;
+            if(st == en)continue;
+            if(adds != NULL){
+               for(i=st;i<en;i++)phi_sm->val[i] = vals[i] + adds[i];
+            }else if(vals != phi_sm->val){
+               for(i=st;i<en;i++)phi_sm->val[i] = vals[i];
+            }
+            maxV[k-b] = phi_sm->val[st];
+            for(i=st+1;i<en;i++)if(phi_sm->val[i] > maxV[k-b])maxV[k-b] = phi_sm->val[i];
+            exR = ex + exStart[k-b] - st;
+            for(i=st;i<en;i++)exR[i] = phi_sm->val[i] - maxV[k-b];
+         }
+         ns_vecMath::expArray(ex, len);
+         for(k=b;k<bEnd;k++){
+            r = (rows == NULL) ? k : rows[k];
+            st = beta->rowStart[r];
+            en = beta->rowStart[r+1];
+            if(st == en)continue;
+            exR = ex + exStart[k-b] - st;
+            sumE = 0;
+            for(i=st;i<en;i++)sumE += exR[i];
+            logRowSum = maxV[k-b] + log(sumE);
+            normE = 1.0 / sumE;
+            w_r = beta->rowWeight[r];
+            A_r = B_r = 0;
+            for(i=st;i<en;i++){
+               phi_sm->val[i] -= logRowSum;
+               exR[i] *= normE;
+               phi_i = exR[i];
+               if(phiV != NULL)phiV[i] = exR[i];
+               // beta is logged now.
+               A_r += phi_i * beta->val[i];
+               // PyDif use nansum instead of ZERO_LIMIT (nansum sums all elements treating NaN as zero
+               if(phi_i>ZERO_LIMIT){
+                  B_r += phi_i * phi_sm->val[i];
+               }
+               partial[beta->col[i]] += w_r * phi_i;
+            }
+            A += w_r * A_r;
+            B += w_r * B_r;
+         }
+      }
+      // Implicit barrier of the loop above makes teamN and all partials visible.
+      reducePhiHat(teamN);
+   }
+   boundAB = A - B;
+   if(activeSet){
+      // Add cached contributions of frozen rows.
+      long m;
+      for(m=0;m<M;m++)phiHat[m] += frozenPhiHat[m];
+      boundAB += frozenAB;
+   }
+   if(reducer){
+      // phiHat and bound terms of all reads.
+      vector<double> sums(phiHat, phiHat + M);
+      sums.push_back(boundAB);
+      reducer->sum(&sums[0], M + 1);
+      memcpy(phiHat, &sums[0], M * sizeof(double));
+      boundAB = sums[M];
    }
-   phi_sm->softmaxInplace(phi); //softmax  phi_sm into phi; and set phi_sm to log(phi)
-   phi->sumCols(phiHat); // sumCols of phi into phiHat
 }//}}}
-
-void VariationalBayes::negGradient(double res[]){//{{{
-   long i;
-   int err=0,totalError=0;
-   #pragma omp parallel for private(err) reduction(+:totalError)
+template<typename Real>
+void VariationalBayesT<Real>::reducePhiHat(long threadsN){//{{{
+/*
+ Tree reduction of per-thread partials, called by every thread of the team
+ inside the parallel region of unpack(). In level with stride s, partial of
+ thread t adds partial of thread t+s (for t multiple of 2s), so that after
+ log2(threadsN) levels the sum is in partial 0. Each level is split over
+ columns between the threads, the levels are separated by barriers.
+*/
+   long m,t,s;
+   for(s=1;s<threadsN;s*=2){
+      #pragma omp for schedule(static)
+      for(m=0;m<M;m++)
+         for(t=0;t+s<threadsN;t+=2*s)phiHatPart[t * M + m] += phiHatPart[(t + s) * M + m];
+   }
+   #pragma omp for schedule(static)
+   for(m=0;m<M;m++)phiHat[m] = phiHatPart[m];
+}//}}}
+template<typename Real>
+void VariationalBayesT<Real>::updateDigamma(){//{{{
+   long i,b;
+   int totalError=0;
    for(i=0;i<M;i++){
-      digA_pH[i]=digama(alpha[i]+phiHat[i], &err);
-      totalError += err;
+      digA_pH[i] = alpha[i]+phiHat[i];
+      if(!(digA_pH[i] > 0))totalError++;
+   }
+   #pragma omp parallel for schedule(static)
+   for(b=0;b<M;b+=DIGAMMA_BLOCK){
+      ns_vecMath::digammaArray(digA_pH + b, min(DIGAMMA_BLOCK, M - b));
    }
    if(totalError){error("VariationalBayes: Digamma error (%d).\n",totalError); }
+}//}}}
+template<typename Real>
+void VariationalBayesT<Real>::negGradient(Real res[]){//{{{
+   long i;
+   updateDigamma();
    // beta is logged now
    #pragma omp parallel for
    for(i=0;i<T;i++)res[i]= - (beta->val[i] - phi_sm->val[i] - 1.0 + digA_pH[beta->col[i]]);
 }//}}}
-double VariationalBayes::getBound(){//{{{
+template<typename Real>
+double VariationalBayesT<Real>::getBound(){//{{{
    // the lower bound on the model likelihood
-   double A=0,B=0,C=0;
+   // Terms over alignments (A - B) are computed by unpack():
+   //   A = sum phi * log(beta)  expected log likelihood of alignments,
+   //   B = sum phi * log(phi)   negative entropy of q(Z), so it is subtracted.
+   // (Up to 0.7.5, B was added, which is not the function whose gradient is
+   // negGradient(); line search methods need the consistent bound.)
+   double C=0;
    long i;
-   #pragma omp parallel for reduction(+:A,B)
-   for(i=0;i<T;i++){
-      // beta is logged now.
-      A += phi->val[i] * beta->val[i];
-      // PyDif use nansum instead of ZERO_LIMIT (nansum sums all elements treating NaN as zero
-      if(phi->val[i]>ZERO_LIMIT){
-         B += phi->val[i] * phi_sm->val[i];
-      }
-   }
    #pragma omp parallel for reduction(+:C)
    for(i=0;i<M;i++){
       C += lgamma(alpha[i]+phiHat[i]);
    }
-   return A+B+C+boundConstant;
+   return boundAB+C+boundConstant;
 }//}}}
 
-void VariationalBayes::optimize(bool verbose,OPT_TYPE method,long maxIter,double ftol, double gtol){//{{{
-   bool usedSteepest;
-   long iteration=0,i,r;
-   double boundOld,bound,squareNorm,squareNormOld=1,valBeta=0,valBetaDiv,natGrad_i,gradGamma_i,phiGradPhiSum_r;
-   double *gradPhi,*natGrad,*gradGamma,*searchDir,*tmpD,*phiOld;
+template<typename Real>
+void VariationalBayesT<Real>::setActiveSet(double tol, long check){//{{{
+   activeTol = tol;
+   activeCheck = (check > 0) ? check : 1;
+}//}}}
+template<typename Real>
+void VariationalBayesT<Real>::unfreezeRows(){//{{{
+   long r;
+   activeRows.clear();
+   for(r=0;r<N;r++)
+      if(beta->rowStart[r] < beta->rowStart[r+1])activeRows.push_back(r);
+   frozenPhiHat.assign(M,0);
+   frozenAB = 0;
+}//}}}
+template<typename Real>
+bool VariationalBayesT<Real>::freezeRows(const vector<double> &rowNorm){//{{{
+   long k, r, i, kept = 0, activeN = activeRows.size();
+   double A_r, B_r, w_r;
+   for(k=0;k<activeN;k++){
+      r = activeRows[k];
+      if(rowNorm[r] >= activeTol){
+         activeRows[kept++] = r;
+         continue;
+      }
+      // Cache contributions of the row to phiHat and the bound (as in unpack).
+      w_r = beta->rowWeight[r];
+      A_r = B_r = 0;
+      for(i = beta->rowStart[r]; i < beta->rowStart[r+1]; i++){
+         A_r += phi->val[i] * beta->val[i];
+         if(phi->val[i]>ZERO_LIMIT){
+            B_r += phi->val[i] * phi_sm->val[i];
+         }
+         frozenPhiHat[beta->col[i]] += w_r * phi->val[i];
+      }
+      frozenAB += w_r * (A_r - B_r);
+   }
+   activeRows.resize(kept);
+   return kept < activeN;
+}//}}}
+template<typename Real>
+void VariationalBayesT<Real>::optimize(bool verbose,OPT_TYPE method,long maxIter,double ftol, double gtol){//{{{
+   bool usedSteepest,fullPass=true,activeChanged=false,checkActive=false;
+   long iteration=0,i,r,k,rowsN=N,sinceCheck=0;
+   double boundOld,bound,squareNorm,squareNormOld=1,valBeta=0,valBetaDiv,natGrad_i,gradGamma_i,phiGradPhiSum_r,squareNorm_r,w_r;
+   Real *gradPhi,*natGrad,*gradGamma,*searchDir,*tmpD,*phiOld;
    gradPhi=natGrad=gradGamma=searchDir=tmpD=phiOld=NULL;
+   const long *rows = NULL;
+   vector<double> rowNorm;
    MyTimer timer;
+   if((activeTol > 0) && (lean || (method == OPTT_SQUAREM) || (method == OPTT_ARMIJO))){
+      warning("VariationalBayes: Active set is supported only by steepest, PR, FR and HS methods without low memory mode; not using active set.\n");
+   }
+   if(lean){
+      if((method != OPTT_STEEPEST) && (method != OPTT_FR)){
+         warning("VariationalBayes: Low memory mode supports only steepest and FR methods, using FR.\n");
+         method = OPTT_FR;
+      }
+      optimizeLean(verbose,method,maxIter,ftol,gtol);
+      return;
+   }
+   if(method == OPTT_SQUAREM){
+      optimizeSquarem(verbose,maxIter,ftol,gtol);
+      return;
+   }
+   if(method == OPTT_ARMIJO){
+      optimizeArmijo(verbose,maxIter,ftol,gtol);
+      return;
+   }
    // allocate stuff {{{
    //SimpleSparse *phiGradPhi=new SimpleSparse(beta);
-   gradPhi = new double[T];
+   gradPhi = beta->newRowArray();
    // phiOld = new double[T]; will use gradPhi memory for this
    phiOld = NULL;
-   natGrad = new double[T];
+   natGrad = beta->newRowArray();
    if(method == OPTT_HS)
-      gradGamma = new double[T];
-   searchDir = new double[T];
+      gradGamma = beta->newRowArray();
+   searchDir = beta->newRowArray();
    //searchDirOld = new double[T];
    //phiGradPhi_sum = new double[N];
    // }}}
@@ -151,10 +414,30 @@ void VariationalBayes::optimize(bool verbose,OPT_TYPE method,long maxIter,double
    vector<double> dirAlpha(M);
    #endif
 #endif
+   if(activeTol > 0){
+      activeSet = true;
+      unfreezeRows();
+      rowNorm.assign(N,0);
+      // First iteration is a full pass.
+      checkActive = true;
+   }
    boundOld=getBound();
    timer.start();
    while(true){
-      negGradient(gradPhi);
+      if(activeSet){
+         // Re-validate frozen rows periodically and before finishing.
+         fullPass = checkActive || (sinceCheck >= activeCheck);
+         if(fullPass){
+            unfreezeRows();
+            sinceCheck = 0;
+            checkActive = false;
+         }
+         sinceCheck++;
+         rows = activeRowsPtr();
+         rowsN = activeRows.size();
+      }
+      // Gradient (negGradient) is computed within the row loop below.
+      updateDigamma();
       // "yuck"
       //setVal(phiGradPhi,i,phi->val[i]*gradPhi[i]);
       //phiGradPhi->sumRows(phiGradPhi_sum);
@@ -169,30 +452,64 @@ void VariationalBayes::optimize(bool verbose,OPT_TYPE method,long maxIter,double
       squareNorm=0;
       valBeta = 0;
       valBetaDiv = 0;
-      #pragma omp parallel for private(i,phiGradPhiSum_r,natGrad_i,gradGamma_i) reduction(+:squareNorm,valBeta,valBetaDiv)
-      for(r=0;r<N;r++){
+      // The (natural) gradient is computed per read, norms are summed over
+      // all reads of a row.
+      #pragma omp parallel for private(i,r,phiGradPhiSum_r,natGrad_i,gradGamma_i,squareNorm_r,w_r) reduction(+:squareNorm,valBeta,valBetaDiv)
+      for(k=0;k<rowsN;k++){
+         r = (rows == NULL) ? k : rows[k];
+         w_r = phi->rowWeight[r];
          phiGradPhiSum_r = 0;
-         for(i = phi->rowStart[r]; i < phi->rowStart[r+1]; i++) 
+         for(i = phi->rowStart[r]; i < phi->rowStart[r+1]; i++){
+            // beta is logged now
+            gradPhi[i] = - (beta->val[i] - phi_sm->val[i] - 1.0 + digA_pH[beta->col[i]]);
             phiGradPhiSum_r += phi->val[i] * gradPhi[i];
+         }
          
+         squareNorm_r = 0;
          for(i = phi->rowStart[r]; i < phi->rowStart[r+1]; i++){
             natGrad_i = gradPhi[i] - phiGradPhiSum_r;
             gradGamma_i = natGrad_i * phi->val[i];
-            squareNorm += natGrad_i * gradGamma_i;
+            squareNorm_r += natGrad_i * gradGamma_i;
             
             if(method==OPTT_PR){
-               valBeta += (natGrad_i - natGrad[i])*gradGamma_i;
+               valBeta += w_r * (natGrad_i - natGrad[i])*gradGamma_i;
             }
             if(method==OPTT_HS){
-               valBeta += (natGrad_i-natGrad[i])*gradGamma_i;
-               valBetaDiv += (natGrad_i-natGrad[i])*gradGamma[i];
+               valBeta += w_r * (natGrad_i-natGrad[i])*gradGamma_i;
+               valBetaDiv += w_r * (natGrad_i-natGrad[i])*gradGamma[i];
                gradGamma[i] = gradGamma_i;
             }
             natGrad[i] = natGrad_i;
          }
+         squareNorm += w_r * squareNorm_r;
+         if(activeSet)rowNorm[r] = squareNorm_r;
+      }
+      if(reducer){
+         double sums[3] = {squareNorm, valBeta, valBetaDiv};
+         reducer->sum(sums, 3);
+         squareNorm = sums[0];
+         valBeta = sums[1];
+         valBetaDiv = sums[2];
+      }
+      if(activeSet){
+         // Freeze rows which (almost) do not change. In a full pass all rows
+         // take the step, so that the convergence check below holds for all
+         // rows; converged rows are frozen in the next iteration.
+         activeChanged = fullPass;
+         if((!fullPass) && freezeRows(rowNorm))activeChanged = true;
+         if(reducer){
+            // Rows are frozen on each process's own reads, all processes
+            // have to take the same branch (the same sequence of reductions).
+            double changed = activeChanged ? 1 : 0;
+            reducer->max(&changed, 1);
+            activeChanged = (changed > 0);
+         }
+         rows = activeRowsPtr();
+         rowsN = activeRows.size();
       }
       
-      if((method==OPTT_STEEPEST) || (iteration % (N*M)==0)){
+      if((method==OPTT_STEEPEST) || (iteration % (Nreads*M)==0) || activeChanged){
+         // Restart also when the set of active rows changed.
          valBeta=0;
       }else if(method==OPTT_PR ){
          // already computed:
@@ -212,32 +529,50 @@ void VariationalBayes::optimize(bool verbose,OPT_TYPE method,long maxIter,double
          else valBeta = 0;
       }
 
+      // Only active rows are updated (all rows unless in active set mode).
       if(valBeta>0){
          usedSteepest = false;
          //for(i=0;i<T;i++)searchDir[i]= -natGrad[i] + valBeta*searchDirOld[i];
          // removed need for searchDirOld:
-         #pragma omp parallel for
-         for(i=0;i<T;i++)
-            searchDir[i]= -natGrad[i] + valBeta*searchDir[i];
+         #pragma omp parallel for private(i,r)
+         for(k=0;k<rowsN;k++){
+            r = (rows == NULL) ? k : rows[k];
+            for(i = beta->rowStart[r]; i < beta->rowStart[r+1]; i++)
+               searchDir[i]= -natGrad[i] + valBeta*searchDir[i];
+         }
       }else{
          usedSteepest = true;
-         #pragma omp parallel for
-         for(i=0;i<T;i++)
-            searchDir[i]= -natGrad[i];
+         #pragma omp parallel for private(i,r)
+         for(k=0;k<rowsN;k++){
+            r = (rows == NULL) ? k : rows[k];
+            for(i = beta->rowStart[r]; i < beta->rowStart[r+1]; i++)
+               searchDir[i]= -natGrad[i];
+         }
       }
 
       //try conjugate step
       SWAPD(gradPhi,phiOld);
-      memcpy(phiOld,phi_sm->val,T*sizeof(double)); // memcpy(phiOld,pack(),T*sizeof(double));
+      if(activeSet){
+         #pragma omp parallel for private(r)
+         for(k=0;k<rowsN;k++){
+            r = rows[k];
+            memcpy(phiOld + beta->rowStart[r], phi_sm->val + beta->rowStart[r], (beta->rowStart[r+1] - beta->rowStart[r]) * sizeof(Real));
+         }
+      }else{
+         memcpy(phiOld,phi_sm->val,T*sizeof(Real)); // memcpy(phiOld,pack(),T*sizeof(Real));
+      }
       unpack(phiOld,searchDir);
       bound = getBound();
       iteration++;
       // make sure there is an increase in L, else revert to steepest
       if((bound<boundOld) && (valBeta>0)){
          usedSteepest = true;
-         #pragma omp parallel for
-         for(i=0;i<T;i++)
-            searchDir[i]= -natGrad[i];
+         #pragma omp parallel for private(i,r)
+         for(k=0;k<rowsN;k++){
+            r = (rows == NULL) ? k : rows[k];
+            for(i = beta->rowStart[r]; i < beta->rowStart[r+1]; i++)
+               searchDir[i]= -natGrad[i];
+         }
          unpack(phiOld,searchDir);
          bound = getBound();
          // this should not be increased: iteration++;
@@ -252,6 +587,7 @@ void VariationalBayes::optimize(bool verbose,OPT_TYPE method,long maxIter,double
          #else
             messageF("iter(%c)[%5.lds]: %5.ld  bound: %.3lf grad: %.7lf  beta: %.7lf\n",(usedSteepest?'s':'o'),(long)timer.getTime(),iteration,bound,squareNorm,valBeta);
          #endif
+         if(activeSet)messageF("   active rows: %ld (%.1lf%%)\n",rowsN,100.0*rowsN/N);
       }else if(!quiet){
          messageF("\riter(%c): %5.ld  bound: %.3lf grad: %.7lf  beta: %.7lf      ",(usedSteepest?'s':'o'),iteration,bound,squareNorm,valBeta);
       }
@@ -278,17 +614,28 @@ void VariationalBayes::optimize(bool verbose,OPT_TYPE method,long maxIter,double
 #endif
 
       // convergence check {{{
-      if(bound<boundOld){
-         message("\nEnd: bound decrease\n");
-         break;
-      }
-      if(abs(bound-boundOld)<=ftol){
-         message("\nEnd: converged (ftol)\n");
+      if(reducer && (!reducer->good())){
+         message("\nEnd: communication failed\n");
          break;
       }
-      if(squareNorm<=gtol){
-         message("\nEnd: converged (gtol)\n");
-         break;
+      if(activeSet && (!fullPass) && ((bound<boundOld) || (abs(bound-boundOld)<=ftol) || (squareNorm<=gtol))){
+         // Converged only over active rows, check all rows before finishing.
+         checkActive = true;
+         // Decreasing step was reverted.
+         if(bound<boundOld)bound = boundOld;
+      }else{
+         if(bound<boundOld){
+            message("\nEnd: bound decrease\n");
+            break;
+         }
+         if(abs(bound-boundOld)<=ftol){
+            message("\nEnd: converged (ftol)\n");
+            break;
+         }
+         if(squareNorm<=gtol){
+            message("\nEnd: converged (gtol)\n");
+            break;
+         }
       }
       if(iteration>=maxIter){
          message("\nEnd: maxIter exceeded\n");
@@ -300,10 +647,18 @@ void VariationalBayes::optimize(bool verbose,OPT_TYPE method,long maxIter,double
       boundOld=bound;
       // }}}
       R_INTERUPT;
+      if(threadShare)threadShare->update(threadJob);
    }
    if(quiet){
       messageF("iter(%c): %5.ld  bound: %.3lf grad: %.7lf  beta: %.7lf\n",(usedSteepest?'s':'o'),iteration,bound,squareNorm,valBeta);
    }
+   message("VB: %ld iterations in %.0lf seconds.\n",iteration,timer.current(0,'s'));
+   if(activeSet){
+      // phiHat and the bound stay valid, rows are not frozen anymore.
+      activeSet = false;
+      vector<long>().swap(activeRows);
+      vector<double>().swap(frozenPhiHat);
+   }
 #ifdef LOG_CONV
    logF<<iteration<<" "<<bound<<" "<<squareNorm;
    if(logTimer)logF<<" "<<logTimer->current(0,'m');
@@ -335,30 +690,405 @@ void VariationalBayes::optimize(bool verbose,OPT_TYPE method,long maxIter,double
    // }}}
 }//}}}
 
-double *VariationalBayes::getAlphas(){//{{{
+template<typename Real>
+double VariationalBayesT<Real>::natGradient(Real gradPhi[], Real natGrad[]){//{{{
+   long i,r;
+   double squareNorm=0,phiGradPhiSum_r,squareNorm_r;
+   updateDigamma();
+   #pragma omp parallel for private(i,phiGradPhiSum_r,squareNorm_r) reduction(+:squareNorm)
+   for(r=0;r<N;r++){
+      phiGradPhiSum_r = 0;
+      for(i = phi->rowStart[r]; i < phi->rowStart[r+1]; i++){
+         // beta is logged now
+         gradPhi[i] = - (beta->val[i] - phi_sm->val[i] - 1.0 + digA_pH[beta->col[i]]);
+         phiGradPhiSum_r += phi->val[i] * gradPhi[i];
+      }
+      squareNorm_r = 0;
+      for(i = phi->rowStart[r]; i < phi->rowStart[r+1]; i++){
+         natGrad[i] = gradPhi[i] - phiGradPhiSum_r;
+         squareNorm_r += natGrad[i] * natGrad[i] * phi->val[i];
+      }
+      squareNorm += phi->rowWeight[r] * squareNorm_r;
+   }
+   return globalSum(squareNorm);
+}//}}}
+template<typename Real>
+double VariationalBayesT<Real>::normSq(const Real vec[]) const{//{{{
+   long i,r;
+   double sum=0,sum_r;
+   #pragma omp parallel for private(i,sum_r) reduction(+:sum)
+   for(r=0;r<N;r++){
+      sum_r = 0;
+      for(i = beta->rowStart[r]; i < beta->rowStart[r+1]; i++)sum_r += vec[i] * vec[i];
+      sum += beta->rowWeight[r] * sum_r;
+   }
+   return globalSum(sum);
+}//}}}
+template<typename Real>
+void VariationalBayesT<Real>::logIteration(char stepType, long iteration, double bound, double squareNorm, double stepSize, bool verbose, MyTimer &timer) const{//{{{
+   if(verbose){
+      messageF("iter(%c)[%5.lds]: %5.ld  bound: %.3lf grad: %.7lf  step: %.7lf\n",stepType,(long)timer.getTime(),iteration,bound,squareNorm,stepSize);
+   }else if(!quiet){
+      messageF("\riter(%c): %5.ld  bound: %.3lf grad: %.7lf  step: %.7lf      ",stepType,iteration,bound,squareNorm,stepSize);
+   }
+}//}}}
+template<typename Real>
+bool VariationalBayesT<Real>::converged(long iteration, double bound, double boundOld, double squareNorm, long maxIter, double ftol, double gtol) const{//{{{
+   if(reducer && (!reducer->good())){
+      message("\nEnd: communication failed\n");
+      return true;
+   }
+   if(bound<boundOld){
+      message("\nEnd: bound decrease\n");
+      return true;
+   }
+   if(abs(bound-boundOld)<=ftol){
+      message("\nEnd: converged (ftol)\n");
+      return true;
+   }
+   if(squareNorm<=gtol){
+      message("\nEnd: converged (gtol)\n");
+      return true;
+   }
+   if(iteration>=maxIter){
+      message("\nEnd: maxIter exceeded\n");
+      return true;
+   }
+   return false;
+}//}}}
+template<typename Real>
+void VariationalBayesT<Real>::optimizeSquarem(bool verbose, long maxIter, double ftol, double gtol){//{{{
+/*
+ SQUAREM (Varadhan & Roland, 2008), scheme S3, with the unit natural gradient
+ step (one VBEM update) as the fixed point map F:
+   r = F(x0) - x0, v = F(F(x0)) - 2 F(x0) + x0, a = -|r|/|v|
+   x = x0 - 2 a r + a^2 v
+ If the extrapolated point decreases the bound, a is moved towards -1, where
+ x = F(F(x0)).
+*/
+   long iteration=0,i,evaluations=0;
+   double boundOld,bound,bound1,squareNorm,squareNorm1,alpha=-1,rNorm,vNorm;
+   Real *gradPhi,*natGrad,*x0,*r,*v;
+   MyTimer timer;
+   gradPhi = beta->newRowArray();
+   natGrad = beta->newRowArray();
+   x0 = beta->newRowArray();
+   r = beta->newRowArray();
+   v = beta->newRowArray();
+   boundOld=getBound();
+   timer.start();
+   while(true){
+      memcpy(x0,phi_sm->val,T*sizeof(Real));
+      // First step: r = F(x0) - x0.
+      squareNorm = natGradient(gradPhi,natGrad);
+      #pragma omp parallel for
+      for(i=0;i<T;i++)r[i] = -natGrad[i];
+      unpack(x0,r);
+      bound1 = getBound();
+      // Second step: v = F(x1) - x1 - r.
+      squareNorm1 = natGradient(gradPhi,natGrad);
+      #pragma omp parallel for
+      for(i=0;i<T;i++)v[i] = -natGrad[i] - r[i];
+      evaluations += 2;
+      rNorm = normSq(r);
+      vNorm = normSq(v);
+      alpha = (vNorm > 0) ? -sqrt(rNorm / vNorm) : -1;
+      if(alpha > -1)alpha = -1;
+      while(true){
+         #pragma omp parallel for
+         for(i=0;i<T;i++)gradPhi[i] = -2*alpha*r[i] + alpha*alpha*v[i];
+         unpack(x0,gradPhi);
+         bound = getBound();
+         evaluations++;
+         if((bound >= boundOld) || (alpha >= -1))break;
+         // Move towards plain double step.
+         alpha = (alpha - 1) / 2;
+         if(alpha > -1.01)alpha = -1;
+      }
+      iteration++;
+      if(!(bound >= boundOld)){
+         // Even double step failed, use single step if it increased the bound.
+         if(bound1 >= boundOld){
+            unpack(x0,r);
+            bound = bound1;
+            squareNorm = squareNorm1;
+            alpha = 0;
+         }else{
+            unpack(x0);
+         }
+      }
+      logIteration((alpha < -1) ? 'x' : 's',iteration,bound,squareNorm,-alpha,verbose,timer);
+      if(converged(iteration,bound,boundOld,squareNorm,maxIter,ftol,gtol))break;
+      boundOld=bound;
+      R_INTERUPT;
+      if(threadShare)threadShare->update(threadJob);
+   }
+   message("VB: %ld iterations (%ld bound evaluations) in %.0lf seconds.\n",iteration,evaluations,timer.current(0,'s'));
+   delete[] gradPhi;
+   delete[] natGrad;
+   delete[] x0;
+   delete[] r;
+   delete[] v;
+}//}}}
+template<typename Real>
+void VariationalBayesT<Real>::optimizeArmijo(bool verbose, long maxIter, double ftol, double gtol){//{{{
+/*
+ Steepest ascent along the natural gradient with backtracking line search.
+ Step t is accepted if it satisfies the Armijo condition:
+   L(x + t d) >= L(x) + c t |natGrad|^2,
+ where |natGrad|^2 is the derivative of the bound along d = -natGrad.
+ Each iteration starts with twice the last accepted step.
+*/
+   const double armijoC = 1e-4, stepMax = 1e4, stepMin = 1e-10;
+   long iteration=0,i,evaluations=0;
+   double boundOld,bound,squareNorm,step=1;
+   Real *gradPhi,*natGrad,*x0;
+   MyTimer timer;
+   gradPhi = beta->newRowArray();
+   natGrad = beta->newRowArray();
+   x0 = beta->newRowArray();
+   boundOld=getBound();
+   timer.start();
+   while(true){
+      memcpy(x0,phi_sm->val,T*sizeof(Real));
+      squareNorm = natGradient(gradPhi,natGrad);
+      step = min(step*2, stepMax);
+      while(true){
+         #pragma omp parallel for
+         for(i=0;i<T;i++)gradPhi[i] = -step*natGrad[i];
+         unpack(x0,gradPhi);
+         bound = getBound();
+         evaluations++;
+         if(bound >= boundOld + armijoC * step * squareNorm)break;
+         step /= 2;
+         if(step < stepMin)break;
+      }
+      iteration++;
+      if(!(bound >= boundOld)){
+         // No step increases the bound.
+         unpack(x0);
+      }
+      logIteration('a',iteration,bound,squareNorm,step,verbose,timer);
+      if(converged(iteration,bound,boundOld,squareNorm,maxIter,ftol,gtol))break;
+      boundOld=bound;
+      R_INTERUPT;
+      if(threadShare)threadShare->update(threadJob);
+   }
+   message("VB: %ld iterations (%ld bound evaluations) in %.0lf seconds.\n",iteration,evaluations,timer.current(0,'s'));
+   delete[] gradPhi;
+   delete[] natGrad;
+   delete[] x0;
+}//}}}
+
+template<typename Real>
+double VariationalBayesT<Real>::leanNatGradNorm(){//{{{
+   long i,r;
+   double squareNorm=0,phiGradPhiSum_r,squareNorm_r,phi_i,natGrad_i;
+   #pragma omp parallel for private(i,phiGradPhiSum_r,squareNorm_r,phi_i,natGrad_i) reduction(+:squareNorm)
+   for(r=0;r<N;r++){
+      phiGradPhiSum_r = 0;
+      for(i = beta->rowStart[r]; i < beta->rowStart[r+1]; i++)
+         phiGradPhiSum_r += exp(phi_sm->val[i]) * leanGrad(i);
+      squareNorm_r = 0;
+      for(i = beta->rowStart[r]; i < beta->rowStart[r+1]; i++){
+         phi_i = exp(phi_sm->val[i]);
+         natGrad_i = leanGrad(i) - phiGradPhiSum_r;
+         squareNorm_r += natGrad_i * natGrad_i * phi_i;
+      }
+      squareNorm += beta->rowWeight[r] * squareNorm_r;
+   }
+   return globalSum(squareNorm);
+}//}}}
+template<typename Real>
+void VariationalBayesT<Real>::leanSetDirection(double valBeta, Real searchDir[]){//{{{
+   long i,r;
+   double phiGradPhiSum_r;
+   #pragma omp parallel for private(i,phiGradPhiSum_r)
+   for(r=0;r<N;r++){
+      phiGradPhiSum_r = 0;
+      for(i = beta->rowStart[r]; i < beta->rowStart[r+1]; i++)
+         phiGradPhiSum_r += exp(phi_sm->val[i]) * leanGrad(i);
+      for(i = beta->rowStart[r]; i < beta->rowStart[r+1]; i++){
+         if(valBeta > 0)searchDir[i] = -(leanGrad(i) - phiGradPhiSum_r) + valBeta * searchDir[i];
+         else searchDir[i] = -(leanGrad(i) - phiGradPhiSum_r);
+      }
+   }
+}//}}}
+template<typename Real>
+void VariationalBayesT<Real>::leanRevert(Real searchDir[]){//{{{
+   long i;
+   // Softmax is invariant to row constants, so subtracting the step from
+   // normalised phi_sm restores previous phi.
+   #pragma omp parallel for
+   for(i=0;i<T;i++)phi_sm->val[i] -= searchDir[i];
+   unpack(phi_sm->val);
+}//}}}
+template<typename Real>
+void VariationalBayesT<Real>::optimizeLean(bool verbose, OPT_TYPE method, long maxIter, double ftol, double gtol){//{{{
+/*
+ Low memory version of steepest ascent and FR conjugate gradient.
+ Only phi_sm and the search direction are kept, phi is computed as
+ exp(phi_sm) and the (natural) gradient is recomputed per row, once for its
+ norm and once for the search direction.
+*/
+   bool usedSteepest;
+   long iteration=0;
+   double boundOld,bound,squareNorm,squareNormOld=1,valBeta=0;
+   Real *searchDir = beta->newRowArray();
+   MyTimer timer;
+   boundOld=getBound();
+   timer.start();
+   while(true){
+      updateDigamma();
+      squareNorm = leanNatGradNorm();
+      if((method==OPTT_STEEPEST) || (iteration % (Nreads*M)==0)){
+         valBeta=0;
+      }else{
+         valBeta = squareNorm / squareNormOld;
+      }
+      usedSteepest = !(valBeta>0);
+      leanSetDirection(valBeta, searchDir);
+      // try conjugate step
+      unpack(phi_sm->val, searchDir);
+      bound = getBound();
+      iteration++;
+      // make sure there is an increase in L, else revert to steepest
+      if((bound<boundOld) && (valBeta>0)){
+         usedSteepest = true;
+         leanRevert(searchDir);
+         updateDigamma();
+         leanSetDirection(0, searchDir);
+         unpack(phi_sm->val, searchDir);
+         bound = getBound();
+      }
+      if(bound<boundOld) { // If bound decreased even after using steepest, step back and quit.
+         leanRevert(searchDir);
+      }
+      logIteration(usedSteepest ? 's' : 'o',iteration,bound,squareNorm,valBeta,verbose,timer);
+      if(converged(iteration,bound,boundOld,squareNorm,maxIter,ftol,gtol))break;
+      squareNormOld=squareNorm;
+      boundOld=bound;
+      R_INTERUPT;
+      if(threadShare)threadShare->update(threadJob);
+   }
+   message("VB: %ld iterations in %.0lf seconds.\n",iteration,timer.current(0,'s'));
+   delete[] searchDir;
+}//}}}
+
+template<typename Real>
+double *VariationalBayesT<Real>::getAlphas(){//{{{
    double *alphas = new double[M];
    for(long i=0;i<M;i++)alphas[i] = alpha[i] + phiHat[i];
    return alphas;
 }//}}}
 
-SimpleSparse *VariationalBayes::getPhi(){//{{{
+template<typename Real>
+SimpleSparseT<Real> *VariationalBayesT<Real>::getPhi(){//{{{
+   if(phi == NULL){
+      // Lean mode, compute phi from phi_sm.
+      phi = new SimpleSparseT<Real>(beta);
+      memcpy(phi->val, phi_sm->val, T * sizeof(Real));
+      ns_vecMath::expArray(phi->val, T);
+   }
    return phi;
 }//}}}
 
-void VariationalBayes::generateSamples(long samplesN, const string &outTypeS, const vector<double> *isoformLengths, ofstream *outF) {//{{{
+template<typename Real>
+void VariationalBayesT<Real>::generateSamples(long samplesN, const string &outTypeS, const vector<double> *isoformLengths, AsyncWriter *outF) {//{{{
+   vector<double> dirAlpha(M);
+   double priorReads = 0;
+   for(long m=0;m<M;m++){
+      dirAlpha[m] = alpha[m] + phiHat[m];
+      priorReads += alpha[m] - 1.0;
+   }
+   // Prior given by previous posterior (incremental mode) accounts for reads.
+   if(priorReads < 0.5)priorReads = 0;
+   sampleDirichlet(dirAlpha, Nreads + (long)floor(priorReads + 0.5), samplesN, outTypeS, isoformLengths, outF, rng_mt);
+}//}}}
+
+template class VariationalBayesT<double>;
+template class VariationalBayesT<float>;
+
+StochasticVB::StochasticVB(long M, long Nreads, long seed, double kappa, double tau){//{{{
+   this->M = M;
+   this->Nreads = Nreads;
+   this->kappa = kappa;
+   this->tau = tau;
+   t = 0;
+   rng_mt.seed(seed);
+   alpha.assign(M,1.0);
+   // Start with reads spread uniformly.
+   lambda.assign(M,1.0 + (double)Nreads / M);
+   digLambda.resize(M);
+   batchHat.resize(M);
+}//}}}
+template<typename Real>
+double StochasticVB::update(const SimpleSparseT<Real> *batch){//{{{
+   long m;
+   double batchReads = batch->weightSum(), rho, scale;
+   if(batchReads <= 0)return 0;
+   memcpy(&digLambda[0], &lambda[0], M * sizeof(double));
+   ns_vecMath::digammaArray(&digLambda[0], M);
+   batchHat.assign(M,0);
+   #pragma omp parallel
+   {
+      // phi of a read is softmax(log(beta) + digamma(lambda)).
+      long r, i, st, en, mm;
+      double maxV, sumE, w_r;
+      vector<double> part(M,0), row;
+      #pragma omp for schedule(static)
+      for(r=0;r<batch->N;r++){
+         st = batch->rowStart[r];
+         en = batch->rowStart[r+1];
+         if(st == en)continue;
+         if((long)row.size() < en - st)row.resize(en - st);
+         for(i=st;i<en;i++)row[i-st] = batch->val[i] + digLambda[batch->col[i]];
+         maxV = row[0];
+         for(i=1;i<en-st;i++)if(row[i] > maxV)maxV = row[i];
+         for(i=0;i<en-st;i++)row[i] -= maxV;
+         ns_vecMath::expArray(&row[0], en - st);
+         sumE = 0;
+         for(i=0;i<en-st;i++)sumE += row[i];
+         w_r = batch->rowWeight[r] / sumE;
+         for(i=st;i<en;i++)part[batch->col[i]] += w_r * row[i-st];
+      }
+      #pragma omp critical
+      for(mm=0;mm<M;mm++)batchHat[mm] += part[mm];
+   }
+   rho = pow(tau + t, -kappa);
+   scale = Nreads / batchReads;
+   for(m=0;m<M;m++)
+      lambda[m] = (1.0 - rho) * lambda[m] + rho * (alpha[m] + scale * batchHat[m]);
+   t++;
+   return rho;
+}//}}}
+double *StochasticVB::getAlphas() const{//{{{
+   double *alphas = new double[M];
+   for(long m=0;m<M;m++)alphas[m] = lambda[m];
+   return alphas;
+}//}}}
+void StochasticVB::generateSamples(long samplesN, const string &outTypeS, const vector<double> *isoformLengths, AsyncWriter *outF) {//{{{
+   sampleDirichlet(lambda, Nreads, samplesN, outTypeS, isoformLengths, outF, rng_mt);
+}//}}}
+
+template double StochasticVB::update<double>(const SimpleSparseT<double> *batch);
+template double StochasticVB::update<float>(const SimpleSparseT<float> *batch);
+
+static void sampleDirichlet(const vector<double> &dirAlpha, long Nreads, long samplesN, const string &outTypeS, const vector<double> *isoformLengths, AsyncWriter *outF, boost::random::mt11213b &rng_mt) {//{{{
+   long M = dirAlpha.size();
    vector<double> gamma(M,0);
    vector<gDP> alphaParam;
    boost::random::gamma_distribution<double> gammaDistribution;
    long n,m;
    double gammaSum, norm, normC = 1.0;
    // Set normalisation.
-   if(outTypeS == "counts") normC = N; // N is Nmap.
+   if(outTypeS == "counts") normC = Nreads; // Nreads is Nmap.
    if(outTypeS == "rpkm") normC = 1e9;
    // Pre-compute Dirichlet's alpha and save them as parameters for Gamma.
-   for(m=0;m<M;m++)alphaParam.push_back(gDP(alpha[m] + phiHat[m], 1.0));
+   for(m=0;m<M;m++)alphaParam.push_back(gDP(dirAlpha[m], 1.0));
    // Sample.
    outF->precision(9);
-   (*outF)<<scientific;
+   outF->scientific();
    for(n=0;n<samplesN;n++){
       // Compute M gammas and sum. Ignore 0 - noise transcript.
       gammaSum = 0;
@@ -381,7 +1111,7 @@ void VariationalBayes::generateSamples(long samplesN, const string &outTypeS, co
       for(m=1;m < M;m++){
          (*outF)<<gamma[m] * norm<<" ";
       }
-      (*outF)<<endl;
+      (*outF)<<"\n";
       R_INTERUPT;
    }
    // Delete lengths.
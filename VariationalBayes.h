@@ -1,46 +1,168 @@
 #ifndef VARIATIONALBAYES_H
 #define VARIATIONALBAYES_H
 
+#include<vector>
+
 #include "boost/random/mersenne_twister.hpp"
 
+#include "AllReduce.h"
+#include "AsyncWriter.h"
 #include "MyTimer.h"
 #include "SimpleSparse.h"
+#include "Threads.h"
 
 //#define LOG_CONV
 //#define LONG_LOG
 //#define SHOW_FIXED
 
-enum OPT_TYPE { OPTT_STEEPEST, OPTT_PR, OPTT_FR, OPTT_HS};
+// Steepest ascent and conjugate gradient methods (Polak-Ribiere, Fletcher-Reeves,
+// Hestenes-Stiefel) take unit step along the search direction,
+// SQUAREM extrapolates two steepest (unit) steps,
+// ARMIJO uses backtracking line search along the natural gradient.
+enum OPT_TYPE { OPTT_STEEPEST, OPTT_PR, OPTT_FR, OPTT_HS, OPTT_SQUAREM, OPTT_ARMIJO};
 
-class VariationalBayes {
+// Real is the type of per-alignment arrays (beta, phi and optimisation work
+// arrays). With float the memory is halved, all sums are still accumulated in
+// double.
+template<typename Real>
+class VariationalBayesT {
    private:
-      long N,M,T; // N - read num K- read number?
+      long N,M,T; // N - number of rows (classes of identical reads)
+      long Nreads; // number of reads, sum of row weights
       double * alpha; // prior over expression
       double * phiHat;
       double * digA_pH;
+      // Per-thread partial sums of phiHat.
+      vector<double> phiHatPart;
       double boundConstant;
-      SimpleSparse *beta,*phi_sm,*phi;
+      // Part of the bound computed over alignments by unpack().
+      double boundAB;
+      SimpleSparseT<Real> *beta,*phi_sm,*phi;
       // logBeta replaced by logging beta itself
       string logFileName;
       MyTimer *logTimer;
       // mersen twister random number generator
       boost::random::mt11213b rng_mt;
       bool quiet;
+      // Low memory mode: phi and gradients are not stored.
+      bool lean;
+      // Active set mode: rows with squared natural gradient norm below
+      // activeTol are frozen (not updated) and all rows are re-validated
+      // every activeCheck iterations and before finishing.
+      bool activeSet;
+      double activeTol;
+      long activeCheck;
+      // Rows which are updated.
+      vector<long> activeRows;
+      // Pointer to activeRows; NULL when empty, which is valid as the loops
+      // over active rows then have no iterations.
+      const long *activeRowsPtr() const{
+         return activeRows.empty() ? NULL : &activeRows[0];
+      }
+      // Contributions of frozen rows to phiHat and boundAB.
+      vector<double> frozenPhiHat;
+      double frozenAB;
+      // Distributed mode: sums over reads are combined over all processes.
+      AllReduce *reducer;
+      // Batch mode: threads shared with other jobs, updated every iteration.
+      ns_threads::ThreadShare *threadShare;
+      long threadJob;
+
+      void setBoundConstant();
+      // Sum x over all processes (in distributed mode).
+      double globalSum(double x) const{
+         if(reducer)reducer->sum(&x, 1);
+         return x;
+      }
 
+      // Make all rows active.
+      void unfreezeRows();
+      // Freeze active rows with rowNorm below activeTol, returns true if any
+      // row was frozen.
+      bool freezeRows(const vector<double> &rowNorm);
+      // Sum partials of threadsN threads into phiHat, called inside parallel region.
+      void reducePhiHat(long threadsN);
+      // Set digA_pH = digamma(alpha + phiHat).
+      void updateDigamma();
+      // Compute natural gradient at current phi, returns its squared norm.
+      double natGradient(Real gradPhi[], Real natGrad[]);
+      // Weighted (per read) squared norm of vector with T elements.
+      double normSq(const Real vec[]) const;
+      void logIteration(char stepType, long iteration, double bound, double squareNorm, double stepSize, bool verbose, MyTimer &timer) const;
+      // Returns true if optimization should stop.
+      bool converged(long iteration, double bound, double boundOld, double squareNorm, long maxIter, double ftol, double gtol) const;
+      void optimizeSquarem(bool verbose, long maxIter, double ftol, double gtol);
+      void optimizeArmijo(bool verbose, long maxIter, double ftol, double gtol);
+      // Gradient (negGradient) of alignment i, digA_pH has to be up to date.
+      double leanGrad(long i) const{
+         // beta is logged now
+         return - (beta->val[i] - phi_sm->val[i] - 1.0 + digA_pH[beta->col[i]]);
+      }
+      // Squared norm of the natural gradient computed without storing phi and gradients.
+      double leanNatGradNorm();
+      // Set searchDir = -natGrad + valBeta * searchDir (or -natGrad if valBeta is 0).
+      void leanSetDirection(double valBeta, Real searchDir[]);
+      // Undo step along searchDir.
+      void leanRevert(Real searchDir[]);
+      void optimizeLean(bool verbose, OPT_TYPE method, long maxIter, double ftol, double gtol);
    public:
-      VariationalBayes(SimpleSparse *_beta,double *_alpha=NULL,long seed = 0,long procN = 1);
-      ~VariationalBayes();
+      // Number of threads is set by ns_threads::setThreads().
+      VariationalBayesT(SimpleSparseT<Real> *_beta,double *_alpha=NULL,long seed = 0,bool lean = false);
+      ~VariationalBayesT();
       //double *pack(){return phi_sm->val;} 
-      void unpack(double vals[], double adds[] = NULL); // set phi_m, phi=softmax(phi_m), phi_hat=sumOverCols(phi)
-      void negGradient(double res[]);
+      void unpack(Real vals[], Real adds[] = NULL); // set phi_m, phi=softmax(phi_m), phi_hat=sumOverCols(phi)
+      void negGradient(Real res[]);
       double getBound();
       void optimize(bool verbose=false, OPT_TYPE method=OPTT_STEEPEST,long maxIter=10000,double ftol=1e-5, double gtol=1e-5);
       double *getAlphas();
-      SimpleSparse *getPhi();
+      SimpleSparseT<Real> *getPhi();
       void setLog(string logFileName,MyTimer *timer);
       // Generates samples from the distribution. The 0 (noise) transcript is left out.
-      void generateSamples(long samplesN, const string &outTypeS, const vector<double> *isoformLengths, ofstream *outF);
+      void generateSamples(long samplesN, const string &outTypeS, const vector<double> *isoformLengths, AsyncWriter *outF);
       void beQuiet(){ quiet = true; }
+      // Warm start: set phi to the VBEM update from Dirichlet(initAlpha),
+      // e.g. posterior of a previous run.
+      void initPhi(const double initAlpha[]);
+      // Approximate memory in bytes used by VB with T alignments and optimize()
+      // method (including beta).
+      static long memoryEstimate(long T, OPT_TYPE method, bool lean = false);
+      // Use active set in optimize() (steepest, PR, FR and HS methods), tol 0 disables it.
+      void setActiveSet(double tol, long check = 20);
+      // Distributed mode: beta contains only a part of the reads and the other
+      // parts are processed by other processes (with the same M) connected by
+      // reducer. All processes have to run the same optimize().
+      void setReducer(AllReduce *reducer);
+      // Batch mode: before every iteration of optimize() set the number of
+      // threads to job's current part of share.
+      void setThreadShare(ns_threads::ThreadShare *share, long job);
+};
+
+typedef VariationalBayesT<double> VariationalBayes;
+
+// Stochastic variational inference for libraries which do not fit in memory.
+// Reads are processed in mini-batches; phi is computed only for the reads of
+// the current batch and the Dirichlet parameters lambda (alpha + phiHat in
+// VariationalBayesT) are updated as
+//   lambda = (1-rho_t) * lambda + rho_t * (alpha + Nreads/batchReads * batchPhiHat)
+// with Robbins-Monro step sizes rho_t = (tau + t)^-kappa, 0.5 < kappa <= 1.
+class StochasticVB {
+   private:
+      long M,Nreads,t;
+      double kappa,tau;
+      vector<double> alpha,lambda,digLambda,batchHat;
+      boost::random::mt11213b rng_mt;
+   public:
+      StochasticVB(long M, long Nreads, long seed = 0, double kappa = 0.7, double tau = 1.0);
+      // Set number of reads in the whole library (used for scaling batches).
+      void setNreads(long Nreads){ this->Nreads = Nreads; }
+      // Update lambda using batch of reads (rows of log alignment
+      // probabilities). Returns step size rho_t used.
+      template<typename Real>
+      double update(const SimpleSparseT<Real> *batch);
+      long getIteration() const { return t; }
+      double *getAlphas() const;
+      // Generates samples from the distribution. The 0 (noise) transcript is left out.
+      void generateSamples(long samplesN, const string &outTypeS, const vector<double> *isoformLengths, AsyncWriter *outF);
 };
 
 #endif
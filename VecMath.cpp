@@ -0,0 +1,294 @@
+#include<cfloat>
+#include<cmath>
+#include<cstdlib>
+#include<cstring>
+#include<limits>
+#include<stdint.h>
+
+using namespace std;
+
+#include "VecMath.h"
+
+// Kernels are compiled for several instruction sets only on x86 with GCC
+// compatible compilers (target attributes, __builtin_cpu_supports).
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define VM_X86
+#endif
+
+#define VM_INLINE inline __attribute__((always_inline))
+
+namespace ns_vecMath {
+
+namespace {
+
+const double LOG2E = 1.4426950408889634074;
+// ln(2) split into high part with zero trailing bits and the rest (fdlibm).
+const double LN2_HI = 6.93147180369123816490e-01;
+const double LN2_LO = 1.90821492927058770002e-10;
+const double SQRT2 = 1.4142135623730950488;
+// Adding 1.5*2^52 rounds to integer which is then stored in the low bits.
+const double ROUND_SHIFT = 6755399441055744.0;
+const double EXP_MAX = 709.782712893383973;
+// log(DBL_MIN), smaller values are flushed to zero.
+const double EXP_MIN = -708.396418532264106;
+// Vector kernels process multiples of VEC_BLOCK elements, the rest is
+// processed by libm which is faster for single elements.
+const long VEC_BLOCK = ns_vecMath::VEC_MIN;
+
+VM_INLINE double fromBits(uint64_t b){//{{{
+   double d;
+   memcpy(&d, &b, sizeof(d));
+   return d;
+}//}}}
+VM_INLINE uint64_t toBits(double d){//{{{
+   uint64_t b;
+   memcpy(&b, &d, sizeof(b));
+   return b;
+}//}}}
+// All the kernels are branch free (selects only) so that loops calling them
+// can be vectorised.
+VM_INLINE double expK(double x){//{{{
+   double xc = x < EXP_MIN ? EXP_MIN : (x > EXP_MAX ? EXP_MAX : x);
+   // x = k*ln(2) + r, |r| <= ln(2)/2
+   double t = xc * LOG2E + ROUND_SHIFT;
+   double k = t - ROUND_SHIFT;
+   double r = (xc - k * LN2_HI) - k * LN2_LO;
+   // Taylor expansion of exp(r) up to r^13.
+   double p = 1.0/6227020800.0;
+   p = p * r + 1.0/479001600.0;
+   p = p * r + 1.0/39916800.0;
+   p = p * r + 1.0/3628800.0;
+   p = p * r + 1.0/362880.0;
+   p = p * r + 1.0/40320.0;
+   p = p * r + 1.0/5040.0;
+   p = p * r + 1.0/720.0;
+   p = p * r + 1.0/120.0;
+   p = p * r + 1.0/24.0;
+   p = p * r + 1.0/6.0;
+   p = p * r + 0.5;
+   p = p * r + 1.0;
+   p = p * r + 1.0;
+   // Low 12 bits of t hold k (mod 2^12). The result is scaled by 2^(k-1) * 2
+   // or 2^(k+1) / 2 as k can be 1024 or -1022.
+   bool positive = k > 0;
+   double scale = fromBits((toBits(t) + (positive ? 1022 : 1024)) << 52);
+   double res = p * scale * (positive ? 2.0 : 0.5);
+   res = x < EXP_MIN ? 0.0 : res;
+   res = x > EXP_MAX ? HUGE_VAL : res;
+   return x != x ? x : res;
+}//}}}
+VM_INLINE double logK(double x){//{{{
+   // Subnormal numbers are scaled up by 2^54.
+   bool subnormal = x < DBL_MIN;
+   double xs = subnormal ? x * 18014398509481984.0 : x;
+   uint64_t b = toBits(xs);
+   // x = m * 2^e, 1 <= m < 2
+   double m = fromBits((b & 0x000fffffffffffffULL) | 0x3ff0000000000000ULL);
+   // Exponent converted to double without integer conversion.
+   double e = fromBits(((b >> 52) & 0x7ff) | 0x4330000000000000ULL) - 4503599627370496.0 - 1023.0;
+   e = subnormal ? e - 54.0 : e;
+   // Move m into [sqrt(2)/2, sqrt(2)).
+   bool large = m > SQRT2;
+   m = large ? m * 0.5 : m;
+   e = large ? e + 1.0 : e;
+   // log(m) = 2 atanh(s), s = (m-1)/(m+1), |s| < 0.1716.
+   double f = m - 1.0;
+   double s = f / (m + 1.0);
+   double z = s * s;
+   double p = 2.0/21.0;
+   p = p * z + 2.0/19.0;
+   p = p * z + 2.0/17.0;
+   p = p * z + 2.0/15.0;
+   p = p * z + 2.0/13.0;
+   p = p * z + 2.0/11.0;
+   p = p * z + 2.0/9.0;
+   p = p * z + 2.0/7.0;
+   p = p * z + 2.0/5.0;
+   p = p * z + 2.0/3.0;
+   // 2s = f - s*f
+   double logM = f - s * (f - z * p);
+   double res = e * LN2_HI + (logM + e * LN2_LO);
+   res = x == HUGE_VAL ? x : res;
+   res = x == 0 ? -HUGE_VAL : res;
+   res = x < 0 ? numeric_limits<double>::quiet_NaN() : res;
+   return x != x ? x : res;
+}//}}}
+VM_INLINE double log1pK(double x){//{{{
+   // log1p(x) = log(u) * x / (u-1) with u = 1+x corrects the rounding error of u.
+   double u = 1.0 + x;
+   double res = logK(u) * (x / (u - 1.0));
+   res = u == 1.0 ? x : res;
+   return x == HUGE_VAL ? x : res;
+}//}}}
+VM_INLINE double digammaK(double x){//{{{
+   // digamma(x) = digamma(x+1) - 1/x is used until x >= 10, the sum of
+   // 1/x terms is accumulated as a fraction num/den to avoid divisions.
+   double num = 0, den = 1, y = x;
+   bool small;
+   for(long k = 0; k < 10; k++){
+      small = y < 10.0;
+      num = small ? num * y + den : num;
+      den = small ? den * y : den;
+      y = small ? y + 1.0 : y;
+   }
+   // Asymptotic expansion.
+   double r = 1.0 / y, r2 = r * r;
+   double p = 1.0/132.0 - r2 * (691.0/32760.0);
+   p = 1.0/240.0 - r2 * p;
+   p = 1.0/252.0 - r2 * p;
+   p = 1.0/120.0 - r2 * p;
+   p = 1.0/12.0 - r2 * p;
+   double res = logK(y) - 0.5 * r - r2 * p - num / den;
+   return x <= 0 ? numeric_limits<double>::quiet_NaN() : res;
+}//}}}
+// Scalar versions using libm (and the same digamma expansion) are used for
+// SSE2 and non-x86 CPUs, as 2-wide vector kernels are slower than libm.
+double digammaScalar(double x){//{{{
+   if(!(x > 0)) return numeric_limits<double>::quiet_NaN();
+   double acc = 0, y = x;
+   while(y < 10.0){
+      acc -= 1.0 / y;
+      y += 1.0;
+   }
+   double r = 1.0 / y, r2 = r * r;
+   double p = 1.0/132.0 - r2 * (691.0/32760.0);
+   p = 1.0/240.0 - r2 * p;
+   p = 1.0/252.0 - r2 * p;
+   p = 1.0/120.0 - r2 * p;
+   p = 1.0/12.0 - r2 * p;
+   return acc + log(y) - 0.5 * r - r2 * p;
+}//}}}
+template<typename Real>
+void expScalar(Real x[], long n){//{{{
+   for(long i = 0; i < n; i++) x[i] = (Real)exp((double)x[i]);
+}//}}}
+template<typename Real>
+double expSumScalar(const Real x[], long n, double shift){//{{{
+   double sum = 0;
+   for(long i = 0; i < n; i++) sum += exp((double)x[i] - shift);
+   return sum;
+}//}}}
+void logScalar(double x[], long n){//{{{
+   for(long i = 0; i < n; i++) x[i] = log(x[i]);
+}//}}}
+void log1pScalar(double x[], long n){//{{{
+   for(long i = 0; i < n; i++) x[i] = log1p(x[i]);
+}//}}}
+void digammaArrayScalar(double x[], long n){//{{{
+   for(long i = 0; i < n; i++) x[i] = digammaScalar(x[i]);
+}//}}}
+
+template<typename Real>
+VM_INLINE void expLoop(Real x[], long n){//{{{
+   long i, nv = n - n % VEC_BLOCK;
+   for(i = 0; i < nv; i++) x[i] = (Real)expK((double)x[i]);
+   for(; i < n; i++) x[i] = (Real)exp((double)x[i]);
+}//}}}
+template<typename Real>
+VM_INLINE double expSumLoop(const Real x[], long n, double shift){//{{{
+   // Independent partial sums allow vectorisation.
+   double part[VEC_BLOCK], sum = 0;
+   long i, j;
+   for(j = 0; j < VEC_BLOCK; j++) part[j] = 0;
+   for(i = 0; i + VEC_BLOCK <= n; i += VEC_BLOCK)
+      for(j = 0; j < VEC_BLOCK; j++) part[j] += expK((double)x[i + j] - shift);
+   for(; i < n; i++) sum += exp((double)x[i] - shift);
+   for(j = 0; j < VEC_BLOCK; j++) sum += part[j];
+   return sum;
+}//}}}
+VM_INLINE void logLoop(double x[], long n){//{{{
+   long i, nv = n - n % VEC_BLOCK;
+   for(i = 0; i < nv; i++) x[i] = logK(x[i]);
+   for(; i < n; i++) x[i] = log(x[i]);
+}//}}}
+VM_INLINE void log1pLoop(double x[], long n){//{{{
+   long i, nv = n - n % VEC_BLOCK;
+   for(i = 0; i < nv; i++) x[i] = log1pK(x[i]);
+   for(; i < n; i++) x[i] = log1p(x[i]);
+}//}}}
+VM_INLINE void digammaLoop(double x[], long n){//{{{
+   long i, nv = n - n % VEC_BLOCK;
+   for(i = 0; i < nv; i++) x[i] = digammaK(x[i]);
+   for(; i < n; i++) x[i] = digammaScalar(x[i]);
+}//}}}
+
+struct kernelsT{//{{{
+   const char *name;
+   void (*expD)(double[], long);
+   void (*expF)(float[], long);
+   double (*expSumD)(const double[], long, double);
+   double (*expSumF)(const float[], long, double);
+   void (*log)(double[], long);
+   void (*log1p)(double[], long);
+   void (*digamma)(double[], long);
+};//}}}
+
+// Define kernel set kernels_ISA compiled with attribute TARGET.
+#define VM_DEFINE_KERNELS(ISA, TARGET) \
+TARGET void expD_##ISA(double x[], long n){ expLoop(x, n); } \
+TARGET void expF_##ISA(float x[], long n){ expLoop(x, n); } \
+TARGET double expSumD_##ISA(const double x[], long n, double shift){ return expSumLoop(x, n, shift); } \
+TARGET double expSumF_##ISA(const float x[], long n, double shift){ return expSumLoop(x, n, shift); } \
+TARGET void log_##ISA(double x[], long n){ logLoop(x, n); } \
+TARGET void log1p_##ISA(double x[], long n){ log1pLoop(x, n); } \
+TARGET void digamma_##ISA(double x[], long n){ digammaLoop(x, n); } \
+const kernelsT kernels_##ISA = { #ISA, expD_##ISA, expF_##ISA, expSumD_##ISA, expSumF_##ISA, log_##ISA, log1p_##ISA, digamma_##ISA };
+
+#ifdef VM_X86
+VM_DEFINE_KERNELS(avx2, __attribute__((target("avx2,fma"))))
+VM_DEFINE_KERNELS(avx512, __attribute__((target("avx512f"))))
+const char scalarName[] = "sse2";
+#else
+const char scalarName[] = "generic";
+#endif
+const kernelsT kernels_scalar = { scalarName, expScalar<double>, expScalar<float>, expSumScalar<double>, expSumScalar<float>, logScalar, log1pScalar, digammaArrayScalar };
+
+const kernelsT *selectKernels(){//{{{
+#ifdef VM_X86
+   // BITSEQ_ISA limits the instruction set, any other value than avx512 and
+   // avx2 selects the scalar functions.
+   const char *limit = getenv("BITSEQ_ISA");
+   bool avx512 = (limit == NULL) || (limit[0] == '\0') || (strcmp(limit, "avx512") == 0);
+   bool avx2 = avx512 || (strcmp(limit, "avx2") == 0);
+   __builtin_cpu_init();
+   if(avx512 && __builtin_cpu_supports("avx512f")) return &kernels_avx512;
+   if(avx2 && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return &kernels_avx2;
+#endif
+   return &kernels_scalar;
+}//}}}
+const kernelsT &kernels(){//{{{
+   static const kernelsT *selected = selectKernels();
+   return *selected;
+}//}}}
+
+} // namespace
+
+const char *isaName(){//{{{
+   return kernels().name;
+}//}}}
+double digamma(double x){//{{{
+   return digammaScalar(x);
+}//}}}
+void expArrayV(double x[], long n){//{{{
+   kernels().expD(x, n);
+}//}}}
+void expArrayV(float x[], long n){//{{{
+   kernels().expF(x, n);
+}//}}}
+double expSumV(const double x[], long n, double shift){//{{{
+   return kernels().expSumD(x, n, shift);
+}//}}}
+double expSumV(const float x[], long n, double shift){//{{{
+   return kernels().expSumF(x, n, shift);
+}//}}}
+void logArrayV(double x[], long n){//{{{
+   kernels().log(x, n);
+}//}}}
+void log1pArrayV(double x[], long n){//{{{
+   kernels().log1p(x, n);
+}//}}}
+void digammaArrayV(double x[], long n){//{{{
+   kernels().digamma(x, n);
+}//}}}
+
+} // namespace ns_vecMath
@@ -0,0 +1,75 @@
+#ifndef VECMATH_H
+#define VECMATH_H
+
+#include<cmath>
+
+// Array versions of exp, log, log1p and digamma written so that the compiler
+// can vectorise them. On x86 the kernels are compiled for AVX2+FMA and AVX-512
+// and the best variant supported by the CPU is selected at run time, so the
+// binaries can still be built with -mtune=generic. On SSE2 only (and non-x86)
+// CPUs scalar libm functions are used, as 2-wide kernels are slower.
+// Environment variable BITSEQ_ISA (avx512, avx2, sse2) limits the selected
+// instruction set, e.g. to compare results.
+//
+// Accuracy (relative to libm, measured over the whole double range):
+//   exp, log, log1p: within 2 ulp,
+//   digamma: within 1e-14 (relative, or absolute near the root at 1.4616).
+// Results of vector exp() in the subnormal range are flushed to zero.
+// Results may differ in the last bits between instruction sets.
+namespace ns_vecMath {
+
+// Arrays shorter than VEC_MIN are processed inline using libm.
+const long VEC_MIN = 8;
+
+// Name of selected instruction set ("avx512", "avx2", "sse2" or "generic").
+const char *isaName();
+
+// Scalar digamma(x), x <= 0 produces NaN.
+double digamma(double x);
+
+// Dispatched kernels, use the functions below.
+void expArrayV(double x[], long n);
+void expArrayV(float x[], long n);
+double expSumV(const double x[], long n, double shift);
+double expSumV(const float x[], long n, double shift);
+void logArrayV(double x[], long n);
+void log1pArrayV(double x[], long n);
+void digammaArrayV(double x[], long n);
+
+// x_i = exp(x_i) for 0 <= i < n.
+template<typename Real>
+inline void expArray(Real x[], long n){//{{{
+   if(n >= VEC_MIN) expArrayV(x, n);
+   else for(long i = 0; i < n; i++) x[i] = (Real)exp((double)x[i]);
+}//}}}
+
+// Return sum of exp(x_i - shift) for 0 <= i < n.
+template<typename Real>
+inline double expSum(const Real x[], long n, double shift){//{{{
+   if(n >= VEC_MIN) return expSumV(x, n, shift);
+   double sum = 0;
+   for(long i = 0; i < n; i++) sum += exp((double)x[i] - shift);
+   return sum;
+}//}}}
+
+// x_i = log(x_i) for 0 <= i < n.
+inline void logArray(double x[], long n){//{{{
+   if(n >= VEC_MIN) logArrayV(x, n);
+   else for(long i = 0; i < n; i++) x[i] = log(x[i]);
+}//}}}
+
+// x_i = log(1 + x_i) for 0 <= i < n.
+inline void log1pArray(double x[], long n){//{{{
+   if(n >= VEC_MIN) log1pArrayV(x, n);
+   else for(long i = 0; i < n; i++) x[i] = log1p(x[i]);
+}//}}}
+
+// x_i = digamma(x_i) for 0 <= i < n; x_i <= 0 produces NaN.
+inline void digammaArray(double x[], long n){//{{{
+   if(n >= VEC_MIN) digammaArrayV(x, n);
+   else for(long i = 0; i < n; i++) x[i] = digamma(x[i]);
+}//}}}
+
+}
+
+#endif
@@ -88,7 +88,7 @@ int main(int argc,char* argv[]){
    }
    //}}}
    bool trans;
-   ifstream inFile;
+   IGzStream inFile;
    FileHeader fh;
    string geName,trName;
    TranscriptInfo trInfo;
@@ -102,7 +102,7 @@ int main(int argc,char* argv[]){
       M=trInfo.getM();
    } //}}}
 
-   ofstream outFile;
+   OGzStream outFile;
    if(!ns_misc::openOutput(args,&outFile))return 1;
 
    inFile.open(args.args()[0].c_str());
@@ -13,6 +13,7 @@
 using namespace std;
 
 #include "ArgumentParser.h"
+#include "AsyncWriter.h"
 #include "misc.h"
 #include "MyTimer.h"
 #include "PosteriorSamples.h"
@@ -30,7 +31,7 @@ namespace ns_estimateDE {
 // Open and write headers into appropriate output files.
 // The size of outFiles[] should be C+1.
 // Returns true if everything went OK.
-bool initializeOutputFile(long C, long M, long N, const ArgumentParser &args, ofstream *outF, ofstream outFiles[]);
+bool initializeOutputFile(long C, long M, long N, const ArgumentParser &args, AsyncWriter *outF, AsyncWriter outFiles[]);
 // For a given mean expression expr finds alpha and beta for which were estimated for a closes expression.
 void getParams(double expr,const vector<paramT> &params, paramT *par);
 // Read transcript m into tr and prepare mu_0 and mu_00, cond does not really change.
@@ -53,6 +54,7 @@ string programDescription =
    args.addOptionD("","confidenceInterval","cf",0,"Percentage for confidence intervals.", 95);
    args.addOptionS("","norm","normalization",0,"Normalization constants for each input file provided as comma separated list of doubles (e.g. 1.0017,1.0,0.9999 ).");
    args.addOptionL("","seed","seed",0,"Random initialization seed.");
+   args.addOptionB("","gzip","gzip",0,"Compress the output files (BGZF, .gz suffix is appended).");
    if(!args.parse(*argc,argv))return 0;
    if(args.verbose)buildTime(argv[0],__DATE__,__TIME__);
    //}}}
@@ -70,8 +72,8 @@ string programDescription =
    // Initialize sample files handled by object cond.
    if(!ns_misc::readConditions(args, &C, &M, &N, &cond)) return 1;
    // Initialize output files.
-   ofstream outF;
-   ofstream *outFiles = new ofstream[C+1];
+   AsyncWriter outF;
+   AsyncWriter *outFiles = new AsyncWriter[C+1];
    // Use standard array as we don't want to bother with vector of pointers.
    if(!ns_estimateDE::initializeOutputFile(C, M, N, args, &outF, outFiles)) return 1;
 
@@ -170,17 +172,17 @@ string programDescription =
       // }}}
       // Write logged condition mean for each condition. No space before EOL. {{{
       for(c = 0; c < C-1; c++)outF<<mu_c[c]<<" ";
-      outF<<mu_c[C-1]<<endl;
+      outF<<mu_c[C-1]<<"\n";
       // }}}
       // Write samples if necessary. {{{ 
       if(args.flag("samples")){
          for(c=0;c<C;c++){
             for(n=0;n<N;n++)outFiles[c]<<samples[c][n]<<" ";
-            outFiles[c]<<endl;
+            outFiles[c]<<"\n";
          }
          // Save sampled variance as well.
          for(n=0;n<N;n++) outFiles[C]<<vars[n]<<" ";
-         outFiles[C]<<endl;
+         outFiles[C]<<"\n";
       }//}}}
    }
    // Close and exit {{{
@@ -201,7 +203,7 @@ int main(int argc,char* argv[]){
 
 namespace ns_estimateDE {
 
-bool initializeOutputFile(long C, long M, long N, const ArgumentParser &args, ofstream *outF, ofstream outFiles[]){//{{{
+bool initializeOutputFile(long C, long M, long N, const ArgumentParser &args, AsyncWriter *outF, AsyncWriter outFiles[]){//{{{
    if(args.flag("samples")){
       // If samples flag is set, then write condition mean expression samples into -C?.est files.
       // Also write variance samples into samples file.
@@ -211,9 +213,8 @@ bool initializeOutputFile(long C, long M, long N, const ArgumentParser &args, of
       for(long c=0;c<C;c++){
          fnStream.str("");
          fnStream<<args.getS("outFilePrefix")<<"-C"<<c<<".est";
-         fileName = fnStream.str();
-         outFiles[c].open(fileName.c_str());
-         if(! outFiles[c].is_open()){
+         fileName = ns_gzStream::gzName(fnStream.str(), args.flag("gzip"));
+         if(! outFiles[c].open(fileName)){
             error("Unable to open output file %s\n",fileName.c_str());
             return false;
          }
@@ -224,25 +225,22 @@ bool initializeOutputFile(long C, long M, long N, const ArgumentParser &args, of
          for(long i=0;i<(long)args.args().size();i++){
             outFiles[c]<<args.args()[i]<<" ";
          }
-         outFiles[c]<<"\n# lambda_0 "<<args.getD("lambda0")<<"\n# T (Mrows_Ncols) L (logged)\n# M "<<M<<"\n# N "<<N<<endl;
+         outFiles[c]<<"\n# lambda_0 "<<args.getD("lambda0")<<"\n# T (Mrows_Ncols) L (logged)\n# M "<<M<<"\n# N "<<N<<"\n";
       }
       // Initialize file for variances.
-      string varFileName = args.getS("outFilePrefix")+".estVar";
-      outFiles[C].open(varFileName.c_str());
-      if(! outFiles[C].is_open()){
+      string varFileName = ns_gzStream::gzName(args.getS("outFilePrefix")+".estVar", args.flag("gzip"));
+      if(! outFiles[C].open(varFileName)){
          error("Unable to open output file %s\n",varFileName.c_str());
          return false;
       }
       // Write header for variance file.
       outFiles[C]<<"# Inferred variances in last condition.\n"
                    "# lambda_0 "<<args.getD("lambda0")
-                 <<"\n# T \n# M "<<M<<"\n# N "<<N
-                 <<endl;
+                 <<"\n# T \n# M "<<M<<"\n# N "<<N<<"\n";
    }
    // Initialize PPLR file.
-   string outFileName = args.getS("outFilePrefix")+".pplr";
-   outF->open(outFileName.c_str());
-   if(! outF->is_open()){
+   string outFileName = ns_gzStream::gzName(args.getS("outFilePrefix")+".pplr", args.flag("gzip"));
+   if(! outF->open(outFileName)){
       error("Unable to open output file %s\n",outFileName.c_str());
       return false;
    }
@@ -260,8 +258,7 @@ bool initializeOutputFile(long C, long M, long N, const ArgumentParser &args, of
           "log2 fold change with confidence intervals for each pair of conditions and "
           "log mean condition mean expression for each condition.\n"
           "# CPxPPLR CPx(log2FC ConfidenceLow ConfidenceHigh) "
-          "Cx(log mean condition mean expressions)"
-        <<endl;
+          "Cx(log mean condition mean expressions)\n";
    return true;
 }//}}}
 
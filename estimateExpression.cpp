@@ -7,6 +7,7 @@
 #include<sstream>
 
 #include "ArgumentParser.h"
+#include "AsyncWriter.h"
 #include "CollapsedSampler.h"
 #include "FileHeader.h"
 #include "GibbsSampler.h"
@@ -14,6 +15,7 @@
 #include "MyTimer.h"
 #include "Sampler.h"
 #include "TagAlignments.h"
+#include "Threads.h"
 #include "TranscriptInfo.h"
 #include "transposeFiles.h"
 
@@ -43,9 +45,14 @@ TagAlignments* readData(const ArgumentParser &args) {//{{{
    double prb;
    long Ntotal=0,Nmap=0,probM=0;
    string readId,strand,blank;
-   ifstream inFile;
+   IGzStream inFile;
    MyTimer timer;
-   TagAlignments *alignments = new TagAlignments(false);
+   ns_tagAlignments::ProbStorage storage = ns_tagAlignments::DOUBLE_STORAGE;
+   if(args.getLowerS("probStorage") == "float") storage = ns_tagAlignments::FLOAT_STORAGE;
+   else if(args.getLowerS("probStorage") == "quantised") storage = ns_tagAlignments::QUANTISED_STORAGE;
+   else if(args.getLowerS("probStorage") != "double")
+      warning("Main: Unknown probability storage '%s', using double.\n",args.getS("probStorage").c_str());
+   TagAlignments *alignments = new TagAlignments(false, storage);
 
    // Read alignment probabilities {{{
    inFile.open(args.args()[0].c_str());
@@ -149,8 +156,8 @@ void MCMC(TagAlignments *alignments,gibbsParameters &gPar,ArgumentParser &args){
    long i,j,samplesHave=0,totalSamples=0,samplesN,chainsN,samplesSave,seed;
    pairD rMean,tmpA,tmpV,sumNorms;
    double rH1,rH2;
-   ofstream meansFile;
-   ofstream *samplesFile = new ofstream[gPar.chainsN()];
+   OGzStream meansFile;
+   AsyncWriter *samplesFile = new AsyncWriter[gPar.chainsN()];
    MyTimer timer;
    bool quitNext = false;
    vector<pairD> betwVar(M),withVar(M),s2j(M),totAverage(M),av,var;
@@ -184,6 +191,32 @@ void MCMC(TagAlignments *alignments,gibbsParameters &gPar,ArgumentParser &args){
          samplers[j] = new GibbsSampler;
    }
 
+   // Per NUMA node copies of alignments for chains running on the node
+   // (original is used on the node of the main thread).
+   vector<TagAlignments*> replicas;
+   vector<long> chainAlignments(chainsN, -1);
+   // Without pinning the node of a chain's thread is not fixed (warned in main).
+   if(args.flag("numaReplicas") && (args.getLowerS("pinThreads") != "none") && (ns_threads::numaNodes() > 1)){
+      long mainNode = ns_threads::currentNode();
+      replicas.assign(ns_threads::numaNodes(), NULL);
+      // Same static schedule as sampling, so that chain i is run by the same
+      // (pinned) thread.
+      #pragma omp parallel for schedule(static)
+      for(i=0;i<chainsN;i++)chainAlignments[i] = ns_threads::currentNode();
+      // The first chain of each node copies the data (first touch on the node).
+      #pragma omp parallel for private(j) schedule(static)
+      for(i=0;i<chainsN;i++){
+         for(j=0;(j<i) && (chainAlignments[j]!=chainAlignments[i]);j++);
+         if((j==i) && (chainAlignments[i]!=mainNode))
+            replicas[chainAlignments[i]] = new TagAlignments(*alignments);
+      }
+      if(args.verbose){
+         long replicasN = 0;
+         for(j=0;j<(long)replicas.size();j++)if(replicas[j])replicasN++;
+         message("Alignments replicated on %ld NUMA nodes.\n",replicasN);
+      }
+   }
+
    timer.start();
    timer.start(1);
    if(args.isSet("seed"))seed=args.getL("seed");
@@ -194,7 +227,9 @@ void MCMC(TagAlignments *alignments,gibbsParameters &gPar,ArgumentParser &args){
       DEBUG(message("Sampler %ld init.\n",i);)
       samplers[i]->noSave();
       DEBUG(message("init\n");)
-      samplers[i]->init(M, samplesN, samplesSave, Nunmap, alignments, gPar.beta(), gPar.dir(), seed);
+      samplers[i]->init(M, samplesN, samplesSave, Nunmap,
+         ((chainAlignments[i] >= 0) && replicas[chainAlignments[i]]) ? replicas[chainAlignments[i]] : alignments,
+         gPar.beta(), gPar.dir(), seed);
       DEBUG(message("   seed: %ld\n",seed);)
       // sampler is initialized with 'seed' and then sets 'seed' to new random seed for the next sampler
    }
@@ -205,7 +240,7 @@ void MCMC(TagAlignments *alignments,gibbsParameters &gPar,ArgumentParser &args){
    long samplesDo, subCounter;
    for(samplesHave=0;samplesHave<gPar.burnIn();samplesHave+=samplesDo){
       samplesDo = min(gPar.burnIn() - samplesHave, samplesAtOnce);
-      #pragma omp parallel for private(subCounter)
+      #pragma omp parallel for private(subCounter) schedule(static)
       for(i=0;i<chainsN;i++){
          for(subCounter=0;subCounter<samplesDo; subCounter++){
            samplers[i]->sample();
@@ -215,7 +250,7 @@ void MCMC(TagAlignments *alignments,gibbsParameters &gPar,ArgumentParser &args){
       R_INTERUPT;
    }
 #else
-   #pragma omp parallel for private(samplesHave)
+   #pragma omp parallel for private(samplesHave) schedule(static)
    for(i=0;i<chainsN;i++){
       DEBUG(message(" burn in\n");) 
       for(samplesHave=0;samplesHave<gPar.burnIn();samplesHave++){
@@ -241,7 +276,7 @@ void MCMC(TagAlignments *alignments,gibbsParameters &gPar,ArgumentParser &args){
 #ifdef BIOC_BUILD
       for(samplesHave=0;samplesHave<samplesN;samplesHave+=samplesDo){
          samplesDo = min(samplesN - samplesHave, samplesAtOnce);
-         #pragma omp parallel for private(subCounter)
+         #pragma omp parallel for private(subCounter) schedule(static)
          for(i=0;i<chainsN;i++){
             for(subCounter=0;subCounter<samplesDo; subCounter++){
                samplers[i]->sample();
@@ -252,7 +287,7 @@ void MCMC(TagAlignments *alignments,gibbsParameters &gPar,ArgumentParser &args){
          R_INTERUPT;
       }
 #else
-      #pragma omp parallel for private(samplesHave)
+      #pragma omp parallel for private(samplesHave) schedule(static)
       for(i=0;i<chainsN;i++){
          for(samplesHave = 0;samplesHave<samplesN;samplesHave++){
             samplers[i]->sample();
@@ -423,11 +458,11 @@ void MCMC(TagAlignments *alignments,gibbsParameters &gPar,ArgumentParser &args){
             sstr.str("");
             sstr<<args.getS("outFilePrefix")<<"."<<args.getS("outputType")<<"S-"<<j;
             samplesFileNames.push_back(sstr.str());
-            samplesFile[j].open(samplesFileNames[j].c_str());
+            samplesFile[j].open(samplesFileNames[j]);
             if(! samplesFile[j].is_open()){
                error("Main: Unable to open output file '%s'.\n",(sstr.str()).c_str());
             }else{
-               samplesFile[j]<<"#\n# M "<<M-1<<"\n# N "<<samplesSave<<endl;
+               samplesFile[j]<<"#\n# M "<<M-1<<"\n# N "<<samplesSave<<"\n";
                samplers[j]->saveSamples(&samplesFile[j],trInfo.getShiftedLengths(true),args.getS("outputType"));
             }
          }
@@ -439,7 +474,8 @@ void MCMC(TagAlignments *alignments,gibbsParameters &gPar,ArgumentParser &args){
       //}}}
    }
    // Write means: {{{
-   meansFile.open((args.getS("outFilePrefix")+".thetaMeans").c_str());
+   string meansFileName = ns_gzStream::gzName(args.getS("outFilePrefix")+".thetaMeans", args.flag("gzip"));
+   meansFile.open(meansFileName.c_str());
    if(meansFile.is_open()){
       meansFile<<"# T => Mrows \n# M "<<M-1<<endl;
       meansFile<<"# file containing the mean value of theta - relative abundace of fragments and counts\n"
@@ -474,7 +510,7 @@ void MCMC(TagAlignments *alignments,gibbsParameters &gPar,ArgumentParser &args){
       }
       meansFile.close();
    }else{
-      warning("Main: Unable to write thetaMeans into: %s\n",(args.getS("outFilePrefix")+".thetaMeans").c_str());
+      warning("Main: Unable to write thetaMeans into: %s\n",meansFileName.c_str());
    }
    //}}}
    // Write thetaAct: {{{
@@ -498,6 +534,7 @@ void MCMC(TagAlignments *alignments,gibbsParameters &gPar,ArgumentParser &args){
    for(j=0;j<chainsN;j++){
       delete samplers[j];
    }
+   for(j=0;j<(long)replicas.size();j++)delete replicas[j];
 //   delete [] samplers;
    //}}}
    message("Total samples: %ld\n",totalSamples*chainsN);
@@ -528,6 +565,10 @@ string programDescription =
    args.addOptionD("","MCMC_dirAlpha","MCMC_dirAlpha",0,"Alpha parameter for the Dirichlet distribution.",1.0);
    args.addOptionB("","scaleReduction","scaleReduction",0,"Use scale reduction as stopping criterion, instead of computing effective sample size.");
    args.addOptionL("s","seed","seed",0,"Random initialization seed.");
+   args.addOptionS("","probStorage","probStorage",0,"Precision of alignment probabilities kept in memory (double, float, quantised). The float (4 bytes) and quantised (2 bytes, logarithm with step 1/1024) storage reduce memory at the cost of precision.","double");
+   args.addOptionB("","gzip","gzip",0,"Compress the samples and thetaMeans output files (BGZF, .gz suffix is appended).");
+   args.addOptionS("","pinThreads","pinThreads",0,"Pin threads (chains) to CPUs (none, close, spread).","none");
+   args.addOptionB("","numaReplicas","numaReplicas",0,"Keep a copy of the alignments on every NUMA node used by the chains (use with --pinThreads spread or close); uses more memory.");
    if(!args.parse(*argc,argv))return 0;
    if(args.verbose)buildTime(argv[0],__DATE__,__TIME__);
    // }}}
@@ -543,11 +584,13 @@ string programDescription =
    args.updateS("outputType", ns_expression::getOutputType(args));
    if(args.verbose)gPar.getAllParameters();
 #ifdef SUPPORT_OPENMP
-   if(args.isSet("procN"))
-      omp_set_num_threads(args.getL("procN"));
-   else
-      omp_set_num_threads(gPar.chainsN());
+   // Chains are sampled in parallel, more threads would not be used.
+   ns_threads::setThreads(args.isSet("procN") ? args.getL("procN") : gPar.chainsN(), args.verbose);
+   ns_threads::pinThreads(args.getLowerS("pinThreads"), args.verbose);
 #endif
+   if(args.flag("numaReplicas") && (args.getLowerS("pinThreads") == "none")){
+      warning("Main: --numaReplicas is ignored without --pinThreads close or spread.\n");
+   }
 
 
    //}}}
@@ -575,7 +618,7 @@ string programDescription =
    if(args.verbose)messageF("Starting the sampler.\n");
    MCMC(alignments,gPar,args);
    // {{{ Transpose and merge sample file 
-   if(transposeFiles(samplesFileNames,args.getS("outFilePrefix")+"."+args.getS("outputType"),args.verbose,failedMessage)){
+   if(transposeFiles(samplesFileNames,ns_gzStream::gzName(args.getS("outFilePrefix")+"."+args.getS("outputType"),args.flag("gzip")),args.verbose,failedMessage)){
       if(args.verbose)message("Sample files transposed. Deleting.\n");
       for(long i=0;i<(long)samplesFileNames.size();i++){
          remove(samplesFileNames[i].c_str());
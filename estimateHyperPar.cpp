@@ -69,7 +69,7 @@ string programDescription =
    vector<paramT> params;
    paramT param;
    TranscriptExpression trExp;
-   ofstream outF;
+   OGzStream outF;
 
    if(! args.flag("smoothOnly")){
       if(! args.isSet("meanFileName")){
@@ -102,7 +102,7 @@ string programDescription =
       if(args.verbose)message("Number of all replicates: %ld\n",RTN);
 
       // Prepare file for storing all sampled parameters.
-      ofstream paramsF;
+      OGzStream paramsF;
       if(storeAll){
          if(!ns_misc::openOutput(args.getS("paramsAllFileName"), &paramsF)) return 1;
          paramsF<<"# lambda0 "<<args.getD("lambda0")<<endl;
@@ -1,49 +1,43 @@
+#include<cmath>
+#include<fstream>
+#ifdef _OPENMP
+#include<omp.h>
+#endif
+#include<sstream>
+#include<unistd.h>
+
 #include "ArgumentParser.h"
+#include "AsyncWriter.h"
 #include "FileHeader.h"
 #include "misc.h"
 #include "MyTimer.h"
 #include "SimpleSparse.h"
 #include "TagAlignments.h"
+#include "Threads.h"
 #include "transposeFiles.h"
 #include "VariationalBayes.h"
+#include "VecMath.h"
 
 #include "common.h"
 
-SimpleSparse* readData(const ArgumentParser &args, long trM){//{{{
+template<typename Real>
+SimpleSparseT<Real>* readReads(IGzStream &inFile, ns_fileHeader::AlignmentFileType format, long readsN, long trM, bool verbose, long *bad){//{{{
 /*
- As parse(filename,maxreads=None) in python
- Python difference:
-  - missing maxreads check 
-    (abort if more than maxreads reads were processed)
+ Read (at most) readsN reads from inFile positioned after the header, the
+ number of reads with corrupted alignment information is added to bad.
+ Returns alignment log probabilities with at least trM columns.
 */
    long i,j,num,tid;
    double prb;
-   long Ntotal=0,Nmap=0, M=0;
-   string readId,strand,blank;
-   ifstream inFile;
+   long M=0;
+   string readId;
    MyTimer timer;
    TagAlignments *alignments = new TagAlignments();
 
-   // Read alignment probabilities {{{
-   inFile.open(args.args()[0].c_str());
-   FileHeader fh(&inFile);
-   ns_fileHeader::AlignmentFileType format;
-   if((!fh.probHeader(&Nmap,&Ntotal,&M,&format)) || (Nmap ==0)){//{{{
-      error("Prob file header read failed.\n");
-      return NULL;
-   }//}}}
-   if(format == ns_fileHeader::OLD_FORMAT){
-      error("Please use new/log format of Prob file.");
-      return NULL;
-   }
-   message("N mapped: %ld\n",Nmap);
-   messageF("N total:  %ld\n",Ntotal);
-   if(args.verb())message("Reading alignments.\n");
-   alignments->init(Nmap,0,M);
+   alignments->init(readsN,0,trM);
    long mod=10000;
-   long bad = 0;
    timer.start();
-   for(i = 0; i < Nmap; i++) {
+   for(i = 0; i < readsN; i++) {
       inFile>>readId>>num;
       if(!inFile.good())break;
      //    message("%s %ld\n",(readId).c_str(),num);
@@ -57,7 +51,7 @@ SimpleSparse* readData(const ArgumentParser &args, long trM){//{{{
             tid=0;
             // 10 means either 10 or exp(10), but should be still be large enough
             prb=10;
-            bad++;
+            (*bad)++;
          }
          switch(format){
             case ns_fileHeader::NEW_FORMAT:
@@ -75,27 +69,20 @@ SimpleSparse* readData(const ArgumentParser &args, long trM){//{{{
       alignments->pushRead();
       
       R_INTERUPT;
-      if(args.verb() && (i % mod == 0) && (i>0)){
+      if(verbose && (i % mod == 0) && (i>0)){
          message("  %ld ",i);
          timer.split();
          mod*=10;
       }
    }
-   if(bad>0)warning("Main: %ld reads' alignment information were corrupted.\n",bad);
-   inFile.close();
    long Nhits,NreadsReal;
    alignments->finalizeRead(&M, &NreadsReal, &Nhits);
    // Increase M based on number of transcripts in trInfo file.
    if(M<trM)M = trM;
-   //}}}
-   if(i<Nmap)message("Read only %ld reads.\n",NreadsReal);
-   message("All alignments: %ld\n",Nhits);
-   messageF("Isoforms: %ld\n",M);
-   Nmap = NreadsReal;
 
-   SimpleSparse *beta = new SimpleSparse(Nmap, M, Nhits);
+   SimpleSparseT<Real> *beta = new SimpleSparseT<Real>(NreadsReal, M, Nhits);
 
-   for(i=0;i<=Nmap;i++)beta->rowStart[i]=alignments->getReadsI(i);
+   for(i=0;i<=NreadsReal;i++)beta->rowStart[i]=alignments->getReadsI(i);
    for(i=0;i<Nhits;i++){
       beta->val[i]=alignments->getProb(i);
       beta->col[i]=alignments->getTrId(i);
@@ -105,120 +92,362 @@ SimpleSparse* readData(const ArgumentParser &args, long trM){//{{{
    return beta;
 }//}}}
 
-extern "C" int estimateVBExpression(int *argc, char* argv[]) {//{{{
-string programDescription =
-"Estimates expression given precomputed probabilities of (observed) reads' alignments.\n\
-   Uses Variational Bayes algorithm to produce parameters for distribution of relative abundances.\n";
-   // Set options {{{
-   ArgumentParser args;
-   args.init(programDescription,"[prob file]",1);
-   args.addOptionS("o","outPrefix","outFilePrefix",1,"Prefix for the output files.");
-   args.addOptionS("O","outType","outputType",0,"Output type (theta, RPKM, counts) of the samples sampled from the distribution.","theta");
-   args.addOptionS("t","trInfoFile","trInfoFileName",0,"File containing transcript information. (Necessary for RPKM samples)");
-   args.addOptionL("P","procN","procN",0,"Limit the maximum number of threads to be used.",4);
-   args.addOptionS("m","method","optMethod",0,"Optimization method (steepest, PR, FR, HS).","FR");
-   args.addOptionL("s","seed","seed",0,"Random initialization seed.");
-   args.addOptionL("","maxIter","maxIter",0,"Maximum number of iterations.",(long)1e4);
-   args.addOptionD("","optLimit","limit",0,"Optimisation limit in terms of minimal gradient or change of bound.",1e-5); 
-   args.addOptionL("","samples","samples",0,"Number of samples to be sampled from the distribution.");
-   args.addOptionB("V","veryVerbose","veryVerbose",0,"More verbose output, better if output forwarded into file.");
-   args.addOptionB("","saveAlignmentProbs","saveAlignmentProbs",0,"Output phi (probabilities of reads mapping to each transcript).");
-   if(!args.parse(*argc,argv))return 0;
-   if(args.verbose)buildTime(argv[0],__DATE__,__TIME__);
-   OPT_TYPE optM;
-   if(args.isSet("optMethod")){
-      if((args.getLowerS("optMethod")=="steepest")||
-         (args.getLowerS("optMethod")=="vbem"))optM = OPTT_STEEPEST;
-      else if(args.getLowerS("optMethod")=="pr")optM = OPTT_PR;
-      else if(args.getLowerS("optMethod")=="fr")optM = OPTT_FR;
-      else if(args.getLowerS("optMethod")=="hs")optM = OPTT_HS;
-      else optM = OPTT_FR;
-   }else  optM = OPTT_FR;
-   args.updateS("outputType", ns_expression::getOutputType(args, "theta"));
-   if(args.getS("outputType") == "tau"){
-      error("Main: 'tau' is not valid output type.\n");
+// Open prob file and read its header.
+bool openProb(const string &probFile, IGzStream *inFile, long *Nmap, long *Ntotal, long *M, ns_fileHeader::AlignmentFileType *format){//{{{
+   inFile->open(probFile.c_str());
+   FileHeader fh(inFile);
+   if((!fh.probHeader(Nmap,Ntotal,M,format)) || (*Nmap ==0)){//{{{
+      error("Prob file header read failed.\n");
+      return false;
+   }//}}}
+   if(*format == ns_fileHeader::OLD_FORMAT){
+      error("Please use new/log format of Prob file.");
+      return false;
+   }
+   return true;
+}//}}}
+
+// Estimate number of alignments in prob file from the number of mapped reads
+// in the header and the alignments of the first (up to 1000) reads.
+long estimateAlignments(const string &probFile){//{{{
+   long Ntotal=0, Nmap=0, M=0, readsN, alignmentsN = 0, k;
+   string readId;
+   IGzStream inFile;
+   ns_fileHeader::AlignmentFileType format;
+   if(!openProb(probFile, &inFile, &Nmap, &Ntotal, &M, &format))return 0;
+   for(readsN = 0; readsN < 1000; readsN++){
+      inFile>>readId>>k;
+      if(!inFile.good())break;
+      alignmentsN += k;
+      inFile.ignore(10000000,'\n');
+   }
+   inFile.close();
+   if(readsN == 0)return 0;
+   return (long)ceil((double)alignmentsN / readsN * Nmap);
+}//}}}
+
+template<typename Real>
+SimpleSparseT<Real>* readData(const ArgumentParser &args, const string &probFile, long trM, const AllReduce *reducer = NULL){//{{{
+/*
+ As parse(filename,maxreads=None) in python
+ Python difference:
+  - missing maxreads check 
+    (abort if more than maxreads reads were processed)
+ In distributed mode only the part (shard) of reads of this process is read.
+*/
+   long Ntotal=0,Nmap=0, M=0, bad=0, i, first=0, readsN;
+   IGzStream inFile;
+   ns_fileHeader::AlignmentFileType format;
+
+   // Read alignment probabilities {{{
+   if(!openProb(probFile, &inFile, &Nmap, &Ntotal, &M, &format))return NULL;
+   message("N mapped: %ld\n",Nmap);
+   messageF("N total:  %ld\n",Ntotal);
+   readsN = Nmap;
+   if(reducer && (reducer->getSize() > 1)){
+      first = Nmap * reducer->getRank() / reducer->getSize();
+      readsN = Nmap * (reducer->getRank() + 1) / reducer->getSize() - first;
+      message("Process %ld of %ld: reads %ld - %ld.\n", reducer->getRank(), reducer->getSize(), first, first + readsN - 1);
+      // Reads are on separate lines.
+      for(i=0;(i<first) && inFile.good();i++)inFile.ignore(10000000,'\n');
+   }
+   if(args.verb())message("Reading alignments.\n");
+   SimpleSparseT<Real> *beta = readReads<Real>(inFile, format, readsN, trM, args.verb(), &bad);
+   if(bad>0)warning("Main: %ld reads' alignment information were corrupted.\n",bad);
+   inFile.close();
+   //}}}
+   if(beta->N<readsN)message("Read only %ld reads.\n",beta->N);
+   message("All alignments: %ld\n",beta->T);
+   messageF("Isoforms: %ld\n",beta->M);
+   return beta;
+}//}}}
+
+// Read Dirichlet parameters (second column) from .m_alphas file.
+bool readAlphas(const string &fileName, vector<double> *alphas){//{{{
+   long i,M=0;
+   double mean,beta;
+   IGzStream inF(fileName.c_str());
+   FileHeader fh(&inF);
+   if((!fh.varianceHeader(&M,NULL))||(M<=0)){
+      error("Main: Problem loading alphas file %s\n",fileName.c_str());
+      return false;
+   }
+   alphas->resize(M);
+   for(i=0;i<M;i++){
+      inF>>mean>>(*alphas)[i]>>beta;
+      inF.ignore(1000,'\n');
+      if(inF.fail() || ((*alphas)[i] <= 0)){
+         error("Main: Problem reading alpha of transcript %ld from %s.\n",i,fileName.c_str());
+         return false;
+      }
+   }
+   fh.close();
+   return true;
+}//}}}
+
+// Write expected theta and Dirichlet parameters.
+bool writeAlphas(const ArgumentParser &args, const string &probFile, const string &outPrefix, const double alpha[], long M){//{{{
+   double alphaSum = 0 ;
+   long i;
+   for(i=0;i<M;i++)alphaSum+=alpha[i];
+   OGzStream outF;
+   if(! ns_misc::openOutput(ns_gzStream::gzName(outPrefix+".m_alphas", args.flag("gzip")), &outF)){
+      return false;
+   }
+   outF<<"# "<<probFile<<endl;
+   outF<<"# M "<<M<<"\n"
+         "# List includes also 'noise' transcript (first line)\n"
+         "# <alpha> - parameter of Dirichlet distribution\n"
+         "# <alpha> <beta> - parameters of the marginal Gamma distribution\n"
+         "# columns: <mean theta> <alpha> <beta>"<<endl;
+   outF<<scientific;
+   outF.precision(9);
+   for(i=0;i<M;i++){
+      outF<<alpha[i]/alphaSum<<" "<<alpha[i]<<" "<<alphaSum-alpha[i]<<endl;
+   }
+   outF.close();
+   return true;
+}//}}}
+
+// Generate samples using VB (VariationalBayesT or StochasticVB).
+template<typename VB>
+int writeSamples(const ArgumentParser &args, const string &outPrefix, long M, TranscriptInfo &trInfo, MyTimer &timer, VB &varB){//{{{
+   string outTypeS = args.getS("outputType");
+   string samplesFName = ns_gzStream::gzName(outPrefix+".VB" + outTypeS, args.flag("gzip"));
+   string samplesTmpName = outPrefix+".VB"+outTypeS+"TMP"; 
+   timer.start(0);
+   if(args.verbose)messageF("Generating samples into temporary file %s. ",samplesTmpName.c_str());
+   AsyncWriter samplesF;
+   if(!samplesF.open(samplesTmpName)){
+      error("Main: File '%s' open failed.\n",samplesTmpName.c_str());
       return 1;
    }
-   // }}}
-   MyTimer timer;
-   timer.start(2);
-   long M = 0; 
-   SimpleSparse *beta;
-   TranscriptInfo trInfo;
+   // Samples are generated without the "noise transcript".
+   samplesF<<"# M "<<M-1<<" N "<<args.getL("samples")<<"\n";
+   varB.generateSamples(args.getL("samples"), outTypeS, trInfo.getShiftedLengths(), &samplesF);
+   if(!samplesF.close()) return 1;
+   if(args.verbose)timer.split(0);
+   if(transposeFiles(vector<string>(1, samplesTmpName), samplesFName, args.verbose, "")){
+      if(args.verbose)message("Removing temporary file %s.\n", samplesTmpName.c_str());
+      remove(samplesTmpName.c_str());
+   }else {
+      error("Main: Transposing samples failed.\n");
+      return 1;
+   }
+   return 0;
+}//}}}
 
-   // {{{ Read transcriptInfo and .prob file 
-   if((!args.isSet("trInfoFileName"))||(!trInfo.readInfo(args.getS("trInfoFileName")))){
-      if(args.isSet("samples") && (args.getL("samples")>0) && (args.getS("outputType") == "rpkm")){
-         error("Main: Missing transcript info file. The file is necessary for producing RPKM samples.\n");
-         return 1;
+// Stochastic VB: stream mini-batches of reads from the prob file (several
+// passes), only one batch is kept in memory.
+template<typename Real>
+int estimateSVI(const ArgumentParser &args, const string &probFile, const string &outPrefix, long M, TranscriptInfo &trInfo, MyTimer &timer){//{{{
+   long Ntotal=0, Nmap=0, probM=0, bad=0, epoch, readsN=0, batchSize = args.getL("sviBatch");
+   double rho = 0;
+   IGzStream inFile;
+   ns_fileHeader::AlignmentFileType format;
+   if(!openProb(probFile, &inFile, &Nmap, &Ntotal, &probM, &format))return 1;
+   inFile.close();
+   // Header M does not include the noise transcript.
+   if(M<probM+1)M = probM+1;
+   if(M<=0){
+      error("Main: Number of transcripts unknown, use .prob file with M in the header or provide trInfoFile.\n");
+      return 1;
+   }
+   if(batchSize<=0)batchSize = 1;
+   message("N mapped: %ld\n",Nmap);
+   messageF("N total:  %ld\n",Ntotal);
+   StochasticVB svi(M, Nmap, ns_misc::getSeed(args), args.getD("sviKappa"), args.getD("sviTau"));
+   if(args.verbose)message("Starting stochastic VB (batch size %ld, %ld passes).\n", batchSize, args.getL("sviEpochs"));
+   for(epoch=0;epoch<args.getL("sviEpochs");epoch++){
+      if(!openProb(probFile, &inFile, &Nmap, &Ntotal, &probM, &format))return 1;
+      readsN = 0;
+      bad = 0;
+      while(true){
+         SimpleSparseT<Real> *batch = readReads<Real>(inFile, format, batchSize, M, false, &bad);
+         if(batch->N == 0){
+            delete batch;
+            break;
+         }
+         if(batch->M > M){
+            error("Main: Transcript index %ld exceeds number of transcripts (%ld).\n", batch->M - 1, M);
+            delete batch;
+            return 1;
+         }
+         readsN += batch->N;
+         batch->collapseRows();
+         rho = svi.update(batch);
+         delete batch;
+         R_INTERUPT;
       }
-   }else{
-      M = trInfo.getM()+1;
+      inFile.close();
+      if(bad>0)warning("Main: %ld reads' alignment information were corrupted.\n",bad);
+      // Scale batches by the real number of reads.
+      svi.setNreads(readsN);
+      if(args.verbose){
+         message("  pass %ld: %ld reads, %ld updates, step size %lg ", epoch + 1, readsN, svi.getIteration(), rho);
+         timer.split();
+      }
+   }
+
+   double *alpha = svi.getAlphas();
+   if(!writeAlphas(args, probFile, outPrefix, alpha, M))return 1;
+   delete[] alpha;
+   if(args.isSet("samples") && (args.getL("samples")>0)){
+      return writeSamples(args, outPrefix, M, trInfo, timer, svi);
    }
-   beta = readData(args,M);
+   return 0;
+}//}}}
+
+// Memory limit shared by samples processed concurrently in batch mode.
+class MemoryBudget{//{{{
+   private:
+      long limit,used,running;
+      vector<long> jobMem;
+   public:
+      MemoryBudget(long limitMB, long jobsN){
+         limit = limitMB * 1024 * 1024;
+         used = running = 0;
+         jobMem.assign(jobsN, 0);
+      }
+      // Wait until mem bytes are available for job. Job proceeds even over
+      // the limit if no other job holds memory (so that it can not deadlock).
+      void acquire(long job, long mem){
+         bool granted = false;
+         while(true){
+            #pragma omp critical(vbMemoryBudget)
+            {
+               if((limit <= 0) || (used + mem <= limit) || (running == 0)){
+                  used += mem;
+                  running++;
+                  jobMem[job] = mem;
+                  granted = true;
+               }
+            }
+            if(granted)return;
+            usleep(100000);
+         }
+      }
+      // Release memory held by job (if any).
+      void release(long job){
+         #pragma omp critical(vbMemoryBudget)
+         {
+            if(jobMem[job] > 0){
+               used -= jobMem[job];
+               running--;
+               jobMem[job] = 0;
+            }
+         }
+      }
+};//}}}
+
+// Read alignments, optimize and write results, with per-alignment values
+// stored as Real. In batch mode memory (estimated from the prob file) is
+// requested from budget before reading the alignments and the job's threads
+// are taken from share.
+template<typename Real>
+int estimateVB(const ArgumentParser &args, const string &probFile, const string &outPrefix, OPT_TYPE optM, long M, TranscriptInfo &trInfo, MyTimer &timer, MemoryBudget *budget = NULL, ns_threads::ThreadShare *share = NULL, long job = 0){//{{{
+   vector<double> initAlpha;
+   if(args.isSet("initFile")){
+      if(!readAlphas(args.getS("initFile"), &initAlpha))return 1;
+      if(M < (long)initAlpha.size())M = initAlpha.size();
+   }
+   AllReduce reducer;
+   bool distributed = args.isSet("distAddress"), mainProcess = true;
+   if(distributed){
+      if(args.verbose)message("Connecting process %ld of %ld (%s).\n", args.getL("distRank"), args.getL("distSize"), args.getS("distAddress").c_str());
+      if(!reducer.init(args.getS("distAddress"), args.getL("distRank"), args.getL("distSize")))return 1;
+      mainProcess = (reducer.getRank() == 0);
+   }
+   if(budget)budget->acquire(job, VariationalBayesT<Real>::memoryEstimate(estimateAlignments(probFile), optM, args.flag("lowMemory")));
+   if(share)share->start(job);
+   SimpleSparseT<Real> *beta = readData<Real>(args,probFile,M,distributed ? &reducer : NULL);
    if(! beta){
       error("Main: Reading probabilities failed.\n");
       return 1;
    }
+   if(distributed){
+      // All processes need the same number of transcripts.
+      double maxM = beta->M;
+      if(!reducer.max(&maxM, 1))return 1;
+      beta->M = (long)maxM;
+   }
    M = beta->M;
    if(M<=0){
       error("Main: Invalid number of transcripts in .prob file.\n");
       return 1;
    }
-   // }}}
+   // Reads with identical alignments have identical phi at the optimum, so they
+   // can be optimised as one weighted row. Alignment probabilities (phi) are saved per read.
+   if(args.flag("collapseReads") && !args.flag("saveAlignmentProbs")){
+      long readsN = beta->N;
+      beta->collapseRows();
+      if(args.verbose)message("Reads collapsed into %ld classes (%ld reads, %ld alignments).\n",beta->N,readsN,beta->T);
+   }
+
+   // With pinned threads, move reads' data near the threads processing them.
+   if(args.getLowerS("pinThreads") != "none")beta->placeRows();
 
    if(args.verbose)timer.split();
 
-   if(args.verbose)message("Initializing VB.\n");
+   if(args.verbose)message("Initializing VB (%s math kernels).\n", ns_vecMath::isaName());
 
-   VariationalBayes varB(beta,NULL,ns_misc::getSeed(args),args.getL("procN"));
+   double *priorAlpha = NULL;
+   if(args.isSet("initFile")){
+      // Transcripts not present in the previous run start from prior 1.
+      initAlpha.resize(M, 1.0);
+      if(args.flag("incremental")){
+         // Previous posterior is the prior for new reads, VariationalBayes
+         // takes ownership of the array.
+         priorAlpha = new double[M];
+         for(long m=0;m<M;m++)priorAlpha[m] = initAlpha[m];
+      }
+   }
+   VariationalBayesT<Real> varB(beta,priorAlpha,ns_misc::getSeed(args),args.flag("lowMemory"));
+   if(args.isSet("initFile"))varB.initPhi(&initAlpha[0]);
+   if(distributed)varB.setReducer(&reducer);
+   if(share)varB.setThreadShare(share, job);
    
    if(args.verbose)timer.split();
    if(args.verbose)message("Starting VB optimization.\n");
    
 #ifdef LOG_CONV
-   varB.setLog(args.getS("outFilePrefix")+".convLog",&timer);
+   varB.setLog(outPrefix+".convLog",&timer);
 #endif
 
    // Optimize:
    if(!args.verbose)varB.beQuiet();
+   if(args.isSet("activeTol"))varB.setActiveSet(args.getD("activeTol"),args.getL("activeCheck"));
    varB.optimize(args.flag("veryVerbose"),optM,args.getL("maxIter"),args.getD("limit"),args.getD("limit"));
 
    if(args.verbose){timer.split(0,'m');}
-   double *alpha = varB.getAlphas();
-   double alphaSum = 0 ;
-   long i;
-   for(i=0;i<M;i++)alphaSum+=alpha[i];
-   ofstream outF;
-   if(! ns_misc::openOutput((args.getS("outFilePrefix")+".m_alphas"), &outF)){
+   if(distributed && (!reducer.good())){
+      error("Main: Distributed optimization failed.\n");
+      delete beta;
       return 1;
    }
-   outF<<"# "<<args.args()[0]<<endl;
-   outF<<"# M "<<M<<"\n"
-         "# List includes also 'noise' transcript (first line)\n"
-         "# <alpha> - parameter of Dirichlet distribution\n"
-         "# <alpha> <beta> - parameters of the marginal Gamma distribution\n"
-         "# columns: <mean theta> <alpha> <beta>"<<endl;
-   outF<<scientific;
-   outF.precision(9);
-   for(i=0;i<M;i++){
-      outF<<alpha[i]/alphaSum<<" "<<alpha[i]<<" "<<alphaSum-alpha[i]<<endl;
+   if(!mainProcess){
+      // Results are written by process 0.
+      delete beta;
+      return 0;
    }
-   outF.close();
+   double *alpha = varB.getAlphas();
+   long i;
+   if(!writeAlphas(args, probFile, outPrefix, alpha, M))return 1;
+   OGzStream outF;
 
    // print read/transcript probabilities
    if(args.isSet("phi")) {
       long j;
-      SimpleSparse *phi = varB.getPhi();
-      if(! ns_misc::openOutput((args.getS("outFilePrefix")+".m_phi"), &outF)){
+      SimpleSparseT<Real> *phi = varB.getPhi();
+      if(! ns_misc::openOutput(ns_gzStream::gzName(outPrefix+".m_phi", args.flag("gzip")), &outF)){
          return 1;
       }
 
       // Get read headers. Already performed in readData but function returns SimpleSparse
       long Ntotal=0,Nmap=0, M=0;
-      ifstream inF;
+      IGzStream inF;
       string readId;
-      inF.open(args.args()[0].c_str());
+      inF.open(probFile.c_str());
 
       FileHeader fh(&inF);
       ns_fileHeader::AlignmentFileType format;
@@ -259,25 +488,203 @@ string programDescription =
    delete beta;
    delete[] alpha;
    if(args.isSet("samples") && (args.getL("samples")>0)){
-      string outTypeS = args.getS("outputType");
-      string samplesFName = args.getS("outFilePrefix")+".VB" + outTypeS;
-      string samplesTmpName = args.getS("outFilePrefix")+".VB"+outTypeS+"TMP"; 
-      timer.start(0);
-      if(args.verbose)messageF("Generating samples into temporary file %s. ",samplesTmpName.c_str());
-      if(!ns_misc::openOutput(samplesTmpName, &outF)) return 1;
-      // Samples are generated without the "noise transcript".
-      outF<<"# M "<<M-1<<" N "<<args.getL("samples")<<endl;
-      varB.generateSamples(args.getL("samples"), outTypeS, trInfo.getShiftedLengths(), &outF);
-      outF.close();
-      if(args.verbose)timer.split(0);
-      if(transposeFiles(vector<string>(1, samplesTmpName), samplesFName, args.verbose, "")){
-         if(args.verbose)message("Removing temporary file %s.\n", samplesTmpName.c_str());
-         remove(samplesTmpName.c_str());
-      }else {
-         error("Main: Transposing samples failed.\n");
+      return writeSamples(args, outPrefix, M, trInfo, timer, varB);
+   }
+   return 0;
+}//}}}
+
+// Estimate one sample using the selected mode and precision.
+int estimateSample(const ArgumentParser &args, const string &probFile, const string &outPrefix, OPT_TYPE optM, long M, TranscriptInfo &trInfo, MyTimer &timer, MemoryBudget *budget = NULL, ns_threads::ThreadShare *share = NULL, long job = 0){//{{{
+   if(args.flag("svi")){
+      if(share)share->start(job);
+      if(args.getLowerS("precision") == "float")
+         return estimateSVI<float>(args, probFile, outPrefix, M, trInfo, timer);
+      else
+         return estimateSVI<double>(args, probFile, outPrefix, M, trInfo, timer);
+   }
+   if(args.getLowerS("precision") == "float")
+      return estimateVB<float>(args, probFile, outPrefix, optM, M, trInfo, timer, budget, share, job);
+   return estimateVB<double>(args, probFile, outPrefix, optM, M, trInfo, timer, budget, share, job);
+}//}}}
+
+// Batch mode: estimate all samples listed in manifest (lines with prob file
+// and output prefix), several samples are processed concurrently and the
+// threads (procN) are split between them. Threads of finished samples are
+// handed to the samples still running.
+int estimateBatch(const ArgumentParser &args, OPT_TYPE optM, long M, TranscriptInfo &trInfo){//{{{
+   vector<string> probFiles,outPrefixes;
+   string line,probFile,outPrefix;
+   ifstream manifest(args.args()[0].c_str());
+   if(!manifest.is_open()){
+      error("Main: Can not open manifest file %s.\n",args.args()[0].c_str());
+      return 1;
+   }
+   while(getline(manifest,line)){
+      istringstream lineS(line);
+      if(!(lineS>>probFile) || (probFile[0]=='#'))continue;
+      if(!(lineS>>outPrefix)){
+         error("Main: Missing output prefix for %s in manifest.\n",probFile.c_str());
+         return 1;
+      }
+      probFiles.push_back(probFile);
+      outPrefixes.push_back(args.getS("outFilePrefix") + outPrefix);
+   }
+   manifest.close();
+   long samplesN = probFiles.size(), procN = ns_threads::threadsN(), jobsN = args.getL("batchJobs");
+   if(samplesN == 0){
+      error("Main: No samples in manifest %s.\n",args.args()[0].c_str());
+      return 1;
+   }
+   if(jobsN <= 0)jobsN = procN;
+   if(jobsN > samplesN)jobsN = samplesN;
+#ifdef BIOC_BUILD
+   // R interrupts can be checked only from the main thread.
+   jobsN = 1;
+#endif
+   // Threads of each sample's optimisation.
+   ArgumentParser jobArgs(args);
+   jobArgs.updateL("procN", max(1L, procN / jobsN));
+   // Output of concurrent samples would be interleaved.
+   if(jobsN > 1)jobArgs.verbose = false;
+   // Threads of nested regions are not pinned.
+   jobArgs.updateS("pinThreads", "none");
+   if(args.verbose)message("Batch of %ld samples, %ld concurrently using initially %ld threads each.\n", samplesN, jobsN, jobArgs.getL("procN"));
+   MemoryBudget budget(args.getL("memLimit"), jobsN);
+   ns_threads::ThreadShare share(procN, jobsN);
+   long i,failed = 0;
+#ifdef _OPENMP
+   omp_set_max_active_levels(2);
+#endif
+   #pragma omp parallel for num_threads(jobsN) schedule(dynamic,1) reduction(+:failed)
+   for(i=0;i<samplesN;i++){
+      long job = 0;
+#ifdef _OPENMP
+      job = omp_get_thread_num();
+#endif
+      MyTimer timer;
+      timer.start(2);
+      if(estimateSample(jobArgs, probFiles[i], outPrefixes[i], optM, M, trInfo, timer, &budget, &share, job) != 0){
+         error("Main: Sample %s failed.\n",probFiles[i].c_str());
+         failed++;
+      }else if(args.verbose){
+         message("Sample %s finished.\n",probFiles[i].c_str());
+      }
+      share.finish(job);
+      budget.release(job);
+   }
+   if(failed > 0){
+      error("Main: %ld of %ld samples failed.\n", failed, samplesN);
+      return 1;
+   }
+   return 0;
+}//}}}
+
+extern "C" int estimateVBExpression(int *argc, char* argv[]) {//{{{
+string programDescription =
+"Estimates expression given precomputed probabilities of (observed) reads' alignments.\n\
+   Uses Variational Bayes algorithm to produce parameters for distribution of relative abundances.\n";
+   // Set options {{{
+   ArgumentParser args;
+   args.init(programDescription,"[prob file | manifest file]",1);
+   args.addOptionS("o","outPrefix","outFilePrefix",1,"Prefix for the output files.");
+   args.addOptionS("O","outType","outputType",0,"Output type (theta, RPKM, counts) of the samples sampled from the distribution.","theta");
+   args.addOptionS("t","trInfoFile","trInfoFileName",0,"File containing transcript information. (Necessary for RPKM samples)");
+   args.addOptionL("P","procN","procN",0,"Limit the maximum number of threads to be used (0 for all available CPUs).",4);
+   args.addOptionS("m","method","optMethod",0,"Optimization method (steepest, PR, FR, HS, SQUAREM, Armijo).","FR");
+   args.addOptionL("s","seed","seed",0,"Random initialization seed.");
+   args.addOptionL("","maxIter","maxIter",0,"Maximum number of iterations.",(long)1e4);
+   args.addOptionD("","optLimit","limit",0,"Optimisation limit in terms of minimal gradient or change of bound.",1e-5); 
+   args.addOptionL("","samples","samples",0,"Number of samples to be sampled from the distribution.");
+   args.addOptionB("V","veryVerbose","veryVerbose",0,"More verbose output, better if output forwarded into file.");
+   args.addOptionB("","saveAlignmentProbs","saveAlignmentProbs",0,"Output phi (probabilities of reads mapping to each transcript).");
+   args.addOptionB("","collapseReads","collapseReads",0,"Optimise reads with identical alignments as one weighted row (not with saveAlignmentProbs). Reduces time and memory, the results differ only within the optimisation limit, as after a change of the random seed.");
+   args.addOptionB("","gzip","gzip",0,"Compress the output files (BGZF, .gz suffix is appended).");
+   args.addOptionS("","precision","precision",0,"Precision of arrays with values for every alignment (double, float). The float storage halves the memory, sums are still accumulated in double precision.","double");
+   args.addOptionD("","activeTol","activeTol",0,"Active set mode: reads with squared (natural) gradient norm below activeTol are frozen and not updated until re-validation (only steepest, PR, FR and HS methods; 0 disables).",0);
+   args.addOptionL("","activeCheck","activeCheck",0,"Number of iterations after which frozen reads are re-validated in active set mode.",20);
+   args.addOptionB("","lowMemory","lowMemory",0,"Do not store phi and gradients, recompute them instead (only steepest and FR methods). Uses about three times less memory at the cost of more computation.");
+   args.addOptionS("","init","initFile",0,"Initialise from the Dirichlet parameters of a previous run (.m_alphas file), for example when reads were added to the library.");
+   args.addOptionB("","incremental","incremental",0,"Incremental mode: the .prob file contains only new reads and the previous result (--init) is used as the prior, so the output describes all reads. Assignments of the previous reads are not revisited, use a full run if the new reads change the expression considerably.");
+   args.addOptionS("","pinThreads","pinThreads",0,"Pin threads to CPUs (none, close, spread); with pinned threads the reads' data are placed on the NUMA node of the thread processing them. Not used in batch mode.","none");
+   args.addOptionB("","batch","batch",0,"Batch mode: the argument is a manifest file with lines '<prob file> <output prefix>', samples are processed concurrently sharing procN threads (outPrefix is prepended to the output prefixes).");
+   args.addOptionL("","batchJobs","batchJobs",0,"Number of samples processed concurrently in batch mode (0 means procN).",0);
+   args.addOptionL("","memLimit","memLimit",0,"Memory limit (in MB) for samples optimised concurrently in batch mode, samples wait until enough memory is available (0 for no limit).",0);
+   args.addOptionS("","distAddress","distAddress",0,"Distributed mode: address used by processes which share the optimization, each process reads only its part of the .prob file (Unix socket path or host:port for TCP). Process 0 listens on the address and writes the results.");
+   args.addOptionL("","distRank","distRank",0,"Distributed mode: index of this process (0 to distSize-1).",0);
+   args.addOptionL("","distSize","distSize",0,"Distributed mode: number of processes.",1);
+   args.addOptionB("","svi","svi",0,"Use stochastic VB: stream mini-batches of reads from the .prob file in several passes, only one batch is kept in memory (for libraries which do not fit in memory). Reads should be in the original (not sorted by transcript) order.");
+   args.addOptionL("","sviBatch","sviBatch",0,"Number of reads in one stochastic VB mini-batch.",100000);
+   args.addOptionL("","sviEpochs","sviEpochs",0,"Number of passes through the .prob file in stochastic VB.",3);
+   args.addOptionD("","sviKappa","sviKappa",0,"Stochastic VB step size decay rate kappa, step size is (tau+t)^-kappa (0.5 < kappa <= 1).",0.7);
+   args.addOptionD("","sviTau","sviTau",0,"Stochastic VB step size delay tau.",1.0);
+   if(!args.parse(*argc,argv))return 0;
+   if(args.verbose)buildTime(argv[0],__DATE__,__TIME__);
+   OPT_TYPE optM;
+   if(args.isSet("optMethod")){
+      if((args.getLowerS("optMethod")=="steepest")||
+         (args.getLowerS("optMethod")=="vbem"))optM = OPTT_STEEPEST;
+      else if(args.getLowerS("optMethod")=="pr")optM = OPTT_PR;
+      else if(args.getLowerS("optMethod")=="fr")optM = OPTT_FR;
+      else if(args.getLowerS("optMethod")=="hs")optM = OPTT_HS;
+      else if(args.getLowerS("optMethod")=="squarem")optM = OPTT_SQUAREM;
+      else if(args.getLowerS("optMethod")=="armijo")optM = OPTT_ARMIJO;
+      else optM = OPTT_FR;
+   }else  optM = OPTT_FR;
+   args.updateS("outputType", ns_expression::getOutputType(args, "theta"));
+   if(args.getS("outputType") == "tau"){
+      error("Main: 'tau' is not valid output type.\n");
+      return 1;
+   }
+   if((args.getLowerS("precision") != "double") && (args.getLowerS("precision") != "float")){
+      warning("Main: Unknown precision '%s', using double.\n",args.getS("precision").c_str());
+      args.updateS("precision", "double");
+   }
+   // }}}
+   MyTimer timer;
+   timer.start(2);
+   long M = 0; 
+   int ret;
+   TranscriptInfo trInfo;
+
+   // {{{ Read transcriptInfo and .prob file 
+   if((!args.isSet("trInfoFileName"))||(!trInfo.readInfo(args.getS("trInfoFileName")))){
+      if(args.isSet("samples") && (args.getL("samples")>0) && (args.getS("outputType") == "rpkm")){
+         error("Main: Missing transcript info file. The file is necessary for producing RPKM samples.\n");
          return 1;
       }
+   }else{
+      M = trInfo.getM()+1;
+   }
+   // }}}
+   if(args.flag("incremental") && (!args.isSet("initFile"))){
+      error("Main: Incremental mode needs the previous result (--init).\n");
+      return 1;
+   }
+   if(args.flag("svi")){
+      if(args.isSet("initFile"))warning("Main: Initialisation (--init) is not used in stochastic VB mode.\n");
+      if(args.flag("saveAlignmentProbs"))warning("Main: Alignment probabilities are not saved in stochastic VB mode.\n");
+   }
+   if(args.isSet("distAddress")){
+      if(args.flag("batch") || args.flag("svi")){
+         error("Main: Distributed mode can not be combined with batch or stochastic VB mode.\n");
+         return 1;
+      }
+      if(args.flag("saveAlignmentProbs"))warning("Main: Alignment probabilities are not saved in distributed mode.\n");
+   }
+   ns_threads::setThreads(args.getL("procN"), args.verbose);
+   if(args.getLowerS("pinThreads") != "none"){
+      if(args.flag("batch")){
+         warning("Main: Threads are not pinned in batch mode.\n");
+      }else{
+         ns_threads::pinThreads(args.getLowerS("pinThreads"), args.verbose);
+      }
    }
+   if(args.flag("batch")){
+      if(args.isSet("initFile"))warning("Main: Initialisation (--init) is used for all samples of the batch.\n");
+      ret = estimateBatch(args, optM, M, trInfo);
+   }else
+      ret = estimateSample(args, args.args()[0], args.getS("outFilePrefix"), optM, M, trInfo, timer);
+   if(ret != 0)return ret;
    if(args.verbose){message("DONE. "); timer.split(2,'m');}
    return 0;
 }//}}}
@@ -10,6 +10,7 @@
 
 using namespace std;
 
+#include "GzStream.h"
 #include "PosteriorSamples.h"
 #include "ArgumentParser.h"
 #include "common.h"
@@ -93,7 +94,7 @@ int main(int argc,char* argv[]){
    if(args.verbose)cout<<"C: "<<C<<" samples: "<<N<<"\ntranscripts: "<<M<<"\nselected: "<<S<<endl;
    
    // Open output file and write header
-   ofstream outFile(args.getS("outFileName").c_str());
+   OGzStream outFile(args.getS("outFileName").c_str());
    if(! outFile.is_open()){
       cerr<<"ERROR: Main: File write failed!"<<endl;
       return 1;
@@ -0,0 +1,274 @@
+#include<cmath>
+#include<cstdio>
+#include<cstdlib>
+#include<cstring>
+#include<limits>
+#include<stdint.h>
+#include<string>
+
+using namespace std;
+
+#include "fastFloat.h"
+
+namespace ns_fastFloat {
+
+// Powers of ten which are exactly representable as double.
+static const double exactPow10[] = {
+   1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+   1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+   1e21, 1e22};
+const long maxExactPow10 = 22;
+// Largest integer for which all smaller integers are exact in double (2^53).
+const uint64_t maxExactMantissa = ((uint64_t)1) << 53;
+const long maxMantissaDigits = 19;
+
+// Powers of ten in long double used for formatting, pow10L[i] = 10^(i-pow10LOffset).
+// The range covers all (sub)normal doubles and precisions up to maxFastPrecision.
+const long pow10LOffset = 350;
+static long double pow10L[2 * pow10LOffset + 1];
+static bool initPow10L(){//{{{
+   for(long i = 0; i <= 2 * pow10LOffset; i++)
+      pow10L[i] = powl(10.0L, (long double)(i - pow10LOffset));
+   return true;
+}//}}}
+static const bool pow10LReady = initPow10L();
+// Largest number of significant digits for which the long double fast path is used.
+const long maxFastDigits = 13;
+// The fast path needs the 64-bit mantissa of x87 extended precision (the
+// scaling error has to stay far below the rounding margin and the powers of ten
+// must not underflow); where long double is just double (MSVC, arm64 macOS),
+// all values are formatted by snprintf.
+const bool useFastFormat = numeric_limits<long double>::digits >= 64;
+
+inline bool isSpace(char c){//{{{
+   return (c==' ') || (c=='\t') || (c=='\n') || (c=='\r') || (c=='\v') || (c=='\f');
+}//}}}
+inline char lowerC(char c){//{{{
+   if((c>='A') && (c<='Z')) return c - 'A' + 'a';
+   return c;
+}//}}}
+// Check whether [str,end) starts with lower-case word w (case insensitive).
+bool startsWith(const char *str, const char *end, const char *w){//{{{
+   for(;*w;w++,str++){
+      if((str>=end) || (lowerC(*str) != *w)) return false;
+   }
+   return true;
+}//}}}
+
+const char *skipSpace(const char *str, const char *end){//{{{
+   while((str<end) && isSpace(*str))str++;
+   return str;
+}//}}}
+const char *skipWord(const char *str, const char *end){//{{{
+   while((str<end) && (!isSpace(*str)))str++;
+   return str;
+}//}}}
+
+const char *parseDouble(const char *str, const char *end, double *val){//{{{
+   *val = 0;
+   str = skipSpace(str, end);
+   if(str >= end) return NULL;
+   const char *start = str;
+   bool negative = false;
+   if((*str == '-') || (*str == '+')){
+      negative = (*str == '-');
+      str++;
+   }
+   // Special values.
+   if((str<end) && ((lowerC(*str) == 'i') || (lowerC(*str) == 'n'))){
+      if(startsWith(str, end, "infinity")){
+         *val = negative ? -numeric_limits<double>::infinity() : numeric_limits<double>::infinity();
+         return str + 8;
+      }
+      if(startsWith(str, end, "inf")){
+         *val = negative ? -numeric_limits<double>::infinity() : numeric_limits<double>::infinity();
+         return str + 3;
+      }
+      if(startsWith(str, end, "nan")){
+         *val = numeric_limits<double>::quiet_NaN();
+         return str + 3;
+      }
+      return NULL;
+   }
+   uint64_t mantissa = 0;
+   long digitsN = 0, exp10 = 0, expPart = 0;
+   bool anyDigits = false, expNegative = false;
+   // Skip leading zeros, they are not significant.
+   while((str<end) && (*str == '0')){ str++; anyDigits = true; }
+   // Integer part.
+   for(;(str<end) && (*str>='0') && (*str<='9'); str++){
+      anyDigits = true;
+      if(digitsN < maxMantissaDigits){
+         mantissa = mantissa * 10 + (*str - '0');
+         if(mantissa != 0) digitsN++;
+      }else{
+         // Digits that do not fit only increase the exponent.
+         exp10++;
+         digitsN++;
+      }
+   }
+   // Fraction part.
+   if((str<end) && (*str == '.')){
+      str++;
+      for(;(str<end) && (*str>='0') && (*str<='9'); str++){
+         anyDigits = true;
+         if(digitsN < maxMantissaDigits){
+            mantissa = mantissa * 10 + (*str - '0');
+            if(mantissa != 0) digitsN++;
+            exp10--;
+         }else{
+            digitsN++;
+         }
+      }
+   }
+   if(!anyDigits) return NULL;
+   // Exponent part.
+   if((str<end) && ((*str == 'e') || (*str == 'E'))){
+      const char *expStart = str;
+      str++;
+      if((str<end) && ((*str == '-') || (*str == '+'))){
+         expNegative = (*str == '-');
+         str++;
+      }
+      if((str<end) && (*str>='0') && (*str<='9')){
+         for(;(str<end) && (*str>='0') && (*str<='9'); str++){
+            // Stop accumulating very large exponents, the value over/under-flows anyway.
+            if(expPart < 100000) expPart = expPart * 10 + (*str - '0');
+         }
+         exp10 += expNegative ? -expPart : expPart;
+      }else{
+         // Not an exponent, e.g. "1e" should be parsed as "1".
+         str = expStart;
+      }
+   }
+   if((digitsN <= maxMantissaDigits) && (mantissa <= maxExactMantissa) &&
+      (exp10 >= -maxExactPow10) && (exp10 <= maxExactPow10)){
+      // Both mantissa and power of ten are exact, so single multiplication
+      // or division is rounded correctly.
+      if(exp10 < 0) *val = (double)mantissa / exactPow10[-exp10];
+      else *val = (double)mantissa * exactPow10[exp10];
+      if(negative) *val = -*val;
+      return str;
+   }
+   if(mantissa == 0){
+      *val = negative ? -0.0 : 0.0;
+      return str;
+   }
+   // Slow path: let strtod deal with rounding.
+   string token(start, str - start);
+   *val = strtod(token.c_str(), NULL);
+   return str;
+}//}}}
+
+// Compute digitsN significant digits of positive finite a rounded to nearest
+// and the decimal exponent of the first digit, so that a ~ digits*10^(exp10-digitsN+1).
+// Returns false if a is too close to half-way between two representations and
+// the rounding has to be decided exactly.
+static bool decimalDigits(double a, long digitsN, uint64_t *digits, long *exp10){//{{{
+   int exp2;
+   frexp(a, &exp2);
+   // a is in [2^(exp2-1), 2^exp2), so this is floor(log10(a)) or one less.
+   long e = (long)floor((exp2 - 1) * 0.30102999566398120);
+   const long double low = pow10L[pow10LOffset + digitsN - 1];
+   const long double high = pow10L[pow10LOffset + digitsN];
+   long double s = (long double)a * pow10L[pow10LOffset + digitsN - 1 - e];
+   if(s >= high){
+      e++;
+      s = (long double)a * pow10L[pow10LOffset + digitsN - 1 - e];
+   }else if(s < low){
+      e--;
+      s = (long double)a * pow10L[pow10LOffset + digitsN - 1 - e];
+   }
+   long double intPart = floorl(s);
+   long double frac = s - intPart;
+   // The scaling is precise to few units in the last place of long double,
+   // leave generous margin around the half-way point.
+   if(fabsl(frac - 0.5L) < high * 1e-16L) return false;
+   uint64_t m = (uint64_t)intPart;
+   if(frac > 0.5L) m++;
+   if((long double)m >= high){
+      // Rounded up to the next power of ten.
+      m /= 10;
+      e++;
+   }
+   *digits = m;
+   *exp10 = e;
+   return true;
+}//}}}
+
+static char *writeExponent(char *p, long e){//{{{
+   *p++ = 'e';
+   if(e < 0){
+      *p++ = '-';
+      e = -e;
+   }else *p++ = '+';
+   if(e >= 100){
+      *p++ = '0' + e / 100;
+      e %= 100;
+   }
+   *p++ = '0' + e / 10;
+   *p++ = '0' + e % 10;
+   return p;
+}//}}}
+
+// Remove trailing zeros of the fraction part (and the decimal point itself),
+// as is done by %g.
+static char *stripZeros(char *p, char *point){//{{{
+   while((p > point + 1) && (*(p-1) == '0')) p--;
+   if(p == point + 1) p--;
+   return p;
+}//}}}
+
+long formatDouble(double val, long precision, bool scientific, char *buffer){//{{{
+   if(precision < 0) precision = 6;
+   if((!scientific) && (precision == 0)) precision = 1;
+   long digitsN = scientific ? precision + 1 : precision;
+   uint64_t m = 0;
+   long e = 0;
+   bool zero = (val == 0);
+   if((!useFastFormat) || ((!zero) && (!isfinite(val))) || (digitsN > maxFastDigits) ||
+      ((!zero) && (!decimalDigits(fabs(val), digitsN, &m, &e)))){
+      return snprintf(buffer, precision + 32, scientific ? "%.*e" : "%.*g", (int)precision, val);
+   }
+   char digits[maxFastDigits];
+   if(zero){
+      for(long i = 0; i < digitsN; i++) digits[i] = '0';
+   }else{
+      for(long i = digitsN - 1; i >= 0; i--){
+         digits[i] = '0' + m % 10;
+         m /= 10;
+      }
+   }
+   char *p = buffer;
+   if(signbit(val)) *p++ = '-';
+   if(zero && (!scientific)){
+      *p++ = '0';
+   }else if(scientific || (e < -4) || (e >= precision)){
+      *p++ = digits[0];
+      char *point = p;
+      if(digitsN > 1){
+         *p++ = '.';
+         for(long i = 1; i < digitsN; i++) *p++ = digits[i];
+         if(!scientific) p = stripZeros(p, point);
+      }
+      p = writeExponent(p, e);
+   }else if(e >= 0){
+      long i;
+      for(i = 0; i <= e; i++) *p++ = digits[i];
+      char *point = p;
+      *p++ = '.';
+      for(; i < digitsN; i++) *p++ = digits[i];
+      p = stripZeros(p, point);
+   }else{
+      *p++ = '0';
+      char *point = p;
+      *p++ = '.';
+      for(long i = -1; i > e; i--) *p++ = '0';
+      for(long i = 0; i < digitsN; i++) *p++ = digits[i];
+      p = stripZeros(p, point);
+   }
+   *p = '\0';
+   return p - buffer;
+}//}}}
+
+} // namespace ns_fastFloat
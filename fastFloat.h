@@ -0,0 +1,36 @@
+#ifndef FASTFLOAT_H
+#define FASTFLOAT_H
+
+namespace ns_fastFloat {
+
+// Parse floating point number starting at str, reading at most up to end.
+// Leading white space (including new lines) is skipped. Values inf, -inf and
+// nan are recognized in any case.
+// Returns pointer to the first character after the number, or NULL if there
+// was no valid number (val is then set to 0).
+// The parsing does not depend on locale. Numbers with up to 15 significant
+// digits and small exponents (all values written by BitSeq) are converted
+// exactly using fast path, other values are handed over to strtod.
+const char *parseDouble(const char *str, const char *end, double *val);
+
+// Write val into buffer in the same way as printf() with format "%.<precision>e"
+// (scientific == true) or "%.<precision>g" (C++ stream default), so that the
+// output is identical to ofstream output. The buffer has to be able to hold at
+// least precision+32 characters; the string is zero terminated and its length
+// is returned.
+// Most values are converted using integer arithmetic, only values which are
+// (almost) exactly half-way between two decimal representations and
+// non-finite values are handed over to snprintf (all values on platforms
+// without extended precision long double).
+long formatDouble(double val, long precision, bool scientific, char *buffer);
+
+// Skip white space, return pointer to first non-space character or end.
+const char *skipSpace(const char *str, const char *end);
+
+// Skip word (non-space characters), return pointer to first space character
+// or end.
+const char *skipWord(const char *str, const char *end);
+
+} // namespace ns_fastFloat
+
+#endif
@@ -9,6 +9,7 @@
 
 using namespace std;
 
+#include "GzStream.h"
 #include "PosteriorSamples.h"
 #include "ArgumentParser.h"
 #include "common.h"
@@ -49,7 +50,7 @@ int main(int argc,char* argv[]){
    }//}}}
    if(args.verbose)cout<<"Samples: "<<N<<" transcripts: "<<M<<endl;
    
-   ofstream outFile(args.getS("outFileName").c_str());
+   OGzStream outFile(args.getS("outFileName").c_str());
    if(! outFile.is_open()){
       cerr<<"ERROR: Main: File write failed!"<<endl;
       return 0;
@@ -55,7 +55,7 @@ extern "C" int getGeneExpression(int *argc,char* argv[]){
       }
    }
 
-   ofstream outFile;
+   OGzStream outFile;
    if(!ns_misc::openOutput(args, &outFile))return 1;;
    // Write ouput header {{{
    outFile<<"# from: "<<args.args()[0]<<"\n# samples of gene expression\n";
@@ -35,7 +35,7 @@ int main(int argc,char* argv[]){
    if(! args.isSet("selectFileName")){
       getAll=true;
    }else{
-      ifstream selectF (args.getS("selectFileName").c_str());
+      IGzStream selectF (args.getS("selectFileName").c_str());
       if(! selectF.is_open()){
          cerr<<"ERROR: Main: Failed loading selected transcripts."<<endl;
          return 1;
@@ -62,7 +62,7 @@ int main(int argc,char* argv[]){
       if(args.verbose)cout<<"Will use logged values."<<endl;
    }
    if(args.verbose)cout<<"M "<<M<<"   N "<<N<<endl;
-   ofstream outFile(args.getS("outFileName").c_str());
+   OGzStream outFile(args.getS("outFileName").c_str());
    if(! outFile.is_open()){
       cerr<<"ERROR: Main: File write probably failed!"<<endl;
       return 1;
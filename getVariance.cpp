@@ -65,7 +65,7 @@ extern "C" int getVariance(int *argc,char* argv[]){
    }//}}}
    if(args.verbose)message("replicates: %ld samples: %ld transcripts: %ld\n",RN,N,M);
    
-   ofstream outFile(args.getS("outFileName").c_str());
+   OGzStream outFile(args.getS("outFileName").c_str());
    if(! outFile.is_open()){
       error("Main: File write failed!\n");
       return 1;
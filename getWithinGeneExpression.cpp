@@ -29,7 +29,7 @@ void getSum(long gM, long N, const vector< vector<double> > &trs, vector<double>
 void updateSummaries(double x, long double *mean, long double *sqSum, double norm = 1, bool doLog = false);
 
 // Append samples of a transcript into output file.
-void writeTr(long N, const vector<double> &tr, ofstream *outFile);
+void writeTr(long N, const vector<double> &tr, OGzStream *outFile);
 
 } // namespace ns_withinGene
 
@@ -74,7 +74,7 @@ extern "C" int getWithinGeneExpression(int *argc,char* argv[]){
       }
    }
 
-   ofstream outFile,sumFile;
+   OGzStream outFile,sumFile;
    if(doOut){
       if(!ns_misc::openOutput(args, &outFile))return 1;;
       // Write output header {{{
@@ -238,7 +238,7 @@ void updateSummaries(double x, long double *mean, long double *sqSum, double nor
    *sqSum += x*x;
 }// }}}
 
-void writeTr(long N, const vector<double> &tr, ofstream *outFile){//{{{
+void writeTr(long N, const vector<double> &tr, OGzStream *outFile){//{{{
    for(long n=0; n<N-1; n++)
       (*outFile)<<tr[n]<<" ";
    (*outFile)<<tr[N-1]<<endl;
@@ -9,6 +9,7 @@
 #include <set>
 #include <stdexcept>
 #include <sstream>
+#include <zlib.h>
 #include "ArgumentParser.h"
 #include "common.h"
 
@@ -46,47 +47,33 @@ inline std::string dequote(std::string orig) {
     return orig;
 }
 
+// Reads plain or gzip compressed files (using zlib, no external gunzip).
 class FileHandle {
-  std::FILE *fp;
-  bool ispipe;
+  gzFile fp;
   bool isopen;
 public:
-  FileHandle() : fp(0), ispipe(false), isopen(false) { }
+  FileHandle() : fp(0), isopen(false) { }
 
   FileHandle(std::string name)
   {
-    if (name.substr(name.length()-3, 3).compare(".gz") == 0) {
-      std::string tmp;
-
-      tmp = "gunzip -c '";
-      tmp += name;
-      tmp += "'";
-      ispipe = true;
-      fp = popen(tmp.c_str(), "r");
-      if (!fp)
-	throw std::runtime_error("popen failed on " + tmp);
-      isopen = true;
-    } else {
-      ispipe = false;
-      fp = fopen(name.c_str(), "r");
-      if (!fp)
-	throw std::runtime_error("error opening file " + name);
-      isopen = true;
-    }
+    fp = gzopen(name.c_str(), "rb");
+    if (!fp)
+      throw std::runtime_error("error opening file " + name);
+#if ZLIB_VERNUM >= 0x1240
+    gzbuffer(fp, 1 << 17);
+#endif
+    isopen = true;
   }
 
   char *fgets(char * str, int size)
   {
-    return std::fgets(str, size, fp);
+    return gzgets(fp, str, size);
   }
 
   void close()
   {
     if (isopen) {
-      if (ispipe)
-	pclose(fp);
-      else
-	fclose(fp);
+      gzclose(fp);
       isopen = false;
     }
   }
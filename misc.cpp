@@ -7,6 +7,7 @@
 #include "FileHeader.h"
 
 #include "common.h"
+#include "VecMath.h"
 
 namespace ns_math {
 double logAddExp(double a, double b){ //{{{
@@ -20,10 +21,8 @@ double logSumExp(const vector<double> &vals, long st, long en){ //{{{
    if(st<0)st = 0;
    if((en == -1) || (en > (long)vals.size())) en = vals.size();
    if(st >= en)return 0;
-   double sumE = 0, m = *max_element(vals.begin() + st,vals.begin() + en);
-   for(long i = st; i < en; i++)
-      sumE += exp(vals[i] - m);
-   return  m + log(sumE);
+   double m = *max_element(vals.begin() + st,vals.begin() + en);
+   return  m + log(ns_vecMath::expSum(&vals[st], en - st, m));
 } //}}}
 } // namespace ns_math
 
@@ -47,7 +46,7 @@ long getSeed(const ArgumentParser &args){//{{{
    if(args.verbose)message("seed: %ld\n",seed);
    return seed;
 }//}}}
-bool openOutput(const ArgumentParser &args, ofstream *outF){//{{{
+bool openOutput(const ArgumentParser &args, OGzStream *outF){//{{{
    outF->open(args.getS("outFileName").c_str());
    if(!outF->is_open()){
       error("Main: Output file open failed.\n");
@@ -55,7 +54,7 @@ bool openOutput(const ArgumentParser &args, ofstream *outF){//{{{
    }
    return true;
 }//}}}
-bool openOutput(const string &name, ofstream *outF) {//{{{
+bool openOutput(const string &name, OGzStream *outF) {//{{{
    outF->open(name.c_str());
    if(!outF->is_open()){
       error("Main: File '%s' open failed.\n",name.c_str());
@@ -147,7 +146,7 @@ bool updateGenes(const ArgumentParser &args, TranscriptInfo *trInfo, long *G){//
       return false;
    }
    bool isMap;
-   ifstream mapFile;
+   IGzStream mapFile;
    if(args.isSet("trMapFile")){
       isMap = true;
       mapFile.open(args.getS("trMapFile").c_str());
@@ -210,9 +209,9 @@ bool checkGeneCount(long G, long M){//{{{
 } // namespace ns_genes
 
 namespace ns_params {
-bool readParams(const string &name, vector<paramT> *params, ofstream *outF){//{{{
+bool readParams(const string &name, vector<paramT> *params, ostream *outF){//{{{
    long parN;
-   ifstream parFile(name.c_str());
+   IGzStream parFile(name.c_str());
    FileHeader fh(&parFile);
    if(!fh.paramsHeader(&parN, outF)){
       error("Main: Problem loading parameters file %s\n",name.c_str());
@@ -4,6 +4,7 @@
 #include<fstream>
 
 #include "ArgumentParser.h"
+#include "GzStream.h"
 #include "PosteriorSamples.h"
 #include "TranscriptInfo.h"
 
@@ -32,9 +33,9 @@ const double LOG_ZERO=-100;
 long getSeed(const ArgumentParser &args);
 
 // Open output file based on standard argument --outFile=<outFileName>.
-bool openOutput(const ArgumentParser &args, ofstream *outF);
+bool openOutput(const ArgumentParser &args, OGzStream *outF);
 // Open output file of a give name.
-bool openOutput(const string &name, ofstream *outF);
+bool openOutput(const string &name, OGzStream *outF);
 
 // Reads and initializes files containing samples fro each condition and each replicate.
 bool readConditions(const ArgumentParser &args, long *C, long *M, long *N, Conditions *cond);
@@ -78,7 +79,7 @@ struct paramT {//{{{
 // Read hyperparameters from a file specified by file name.
 // If outF is not NULL, it copies header from input file to outF.
 // The vector is sorted by expression at the end.
-bool readParams(const string &name, vector<paramT> *params, ofstream *outF = NULL);
+bool readParams(const string &name, vector<paramT> *params, ostream *outF = NULL);
 
 }
 #endif
@@ -1,13 +1,26 @@
 // DECLARATIONS: {{{
 #include<cmath>
+#include<csignal>
+#include<cstdio>
+#include<cstdlib>
+#include<cstring>
+#include<fstream>
 #include<set>
+#include<unistd.h>
+#ifdef _OPENMP
+#include<omp.h>
+#endif
+#include "boost/random/mersenne_twister.hpp"
+#include "boost/random/uniform_01.hpp"
 
 using namespace std;
 
 #include "ArgumentParser.h"
+#include "AsyncWriter.h"
 #include "misc.h"
 #include "MyTimer.h"
 #include "ReadDistribution.h"
+#include "Threads.h"
 #include "TranscriptExpression.h"
 #include "TranscriptInfo.h"
 #include "TranscriptSequence.h"
@@ -37,6 +50,114 @@ class TagAlignment{//{{{
       void setProb(double p){prob=p;}
 }; //}}}
 
+// Number of reads processed together when computing probabilities.
+const long READ_BATCH = 4096;
+
+// Result of ReadDistribution::computeP() for one alignment.
+struct alignmentProbT{//{{{
+   double prob,probNoise;
+   ns_rD::probStatusT status;
+   bool firstMateDown;
+}; //}}}
+
+// Alignments of one read used for computing probabilities.
+struct readRecordT{//{{{
+   string name,mateName;
+   // Some alignments were invalid (mates' names did not match).
+   bool invalid;
+   vector<ns_rD::fragmentRecordT> frags;
+   // Probabilities of frags computed by computeProbs().
+   vector<alignmentProbT> probs;
+   readRecordT(){ invalid = false; }
+   void clear(){
+      name.clear();
+      mateName.clear();
+      invalid = false;
+      frags.clear();
+      probs.clear();
+   }
+}; //}}}
+
+// Passes uniquely aligned fragments to ReadDistribution for estimation.
+// With parallel set, fragments are observed in batches by thread-local
+// accumulators. Either only a random sample of sampleN fragments is observed
+// (reservoir sampling), or with tolerance > 0 observing stops once the profile
+// of read distribution changes less than tolerance between checkpoints after
+// every checkN fragments.
+class FragmentObserver{//{{{
+   private:
+      ReadDistribution *readD;
+      vector<ReadDistribution> accs;
+      // Batch of fragments to be observed or the sample.
+      vector<ns_rD::fragmentP> frags;
+      long fragsN, sampleN, checkN, nextCheck, seenN, observedN;
+      double tolerance;
+      bool converged;
+      vector<double> profile;
+      boost::random::mt11213b rng_mt;
+      boost::random::uniform_01<double> uniformDistribution;
+
+      // Not copyable.
+      FragmentObserver(const FragmentObserver &);
+      FragmentObserver& operator=(const FragmentObserver &);
+
+      ns_rD::fragmentP slot(long i);
+      void observeStored();
+      void mergeAccumulators();
+   public:
+      FragmentObserver(ReadDistribution *readD, bool parallel, long sampleN, double tolerance, long checkN, long seed);
+      ~FragmentObserver();
+      // Observe or sample fragment, fragments are ignored after convergence.
+      void add(const ns_rD::fragmentP frag);
+      bool hasConverged() const { return converged; }
+      long seen() const { return seenN; }
+      // Observe remaining fragments and merge accumulators into readD.
+      // Returns number of fragments used for estimation.
+      long finish();
+}; //}}}
+
+// Removes temporary file when it goes out of scope (on every return from
+// main) and also on exit(), abort() (samtools aborts on SAM parse errors)
+// and SIGINT/SIGTERM. Only one file can be set at a time.
+class FileRemover{//{{{
+   private:
+      // Not copyable.
+      FileRemover(const FileRemover &);
+      FileRemover& operator=(const FileRemover &);
+   public:
+      FileRemover(){}
+      ~FileRemover();
+      void set(const string &name);
+}; //}}}
+
+// Counters of reads and alignments written into output.
+struct alignmentCountsT{//{{{
+   long pairedN, singleN, firstN, secondN, weirdN, invalidN, noN;
+   alignmentCountsT(){
+      pairedN = singleN = firstN = secondN = weirdN = invalidN = noN = 0;
+   }
+   long alignmentsN() const { return pairedN + singleN + firstN + secondN + weirdN; }
+}; //}}}
+
+// Observe fragments in parallel, thread i uses accumulator (*accs)[i].
+// Fragments are modified (mates can be swapped).
+// Returns number of fragments which were used.
+long observeFragments(const vector<ns_rD::fragmentP> &frags, long fragsN, vector<ReadDistribution> *accs);
+// Compute probabilities of read's alignments (can be called from multiple threads).
+void computeProbs(ReadDistribution &readD, readRecordT *read);
+// Write read's alignments with probabilities computed by computeProbs() into
+// output and update warnings of readD; reads have to be written in order.
+// Names of reads with no valid alignments are added to failedReads (if not NULL).
+void writeRead(ReadDistribution &readD, const readRecordT &read, AsyncWriter &outF, set<string> *failedReads, alignmentCountsT *counts);
+
+// Store read's alignments in temporary file (single pass mode) and read them back.
+bool writeSpill(ofstream &spillF, const readRecordT &read);
+bool readSpill(ifstream &spillF, readRecordT *read);
+// Header of temporary file with the number of stored reads (rewritten when
+// all reads are stored), reading fails for another format version.
+void writeSpillHeader(ofstream &spillF, int64_t readsN);
+bool readSpillHeader(ifstream &spillF, int64_t *readsN);
+
 // Check if next fragment is different.
 bool nextFragDiffers(const ns_rD::fragmentP curF, const ns_rD::fragmentP nextF, bool mateNamesDiffer);
 // String comparison allowing last cmpEPS bases different as long as length
@@ -46,12 +167,19 @@ long readNameCmp(const char *str1, const char *str2);
 // Copies data from 'next' fragment into 'cur' fragment and reads new fragment information into 'next'.
 // Fragment is either both paired-ends or just single read.
 bool readNextFragment(samfile_t* samData, ns_rD::fragmentP &cur, ns_rD::fragmentP &next);
+// Read alignments of next read which are used for computing probabilities.
+// Reads in ignoredReads are skipped and counted in skippedN. Mismatches of
+// mates' names are counted in nameMismatchN, reading stops after 10.
+// Returns false at the end of file.
+bool readNextRead(samfile_t *samData, ns_rD::fragmentP &cur, ns_rD::fragmentP &next, const ArgumentParser &args, const ReadDistribution &readD, const set<string> &ignoredReads, readRecordT *read, long *skippedN, long *nameMismatchN);
 
 // Determine input format base either on --format flag or on the file extension.
 // Sets format to bam/sam and returns true, or returns false if format is unknown.
 bool setInputFormat(const ArgumentParser &args, string *format);
 
-bool openSamFile(const string &name, const string &inFormat, samfile_t **samFile);
+// Open alignment file, BAM input is decompressed by readThreadsN threads
+// (in the calling thread if 0).
+bool openSamFile(const string &name, const string &inFormat, samfile_t **samFile, long readThreadsN = 0);
 
 bool initializeInfoFile(const ArgumentParser &args, samfile_t *samFile, TranscriptInfo **trInfo, long *M);
 } // namespace ns_parseAlignment
@@ -90,7 +218,9 @@ string programDescription =
    args.addOptionD("","lenMu","lenMu",0,"Set mean of log fragment length distribution. (l_frag ~ LogNormal(mu,sigma^2))");
    args.addOptionD("","lenSigma","lenSigma",0,"Set sigma^2 (or variance) of log fragment length distribution. (l_frag ~ LogNormal(mu,sigma^2))");
    args.addOptionS("","distributionFile","distributionFileName",0,"Name of file to which read-distribution should be saved.");
-   args.addOptionL("P","procN","procN",0,"Maximum number of threads to be used. This provides speedup mostly when using non-uniform read distribution model (i.e. no --uniform flag).",4);
+   args.addOptionS("","saveModel","saveModelFileName",0,"Save estimated read distribution and effective lengths into binary file, which can be used with --loadModel for other runs with the same transcripts.");
+   args.addOptionS("","loadModel","loadModelFileName",0,"Load read distribution saved with --saveModel instead of estimating it (options --uniform, --unstranded, --lenMu, --lenSigma and --expressionFile are ignored).");
+   args.addOptionL("P","procN","procN",0,"Maximum number of threads to be used. This provides speedup mostly when using non-uniform read distribution model (i.e. no --uniform flag) and for decompression of BAM input (which uses a quarter of the threads).",4);
    args.addOptionB("V","veryVerbose","veryVerbose",0,"Very verbose output.");
    args.addOptionL("","noiseMismatches","numNoiseMismatches",0,"Number of mismatches to be considered as noise.",ns_rD::LOW_PROB_MISSES);
    args.addOptionL("l","limitA","maxAlignments",0,"Limit maximum number of alignments per read. (Reads with more alignments are skipped.)");
@@ -98,13 +228,26 @@ string programDescription =
    args.addOptionB("","show1warning","show1warning",0,"Show first alignments that are considered wrong (TID unknown, TID mismatch, wrong strand).");
    args.addOptionB("","excludeSingletons","excludeSingletons",0,"Exclude single mate alignments for paired-end reads.");
    args.addOptionB("","mateNamesDiffer","mateNamesDiffer",0,"Mates from paired-end reads have different names.");
+   args.addOptionB("","singlePass","singlePass",0,"Read the alignment file only once. Alignments are stored in compact form in a temporary file while read distribution is estimated.");
+   args.addOptionS("","spillFile","spillFileName",0,"Temporary file for alignments used with --singlePass (default: <outFile>.spill).");
+   args.addOptionL("","observeSample","observeSample",0,"Estimate read distribution from random sample of at most <observeSample> uniquely aligned fragments.");
+   args.addOptionD("","observeTol","observeTol",0,"Stop estimating read distribution once its profile (bias and fragment length) changes less than <observeTol> between checkpoints.");
+   args.addOptionL("","observeCheck","observeCheck",0,"Number of fragments between checkpoints used with --observeTol.",1000000);
+   args.addOptionL("","seed","seed",0,"Random initialization seed (used with --observeSample).");
    if(!args.parse(*argc,argv))return 0;
    if(args.verbose)buildTime(argv[0],__DATE__,__TIME__);
-   readD.setProcN(args.getL("procN"));
    if(args.flag("show1warning"))readD.showFirstWarnings();
    // }}}
    if(!ns_parseAlignment::setInputFormat(args, &inFormat))return 1;
-   if(!ns_parseAlignment::openSamFile(args.args()[0], inFormat, &samData))return 1;
+   // BGZF blocks of BAM input are decompressed by threads running alongside
+   // the OpenMP threads, they get a quarter of the procN threads.
+   long readThreadsN = 0;
+   readD.setProcN(args.getL("procN"));
+   if((inFormat == "bam") && (ns_threads::threadsN() > 1)){
+      readThreadsN = max(1L, ns_threads::threadsN() / 4);
+      readD.setProcN(ns_threads::threadsN() - readThreadsN);
+   }
+   if(!ns_parseAlignment::openSamFile(args.args()[0], inFormat, &samData, readThreadsN))return 1;
    if(!ns_parseAlignment::initializeInfoFile(args, samData, &trInfo, &M))return 1;
    // Read expression and initialize transcript sequence {{{
    if(args.verbose)message("Initializing fasta sequence reader.\n");
@@ -164,20 +307,26 @@ string programDescription =
 
    // Estimating probabilities {{{
    bool analyzeReads = false;
+   bool loadedModel = args.isSet("loadModelFileName");
 
-   if(args.isSet("lenMu") && args.isSet("lenSigma")){
-      readD.setLength(args.getD("lenMu"),args.getD("lenSigma"));
+   if(loadedModel){
+      if(args.verbose)message("Loading read distribution from %s.\n",args.getS("loadModelFileName").c_str());
+      if(!readD.loadModel(args.getS("loadModelFileName"),trInfo,trSeq,args.flag("veryVerbose")))return 1;
    }else{
-      analyzeReads = true;
-   }
-   if(args.flag("uniform")){
-      if(args.verbose)message("Using uniform read distribution.\n");
-      readD.initUniform(M,trInfo,trSeq,args.flag("veryVerbose"));
-   }else{
-      if(args.verbose)message("Estimating non-uniform read distribution.\n");
-      readD.init(M,trInfo,trSeq,trExp,args.flag("unstranded"),args.flag("veryVerbose"));
-      if(args.flag("veryVerbose"))message(" ReadDistribution initialization done.\n");
-      analyzeReads = true;
+      if(args.isSet("lenMu") && args.isSet("lenSigma")){
+         readD.setLength(args.getD("lenMu"),args.getD("lenSigma"));
+      }else{
+         analyzeReads = true;
+      }
+      if(args.flag("uniform")){
+         if(args.verbose)message("Using uniform read distribution.\n");
+         readD.initUniform(M,trInfo,trSeq,args.flag("veryVerbose"));
+      }else{
+         if(args.verbose)message("Estimating non-uniform read distribution.\n");
+         readD.init(M,trInfo,trSeq,trExp,args.flag("unstranded"),args.flag("veryVerbose"));
+         if(args.flag("veryVerbose"))message(" ReadDistribution initialization done.\n");
+         analyzeReads = true;
+      }
    }
    if(args.isSet("numNoiseMismatches")){
       readD.setLowProbMismatches(args.getL("numNoiseMismatches"));
@@ -190,6 +339,40 @@ string programDescription =
    long maxAlignments = 0;
    if(args.isSet("maxAlignments") && (args.getL("maxAlignments")>0))
       maxAlignments = args.getL("maxAlignments");
+   // In single pass mode alignments are stored for computing probabilities later.
+   bool singlePass = args.flag("singlePass");
+   bool namesMatch;
+   ns_parseAlignment::readRecordT read;
+   string spillFileName = args.isSet("spillFileName") ? args.getS("spillFileName") : args.getS("outFileName")+".spill";
+   // Declared before the streams, so that they are closed before removing.
+   ns_parseAlignment::FileRemover spillRemover;
+   ofstream spillF;
+   long spilledN = 0;
+   if(singlePass){
+      spillF.open(spillFileName.c_str(), ios::binary | ios::trunc);
+      if(!spillF.is_open()){
+         error("Main: Unable to open temporary file %s.\n",spillFileName.c_str());
+         return 1;
+      }
+      spillRemover.set(spillFileName);
+      ns_parseAlignment::writeSpillHeader(spillF, 0);
+      if(args.verbose)message("Storing alignments in %s.\n",spillFileName.c_str());
+   }
+   // With more threads, fragments are observed in parallel (first warnings
+   // are shown only when observing serially).
+   long observeSample = 0, observeCheck = 1;
+   double observeTol = 0;
+   if(args.isSet("observeSample") && (args.getL("observeSample")>0))
+      observeSample = args.getL("observeSample");
+   if(args.isSet("observeTol") && (args.getD("observeTol")>0)){
+      if(observeSample>0){
+         warning("Main: --observeTol is not used with --observeSample.\n");
+      }else observeTol = args.getD("observeTol");
+   }
+   if(args.getL("observeCheck")>0)observeCheck = args.getL("observeCheck");
+   ns_parseAlignment::FragmentObserver observer(&readD,
+      analyzeReads && (ns_threads::threadsN() > 1) && (!args.flag("show1warning")),
+      observeSample, observeTol, observeCheck, (observeSample>0) ? ns_misc::getSeed(args) : 0);
    // start counting (and possibly estimating):
    observeN = pairedGA = firstGA = secondGA = singleGA = weirdGA = pairedBad = 0;
    RE_noEndInfo = RE_weirdPairdInfo = RE_nameMismatch = 0;
@@ -198,6 +381,7 @@ string programDescription =
       R_INTERUPT;
       if( !(curF->first->core.flag & BAM_FUNMAP) ){
          // (at least) The first read was mapped.
+         namesMatch = true;
          if( curF->paired ) {
             // Fragment's both reads are mapped as a pair.
             // Check mates' names.
@@ -205,6 +389,7 @@ string programDescription =
                (args.flag("mateNamesDiffer"))){
                pairedGA++;
             }else{
+               namesMatch = false;
                pairedBad++;
                if(RE_nameMismatch == 0){
                   warning("Paired read name mismatch: %s %s\n",bam1_qname(curF->first), bam1_qname(curF->second));
@@ -233,54 +418,77 @@ string programDescription =
             validAF->copyFragment(curF);
             storedValidA=true;
          }
+         if(singlePass){
+            // Same conditions as when computing probabilities from re-read alignments.
+            if(!namesMatch){
+               read.invalid = true;
+            }else if((!args.flag("excludeSingletons")) || curF->paired || (! (curF->first->core.flag & BAM_FPAIRED))){
+               read.frags.push_back(ns_rD::fragmentRecordT());
+               readD.getRecord(curF, &read.frags.back());
+            }
+         }
       }
       // Next fragment is different.
       if(ns_parseAlignment::nextFragDiffers(curF, nextF, args.flag("mateNamesDiffer"))){
          Ntotal++;
          allGA = singleGA + pairedGA + firstGA +secondGA+ weirdGA;
-         if( allGA == 0 ){ // No good alignment.
-            // Just in case:
-            storedValidA=false;
-            pairedBad = 0;
-            continue;
-         }
-         Nmap ++;
-         if(weirdGA)RE_noEndInfo++;
-         if((singleGA>0) && (pairedGA>0)) RE_weirdPairdInfo++;
-         // If it's good uniquely aligned fragment/read, add it to the observation.
-         if(( allGA == 1) && analyzeReads && (pairedBad == 0) && storedValidA){
-            if(readD.observed(validAF))observeN++;
-         }else if(maxAlignments && (allGA>maxAlignments)) {
-            // This read will be ignored.
-            ignoredReads.insert(bam1_qname(curF->first));
-            ignoredMaxAlignments++;
-            Nmap --;
-         }else if(args.flag("excludeSingletons") && (pairedGA + singleGA == 0)){
-            // When excluding singletons only alignments of full pair or single-end read count.
-            ignoredReads.insert(bam1_qname(curF->first));
-            ignoredSingletons++;
-            Nmap --;
+         bool ignored = false;
+         if( allGA > 0 ){
+            Nmap ++;
+            if(weirdGA)RE_noEndInfo++;
+            if((singleGA>0) && (pairedGA>0)) RE_weirdPairdInfo++;
+            // If it's good uniquely aligned fragment/read, add it to the observation.
+            if(( allGA == 1) && analyzeReads && (pairedBad == 0) && storedValidA){
+               observer.add(validAF);
+            }else if(maxAlignments && (allGA>maxAlignments)) {
+               // This read will be ignored.
+               ignored = true;
+               ignoredMaxAlignments++;
+               Nmap --;
+            }else if(args.flag("excludeSingletons") && (pairedGA + singleGA == 0)){
+               // When excluding singletons only alignments of full pair or single-end read count.
+               ignored = true;
+               ignoredSingletons++;
+               Nmap --;
+            }
+         } // else: No good alignment.
+         if(ignored && (!singlePass))ignoredReads.insert(bam1_qname(curF->first));
+         if(singlePass){
+            if(!ignored){
+               read.name = bam1_qname(curF->first);
+               if(curF->paired)read.mateName = bam1_qname(curF->second);
+               if(!ns_parseAlignment::writeSpill(spillF, read)){
+                  error("Main: Writing into temporary file %s failed.\n",spillFileName.c_str());
+                  return 1;
+               }
+               spilledN++;
+            }
+            read.clear();
          }
          pairedGA = firstGA = secondGA = singleGA = weirdGA = pairedBad = 0;
          storedValidA = false;
       }
    }
+   observeN = observer.finish();
    if(RE_nameMismatch>10){
       error("Names of paired mates didn't match at least 10 times.\n"
             "   Something is possibly wrong with your data or the reads have to be renamed.\n");
       return 1;
    }
    message("Reads: all(Ntotal): %ld  mapped(Nmap): %ld\n",Ntotal,Nmap);
-   if(args.verbose)message("  %ld reads were used to estimate empirical distributions.\n",observeN);
+   if(args.verbose && (!loadedModel))message("  %ld reads were used to estimate empirical distributions.\n",observeN);
+   if(args.verbose && observer.hasConverged())message("  Read distribution converged after %ld reads.\n",observer.seen());
    if(ignoredMaxAlignments>0)message("  %ld reads are skipped due to having more than %ld alignments.\n",ignoredMaxAlignments, maxAlignments);
    if(ignoredSingletons>0)message("  %ld reads skipped due to having just single mate alignments.\n",ignoredSingletons);
    if(RE_noEndInfo)warning("  %ld reads that were paired, but do not have \"end\" information.\n  (is your alignment file valid?)", RE_noEndInfo);
    if(RE_weirdPairdInfo)warning("  %ld reads that were reported as both paired and single end.\n  (is your alignment file valid?)", RE_weirdPairdInfo);
    readD.writeWarnings();
    if(args.flag("veryVerbose"))timer.split(0,'m');
-   // Normalize read distribution:
-   if(args.flag("veryVerbose"))message("Normalizing read distribution.\n");
-   readD.normalize();
+   // Normalize read distribution (loaded model is already normalized):
+   if(!loadedModel){
+      if(args.flag("veryVerbose"))message("Normalizing read distribution.\n");
+      readD.normalize();
+   }
    if(args.isSet("distributionFileName")){
       readD.logProfiles(args.getS("distributionFileName"));
    }
@@ -288,128 +496,113 @@ string programDescription =
    // }}}
 
    // Writing probabilities: {{{
-   // Re-opening alignment file 
-   if(!ns_parseAlignment::openSamFile(args.args()[0], inFormat, &samData))return 1;
+   ifstream spillInF;
+   if(singlePass){
+      // Reading stored alignments.
+      streamoff spillSize = spillF.tellp();
+      spillF.seekp(0);
+      ns_parseAlignment::writeSpillHeader(spillF, spilledN);
+      spillF.close();
+      if(spillF.fail()){
+         error("Main: Writing into temporary file %s failed.\n",spillFileName.c_str());
+         return 1;
+      }
+      spillInF.open(spillFileName.c_str(), ios::binary);
+      if(!spillInF.is_open()){
+         error("Main: Unable to open temporary file %s.\n",spillFileName.c_str());
+         return 1;
+      }
+      // Check size and number of reads before writing any output.
+      int64_t spillHeaderN = -1;
+      spillInF.seekg(0, ios::end);
+      bool spillOK = (spillInF.tellg() == spillSize);
+      spillInF.seekg(0);
+      if((!spillOK) || (!ns_parseAlignment::readSpillHeader(spillInF, &spillHeaderN)) || (spillHeaderN != spilledN)){
+         error("Main: Temporary file %s is incomplete or has another format.\n",spillFileName.c_str());
+         return 1;
+      }
+   }else{
+      // Re-opening alignment file 
+      if(!ns_parseAlignment::openSamFile(args.args()[0], inFormat, &samData, readThreadsN))return 1;
+   }
    if(args.verbose)message("Writing alignment probabilities.\n");
-   double prob,probNoise,minProb;
-   prob = probNoise = 0;
    set<string> failedReads;
-   vector<ns_parseAlignment::TagAlignment> alignments;
+   set<string> *failedReadsP = args.isSet("failed") ? &failedReads : NULL;
    // Open and initialize output file {{{
-   ofstream outF(args.getS("outFileName").c_str());
-   if(!outF.is_open()){
+   AsyncWriter outF;
+   if(!outF.open(args.getS("outFileName"))){
       error("Main: Unable to open output file.\n");
       return 1;
    }
-   outF<<"# Ntotal "<<Ntotal<<"\n# Nmap "<<Nmap<<"\n# M "<<M<<endl;
-   outF<<"# LOGFORMAT (probabilities saved on log scale.)\n# r_name num_alignments (tr_id prob )^*{num_alignments}"<<endl;
+   outF<<"# Ntotal "<<Ntotal<<"\n# Nmap "<<Nmap<<"\n# M "<<M<<"\n";
+   outF<<"# LOGFORMAT (probabilities saved on log scale.)\n# r_name num_alignments (tr_id prob )^*{num_alignments}\n";
    outF.precision(9);
-   outF<<scientific;
+   outF.scientific();
    // }}}
    
    // start reading:
    timer.start(1);
-   bool invalidAlignment = false;
-   long readC, pairedN, singleN, firstN, secondN, weirdN, invalidN, noN;
-   readC = pairedN = singleN = firstN = secondN = weirdN = invalidN = noN = 0;
+   long readC = 0;
+   ns_parseAlignment::alignmentCountsT counts;
    RE_nameMismatch = 0 ;
-   // fill in "next" fragment:
-   ns_parseAlignment::readNextFragment(samData, curF, nextF);
-   while(ns_parseAlignment::readNextFragment(samData,curF,nextF)){
+   // Reads are processed in batches by a pipeline: while the probabilities
+   // of one batch are computed by all threads, the master thread also reads
+   // next batch and writes previous batch (in the original order), so that
+   // messages are only printed by the master thread.
+   const long batchN = ns_parseAlignment::READ_BATCH;
+   vector<ns_parseAlignment::readRecordT> batches[3];
+   long batchSizes[3] = {0, 0, 0}, spillReadN = 0;
+   long readB = 0, computeB = 2, writeB = 1, r;
+   bool moreReads = true;
+   for(i=0;i<3;i++)batches[i].resize(batchN);
+   if(singlePass){
+      // Ignored reads were not stored.
+      readC = ignoredMaxAlignments + ignoredSingletons;
+   }else{
+      // fill in "next" fragment:
+      ns_parseAlignment::readNextFragment(samData, curF, nextF);
+   }
+   do{
       R_INTERUPT;
-      // Skip all alignments of this read.
-      if(ignoredReads.count(bam1_qname(curF->first))>0){
-         DEBUG_AT(" ignore\n");
-         // Read reads while the name is the same.
-         while(ns_parseAlignment::readNextFragment(samData,curF,nextF)){
-            DEBUG_AT(" ignore\n");
-            if(ns_parseAlignment::nextFragDiffers(curF, nextF, args.flag("mateNamesDiffer")))
-               break;
-         }
-         readC++;
-         if(args.verbose){ if(progressLog(readC,Ntotal,10,' '))timer.split(1,'m');}
-         continue;
-      }
-      if( !(curF->first->core.flag & BAM_FUNMAP) ){
-         DEBUG_AT("M");
-         // (at least) The first read was mapped.
-         // Check mates' names.
-         if(curF->paired && (ns_parseAlignment::readNameCmp(bam1_qname(curF->first), bam1_qname(curF->second))!=0) && (!args.flag("mateNamesDiffer"))){
-            if(RE_nameMismatch == 0){
-               warning("Paired read name mismatch: %s %s\n",bam1_qname(curF->first), bam1_qname(curF->second));
-            }
-            RE_nameMismatch++;
-            if(RE_nameMismatch>10)break;
-            invalidAlignment = true;
-         }else if((!args.flag("excludeSingletons")) || curF->paired || (! (curF->first->core.flag & BAM_FPAIRED))){
-            // We only calculate probabilties and add alignments if: 
-            // (singletons are not exlucded) OR  (it is a proper paired alignments) OR (it is single-end read)
-            if(readD.getP(curF, prob, probNoise)){
-               // We calculated valid probabilities for this alignment.   
-               // Add alignment:
-               alignments.push_back(ns_parseAlignment::TagAlignment(curF->first->core.tid+1, prob, probNoise));
-               // Update counters:
-               if( curF->paired ) {
-                  // Fragment's both reads are mapped as a pair.
-                  pairedN++;
-                  DEBUG_AT(" P\n");
-               }else {
-                  if (curF->first->core.flag & BAM_FPAIRED) {
-                     // Read was part of pair (meaning that the other is unmapped).
-                     if (curF->first->core.flag & BAM_FREAD1) {
-                        firstN++;
-                        DEBUG_AT(" 1\n");
-                     } else if (curF->first->core.flag & BAM_FREAD2) {
-                        secondN++;
-                        DEBUG_AT(" 2\n");
-                     } else {
-                        weirdN ++;
-                        DEBUG_AT(" W\n");
-                     }
-                  } else {
-                     // Read is single end, with valid alignment.
-                     singleN++;
-                     DEBUG_AT(" S\n");
-                  }
+      #pragma omp parallel private(r)
+      {
+         #pragma omp master
+         {
+            vector<ns_parseAlignment::readRecordT> &batch = batches[readB];
+            long &n = batchSizes[readB];
+            for(n = 0; moreReads && (n < batchN);){
+               if(singlePass){
+                  if((moreReads = ns_parseAlignment::readSpill(spillInF, &batch[n])))spillReadN++;
+               }else{
+                  moreReads = ns_parseAlignment::readNextRead(samData, curF, nextF, args, readD, ignoredReads, &batch[n], &readC, &RE_nameMismatch);
+               }
+               if(moreReads){
+                  n++;
+                  readC++;
+                  if(args.verbose){ if(progressLog(readC,Ntotal,10,' '))timer.split(1,'m');}
                }
-            } else {
-               // Calculation of alignment probabilities failed.
-               invalidAlignment = true;
-            }
-         }
-      }else DEBUG_AT("UNMAP\n");
-      // next fragment has different name
-      if(ns_parseAlignment::nextFragDiffers(curF, nextF, args.flag("mateNamesDiffer"))){
-         DEBUG_AT("  last\n");
-         readC++;
-         if(args.verbose){ if(progressLog(readC,Ntotal,10,' '))timer.split(1,'m');}
-         if(!alignments.empty()){
-            outF<<bam1_qname(curF->first)<<" "<<alignments.size()+1;
-            minProb = 1;
-            for(i=0;i<(long)alignments.size();i++){
-               if(minProb>alignments[i].getLowProb())minProb = alignments[i].getLowProb();
-               outF<<" "<<alignments[i].getTrId()
-//                   <<" "<<getStrandC(alignments[i].getStrand())
-                   <<" "<<alignments[i].getProb();
-            }
-            outF<<" 0 "<<minProb<<endl;
-            alignments.clear();
-         }else{
-            // read has no valid alignments:
-            if(invalidAlignment){
-               // If there were invalid alignments, write a mock record in order to keep Nmap consistent.
-               invalidN++;
-               outF<<bam1_qname(curF->first)<<" 1 0 0"<<endl;
-            }else {
-               noN++;
-            }
-            if(args.isSet("failed")){
-               // Save failed reads.
-               failedReads.insert(bam1_qname(curF->first));
-               if(curF->paired)failedReads.insert(bam1_qname(curF->second));
             }
+            for(r = 0; r < batchSizes[writeB]; r++)
+               ns_parseAlignment::writeRead(readD, batches[writeB][r], outF, failedReadsP, &counts);
          }
-         invalidAlignment = false;
+         #pragma omp for schedule(dynamic, 16) nowait
+         for(r = 0; r < batchSizes[computeB]; r++)
+            ns_parseAlignment::computeProbs(readD, &batches[computeB][r]);
+      }
+      batchSizes[writeB] = 0;
+      // Batch just read is computed next, computed batch is written next.
+      r = writeB;
+      writeB = computeB;
+      computeB = readB;
+      readB = r;
+   }while(moreReads || (batchSizes[computeB] > 0) || (batchSizes[writeB] > 0));
+   if(singlePass){
+      spillInF.close();
+      // Free the disk space now, spillRemover covers the other exit paths.
+      remove(spillFileName.c_str());
+      if(spillReadN != spilledN){
+         error("Main: Reading temporary file %s failed.\n",spillFileName.c_str());
+         return 1;
       }
    }
    if(RE_nameMismatch>10){
@@ -417,22 +610,22 @@ string programDescription =
             "   Something is possibly wrong with your data or the reads have to be renamed.\n");
       return 1;
    }
-   outF.close();
+   if(!outF.close())return 1;
    timer.split(0,'m');
    if(args.verbose){
       message("Analyzed %ld reads:\n",readC);
       if(ignoredMaxAlignments>0)message(" %ld ignored due to --limitA flag\n",ignoredMaxAlignments);
-      if(invalidN>0)message(" %ld had only invalid alignments (see warnings)\n",invalidN);
-      if(noN>0)message(" %ld had no alignments\n",noN);
-      message("The rest had %ld alignments:\n",pairedN+singleN+firstN+secondN+weirdN);
-      if(pairedN>0)message(" %ld paired alignments\n",pairedN);
-      if(firstN+secondN+weirdN>0)
-         message(" %ld half alignments (paired-end mates aligned independently)\n",firstN+secondN+weirdN);
-      if(singleN>0)message(" %ld single-read alignments\n",singleN);
+      if(counts.invalidN>0)message(" %ld had only invalid alignments (see warnings)\n",counts.invalidN);
+      if(counts.noN>0)message(" %ld had no alignments\n",counts.noN);
+      message("The rest had %ld alignments:\n",counts.alignmentsN());
+      if(counts.pairedN>0)message(" %ld paired alignments\n",counts.pairedN);
+      if(counts.firstN+counts.secondN+counts.weirdN>0)
+         message(" %ld half alignments (paired-end mates aligned independently)\n",counts.firstN+counts.secondN+counts.weirdN);
+      if(counts.singleN>0)message(" %ld single-read alignments\n",counts.singleN);
       //flushStdout();
       messageFlush();
    }else {
-      messageF("Alignments: %ld.\n",pairedN+singleN+firstN+secondN+weirdN);
+      messageF("Alignments: %ld.\n",counts.alignmentsN());
    }
    readD.writeWarnings();
    if(args.flag("veryVerbose")){
@@ -440,10 +633,9 @@ string programDescription =
    }
    // Deal with reads that failed to align {{{
    if(args.isSet("failed")){
-      outF.open(args.getS("failed").c_str());
-      if(outF.is_open()){
+      if(outF.open(args.getS("failed"))){
          for(set<string>::iterator setIt=failedReads.begin(); setIt!=failedReads.end();setIt++)
-            outF<<*setIt<<endl;
+            outF<<*setIt<<"\n";
          outF.close();
       }
    } //}}}
@@ -462,6 +654,13 @@ string programDescription =
       }
       if(args.verbose)timer.split(0,'m');
    } //}}}
+   // Save read distribution with effective lengths {{{
+   if(args.isSet("saveModelFileName")){
+      if((!args.isSet("trInfoFileName")) && args.verbose)messageF("Computing effective lengths.\n");
+      readD.getEffectiveLengths();
+      if(!readD.saveModel(args.getS("saveModelFileName")))return 1;
+      if(args.verbose)message("Read distribution saved into %s.\n",(args.getS("saveModelFileName")).c_str());
+   } //}}}
    // Close, free and write failed reads if filename provided {{{
    delete curF;
    delete nextF;
@@ -485,6 +684,42 @@ int main(int argc,char* argv[]){
 
 namespace ns_parseAlignment {
 
+// File to remove, fixed buffer so that it can be used in signal handler.
+static char removeFileName[4096] = "";
+
+static void removeFile(){//{{{
+   if(removeFileName[0] != '\0')unlink(removeFileName);
+   removeFileName[0] = '\0';
+}//}}}
+
+static void removeFileOnSignal(int sig){//{{{
+   removeFile();
+   signal(sig, SIG_DFL);
+   raise(sig);
+}//}}}
+
+FileRemover::~FileRemover(){//{{{
+   removeFile();
+}//}}}
+
+void FileRemover::set(const string &name){//{{{
+   static bool registered = false;
+   if(name.size() >= sizeof(removeFileName)){
+      warning("Main: Temporary file %s will not be removed on errors.\n", name.c_str());
+      return;
+   }
+   strcpy(removeFileName, name.c_str());
+   if(registered)return;
+   registered = true;
+   atexit(removeFile);
+#ifndef BIOC_BUILD
+   // R handles the signals of its process.
+   signal(SIGABRT, removeFileOnSignal);
+   signal(SIGINT, removeFileOnSignal);
+   signal(SIGTERM, removeFileOnSignal);
+#endif
+}//}}}
+
 bool nextFragDiffers(const ns_rD::fragmentP curF, const ns_rD::fragmentP nextF, bool mateNamesDiffer){//{{{
    if(readNameCmp(bam1_qname(curF->first), bam1_qname(nextF->first))==0) return false;
    if(nextF->paired && mateNamesDiffer && (readNameCmp(bam1_qname(curF->first), bam1_qname(nextF->second))==0)) return false;
@@ -544,6 +779,302 @@ bool readNextFragment(samfile_t* samData, ns_rD::fragmentP &cur, ns_rD::fragment
    return currentOK;
 }//}}}
 
+bool readNextRead(samfile_t *samData, ns_rD::fragmentP &curF, ns_rD::fragmentP &nextF, const ArgumentParser &args, const ReadDistribution &readD, const set<string> &ignoredReads, readRecordT *read, long *skippedN, long *nameMismatchN){//{{{
+   read->clear();
+   while(readNextFragment(samData,curF,nextF)){
+      // Skip all alignments of this read.
+      if(ignoredReads.count(bam1_qname(curF->first))>0){
+         DEBUG_AT(" ignore\n");
+         // Read reads while the name is the same.
+         while(readNextFragment(samData,curF,nextF)){
+            DEBUG_AT(" ignore\n");
+            if(nextFragDiffers(curF, nextF, args.flag("mateNamesDiffer")))
+               break;
+         }
+         (*skippedN)++;
+         continue;
+      }
+      if( !(curF->first->core.flag & BAM_FUNMAP) ){
+         DEBUG_AT("M");
+         // (at least) The first read was mapped.
+         // Check mates' names.
+         if(curF->paired && (readNameCmp(bam1_qname(curF->first), bam1_qname(curF->second))!=0) && (!args.flag("mateNamesDiffer"))){
+            if(*nameMismatchN == 0){
+               warning("Paired read name mismatch: %s %s\n",bam1_qname(curF->first), bam1_qname(curF->second));
+            }
+            (*nameMismatchN)++;
+            if(*nameMismatchN>10)return false;
+            read->invalid = true;
+         }else if((!args.flag("excludeSingletons")) || curF->paired || (! (curF->first->core.flag & BAM_FPAIRED))){
+            // We only calculate probabilties and add alignments if: 
+            // (singletons are not exlucded) OR  (it is a proper paired alignments) OR (it is single-end read)
+            read->frags.push_back(ns_rD::fragmentRecordT());
+            readD.getRecord(curF, &read->frags.back());
+         }
+      }else DEBUG_AT("UNMAP\n");
+      // next fragment has different name
+      if(nextFragDiffers(curF, nextF, args.flag("mateNamesDiffer"))){
+         DEBUG_AT("  last\n");
+         read->name = bam1_qname(curF->first);
+         if(curF->paired)read->mateName = bam1_qname(curF->second);
+         return true;
+      }
+   }
+   return false;
+}//}}}
+
+long observeFragments(const vector<ns_rD::fragmentP> &frags, long fragsN, vector<ReadDistribution> *accs){//{{{
+   long observedN = 0, f;
+   #pragma omp parallel for schedule(static) reduction(+:observedN)
+   for(f=0;f<fragsN;f++){
+      long thread = 0;
+#ifdef _OPENMP
+      thread = omp_get_thread_num();
+#endif
+      if((*accs)[thread].observed(frags[f]))observedN++;
+   }
+   return observedN;
+}//}}}
+
+FragmentObserver::FragmentObserver(ReadDistribution *readD, bool parallel, long sampleN, double tolerance, long checkN, long seed) : rng_mt(seed){//{{{
+   this->readD = readD;
+   this->sampleN = sampleN;
+   this->tolerance = tolerance;
+   this->checkN = checkN;
+   nextCheck = checkN;
+   fragsN = seenN = observedN = 0;
+   converged = false;
+   if(parallel){
+      accs.resize(ns_threads::threadsN());
+      for(long i=0;i<(long)accs.size();i++)readD->initAccumulator(&accs[i]);
+   }
+}//}}}
+
+FragmentObserver::~FragmentObserver(){//{{{
+   for(long i=0;i<(long)frags.size();i++)delete frags[i];
+}//}}}
+
+ns_rD::fragmentP FragmentObserver::slot(long i){//{{{
+   while((long)frags.size() <= i)frags.push_back(new ns_rD::fragmentT);
+   return frags[i];
+}//}}}
+
+void FragmentObserver::observeStored(){//{{{
+   if(accs.empty()){
+      for(long f=0;f<fragsN;f++)
+         if(readD->observed(frags[f]))observedN++;
+   }else{
+      observedN += observeFragments(frags, fragsN, &accs);
+   }
+   fragsN = 0;
+}//}}}
+
+void FragmentObserver::mergeAccumulators(){//{{{
+   // Merge in fixed order so that results do not depend on scheduling.
+   for(long i=0;i<(long)accs.size();i++){
+      readD->merge(accs[i]);
+      readD->initAccumulator(&accs[i]);
+   }
+}//}}}
+
+void FragmentObserver::add(const ns_rD::fragmentP frag){//{{{
+   if(converged)return;
+   seenN++;
+   if(sampleN > 0){
+      // Reservoir sampling: n-th fragment replaces random one with probability sampleN/n.
+      if(fragsN < sampleN)slot(fragsN++)->copyFragment(frag);
+      else{
+         long r = (long)(uniformDistribution(rng_mt) * seenN);
+         if(r < sampleN)frags[r]->copyFragment(frag);
+      }
+      return;
+   }
+   if(accs.empty()){
+      if(readD->observed(frag))observedN++;
+   }else{
+      slot(fragsN++)->copyFragment(frag);
+      if(fragsN == READ_BATCH)observeStored();
+   }
+   if((tolerance > 0) && (seenN >= nextCheck)){
+      nextCheck += checkN;
+      observeStored();
+      mergeAccumulators();
+      if(readD->profileChange(&profile) < tolerance)converged = true;
+   }
+}//}}}
+
+long FragmentObserver::finish(){//{{{
+   observeStored();
+   mergeAccumulators();
+   accs.clear();
+   return observedN;
+}//}}}
+
+void computeProbs(ReadDistribution &readD, readRecordT *read){//{{{
+   read->probs.resize(read->frags.size());
+   for(long f=0;f<(long)read->frags.size();f++){
+      alignmentProbT &p = read->probs[f];
+      p.status = readD.computeP(read->frags[f], p.prob, p.probNoise, &p.firstMateDown);
+   }
+}//}}}
+
+void writeRead(ReadDistribution &readD, const readRecordT &read, AsyncWriter &outF, set<string> *failedReads, alignmentCountsT *counts){//{{{
+   double minProb;
+   bool invalidAlignment = read.invalid;
+   vector<TagAlignment> alignments;
+   for(long f=0;f<(long)read.frags.size();f++){
+      const ns_rD::fragmentRecordT &frag = read.frags[f];
+      const alignmentProbT &p = read.probs[f];
+      if(readD.noteP(frag, p.status, p.firstMateDown, read.name.c_str())){
+         // We calculated valid probabilities for this alignment.   
+         // Add alignment:
+         alignments.push_back(TagAlignment(frag.first.tid+1, p.prob, p.probNoise));
+         // Update counters:
+         if( frag.paired ) {
+            // Fragment's both reads are mapped as a pair.
+            counts->pairedN++;
+            DEBUG_AT(" P\n");
+         }else {
+            if (frag.first.flag & BAM_FPAIRED) {
+               // Read was part of pair (meaning that the other is unmapped).
+               if (frag.first.flag & BAM_FREAD1) {
+                  counts->firstN++;
+                  DEBUG_AT(" 1\n");
+               } else if (frag.first.flag & BAM_FREAD2) {
+                  counts->secondN++;
+                  DEBUG_AT(" 2\n");
+               } else {
+                  counts->weirdN ++;
+                  DEBUG_AT(" W\n");
+               }
+            } else {
+               // Read is single end, with valid alignment.
+               counts->singleN++;
+               DEBUG_AT(" S\n");
+            }
+         }
+      } else {
+         // Calculation of alignment probabilities failed.
+         invalidAlignment = true;
+      }
+   }
+   if(!alignments.empty()){
+      outF<<read.name<<" "<<alignments.size()+1;
+      minProb = 1;
+      for(long i=0;i<(long)alignments.size();i++){
+         if(minProb>alignments[i].getLowProb())minProb = alignments[i].getLowProb();
+         outF<<" "<<alignments[i].getTrId()
+//             <<" "<<getStrandC(alignments[i].getStrand())
+             <<" "<<alignments[i].getProb();
+      }
+      outF<<" 0 "<<minProb<<"\n";
+   }else{
+      // read has no valid alignments:
+      if(invalidAlignment){
+         // If there were invalid alignments, write a mock record in order to keep Nmap consistent.
+         counts->invalidN++;
+         outF<<read.name<<" 1 0 0\n";
+      }else {
+         counts->noN++;
+      }
+      if(failedReads != NULL){
+         // Save failed reads.
+         failedReads->insert(read.name);
+         if(!read.mateName.empty())failedReads->insert(read.mateName);
+      }
+   }
+}//}}}
+
+// Binary format of temporary file (native byte order, the file is read by
+// the process which wrote it):
+//  header: magic, format version, number of reads;
+//  for each read:
+//   name, mate's name, invalid, number of fragments, fragments;
+//   fragment: paired, first mate, (second mate);
+//   mate: tid, pos, endPos, flag, number of bases, (seqLP, seqLowLP) or bases.
+// Read groups are not stored, probabilities do not depend on them.
+const char spillMagic[8] = {'B','S','S','P','I','L','L','\n'};
+const uint32_t spillVersion = 1;
+template<class valT> inline void writeValue(ofstream &spillF, valT val){//{{{
+   spillF.write((const char*)&val, sizeof(val));
+}//}}}
+template<class valT> inline bool readValue(ifstream &spillF, valT *val){//{{{
+   return !spillF.read((char*)val, sizeof(*val)).fail();
+}//}}}
+void writeString(ofstream &spillF, const string &str){//{{{
+   writeValue(spillF, (int32_t)str.size());
+   spillF.write(str.c_str(), str.size());
+}//}}}
+bool readString(ifstream &spillF, string *str){//{{{
+   int32_t len;
+   if(!readValue(spillF, &len) || (len < 0))return false;
+   str->resize(len);
+   return (len == 0) || (!spillF.read(&(*str)[0], len).fail());
+}//}}}
+void writeMate(ofstream &spillF, const ns_rD::mateRecordT &mate){//{{{
+   writeValue(spillF, mate.tid);
+   writeValue(spillF, mate.pos);
+   writeValue(spillF, mate.endPos);
+   writeValue(spillF, mate.flag);
+   writeValue(spillF, (int32_t)mate.bases.size());
+   if(mate.bases.empty()){
+      writeValue(spillF, mate.seqLP);
+      writeValue(spillF, mate.seqLowLP);
+   }else{
+      spillF.write((const char*)&mate.bases[0], mate.bases.size());
+   }
+}//}}}
+bool readMate(ifstream &spillF, ns_rD::mateRecordT *mate){//{{{
+   int32_t basesN;
+   if(!(readValue(spillF, &mate->tid) && readValue(spillF, &mate->pos) &&
+        readValue(spillF, &mate->endPos) && readValue(spillF, &mate->flag) &&
+        readValue(spillF, &basesN) && (basesN >= 0)))return false;
+   mate->bases.resize(basesN);
+   mate->seqLP = mate->seqLowLP = 0;
+   if(basesN == 0)
+      return readValue(spillF, &mate->seqLP) && readValue(spillF, &mate->seqLowLP);
+   return !spillF.read((char*)&mate->bases[0], basesN).fail();
+}//}}}
+bool writeSpill(ofstream &spillF, const readRecordT &read){//{{{
+   writeString(spillF, read.name);
+   writeString(spillF, read.mateName);
+   writeValue(spillF, (uint8_t)read.invalid);
+   writeValue(spillF, (int32_t)read.frags.size());
+   for(long f=0;f<(long)read.frags.size();f++){
+      writeValue(spillF, (uint8_t)read.frags[f].paired);
+      writeMate(spillF, read.frags[f].first);
+      if(read.frags[f].paired)writeMate(spillF, read.frags[f].second);
+   }
+   return !spillF.fail();
+}//}}}
+void writeSpillHeader(ofstream &spillF, int64_t readsN){//{{{
+   spillF.write(spillMagic, sizeof(spillMagic));
+   writeValue(spillF, spillVersion);
+   writeValue(spillF, readsN);
+}//}}}
+bool readSpillHeader(ifstream &spillF, int64_t *readsN){//{{{
+   char magic[8];
+   uint32_t version;
+   spillF.read(magic, sizeof(magic));
+   return (!spillF.fail()) && (memcmp(magic, spillMagic, sizeof(magic)) == 0) &&
+          readValue(spillF, &version) && (version == spillVersion) && readValue(spillF, readsN);
+}//}}}
+bool readSpill(ifstream &spillF, readRecordT *read){//{{{
+   uint8_t flag;
+   int32_t fragsN;
+   if(!(readString(spillF, &read->name) && readString(spillF, &read->mateName) &&
+        readValue(spillF, &flag) && readValue(spillF, &fragsN) && (fragsN >= 0)))return false;
+   read->invalid = flag;
+   read->frags.resize(fragsN);
+   for(long f=0;f<fragsN;f++){
+      if(!readValue(spillF, &flag))return false;
+      read->frags[f].paired = flag;
+      if(!readMate(spillF, &read->frags[f].first))return false;
+      if(flag && (!readMate(spillF, &read->frags[f].second)))return false;
+   }
+   return true;
+}//}}}
+
 bool setInputFormat(const ArgumentParser &args, string *format){//{{{
    if(args.isSet("format")){
       *format = args.getLowerS("format");
@@ -564,7 +1095,7 @@ bool setInputFormat(const ArgumentParser &args, string *format){//{{{
    return false;
 }//}}}
 
-bool openSamFile(const string &name, const string &inFormat, samfile_t **samFile){//{{{
+bool openSamFile(const string &name, const string &inFormat, samfile_t **samFile, long readThreadsN){//{{{
    if(*samFile != NULL)samclose(*samFile);
    if(inFormat=="bam") *samFile = samopen(name.c_str(), "rb" , NULL);
    else *samFile = samopen(name.c_str(), "r" , NULL);
@@ -572,6 +1103,8 @@ bool openSamFile(const string &name, const string &inFormat, samfile_t **samFile
       error("Failed re-reading alignments.\n");
       return false;
    }
+   // Keep few blocks per thread decompressed ahead of parsing.
+   if((inFormat=="bam") && (readThreadsN > 0))samthreads(*samFile, readThreadsN, 4);
    return true;
 }//}}}
 
@@ -210,33 +210,34 @@ static int deflate_block(BGZF *fp, int block_length)
 	return comp_size;
 }
 
-// Inflate the block in fp->compressed_block into fp->uncompressed_block
-static int inflate_block(BGZF* fp, int block_length)
+// Inflate the compressed block in src into dst; -1 on error
+static int bgzf_uncompress(void *dst, void *src, int block_length)
 {
 	z_stream zs;
 	zs.zalloc = NULL;
 	zs.zfree = NULL;
-	zs.next_in = fp->compressed_block + 18;
+	zs.next_in = (uint8_t*)src + 18;
 	zs.avail_in = block_length - 16;
-	zs.next_out = fp->uncompressed_block;
+	zs.next_out = dst;
 	zs.avail_out = BGZF_MAX_BLOCK_SIZE;
 
-	if (inflateInit2(&zs, -15) != Z_OK) {
-		fp->errcode |= BGZF_ERR_ZLIB;
-		return -1;
-	}
+	if (inflateInit2(&zs, -15) != Z_OK) return -1;
 	if (inflate(&zs, Z_FINISH) != Z_STREAM_END) {
 		inflateEnd(&zs);
-		fp->errcode |= BGZF_ERR_ZLIB;
-		return -1;
-	}
-	if (inflateEnd(&zs) != Z_OK) {
-		fp->errcode |= BGZF_ERR_ZLIB;
 		return -1;
 	}
+	if (inflateEnd(&zs) != Z_OK) return -1;
 	return zs.total_out;
 }
 
+// Inflate the block in fp->compressed_block into fp->uncompressed_block
+static int inflate_block(BGZF* fp, int block_length)
+{
+	int ret = bgzf_uncompress(fp->uncompressed_block, fp->compressed_block, block_length);
+	if (ret < 0) fp->errcode |= BGZF_ERR_ZLIB;
+	return ret;
+}
+
 static int check_header(const uint8_t *header)
 {
 	return (header[0] == 31 && header[1] == 139 && header[2] == 8 && (header[3] & 4) != 0
@@ -304,11 +305,184 @@ static int load_block_from_cache(BGZF *fp, int64_t block_address) {return 0;}
 static void cache_block(BGZF *fp, int size) {}
 #endif
 
+/***** BEGIN: multi-threaded reading *****/
+
+/* Worker threads read compressed blocks from the file one after another (under
+ * the lock) and inflate them in parallel into a ring of slots; the reader takes
+ * the slots in the file order. */
+
+#define SLOT_EMPTY   0
+#define SLOT_LOADING 1
+#define SLOT_READY   2
+
+typedef struct {
+	void *compressed, *uncompressed;
+	int64_t address; // address of the block in the file
+	int size, length; // compressed and uncompressed size; length 0 at end-of-file
+	int errcode, state;
+} rslot_t;
+
+typedef struct {
+	int n_threads, n_slots;
+	int next_load, next_use; // slot to be read from the file next, slot to be used by the reader next
+	int eof, done;
+	int64_t next_address; // address of the block following the one being used
+	rslot_t *slots;
+	pthread_t *tid;
+	pthread_mutex_t lock;
+	pthread_cond_t cv_load, cv_ready;
+} mtread_t;
+
+// Read the compressed block into the slot, called with the lock held.
+static void mt_read_load(BGZF *fp, rslot_t *s)
+{
+	mtread_t *mt = (mtread_t*)fp->mt;
+	uint8_t *compressed_block = (uint8_t*)s->compressed;
+	int count, remaining;
+	s->errcode = 0;
+	s->size = s->length = 0;
+	s->address = _bgzf_tell((_bgzf_file_t)fp->fp);
+	count = _bgzf_read(fp->fp, compressed_block, BLOCK_HEADER_LENGTH);
+	if (count == 0) { // end-of-file
+		mt->eof = 1;
+		return;
+	}
+	if (count != BLOCK_HEADER_LENGTH || !check_header(compressed_block)) {
+		s->errcode = BGZF_ERR_HEADER;
+		mt->eof = 1;
+		return;
+	}
+	s->size = unpackInt16(&compressed_block[16]) + 1;
+	remaining = s->size - BLOCK_HEADER_LENGTH;
+	if (_bgzf_read(fp->fp, &compressed_block[BLOCK_HEADER_LENGTH], remaining) != remaining) {
+		s->errcode = BGZF_ERR_IO;
+		mt->eof = 1;
+	}
+}
+
+static void *mt_read_worker(void *data)
+{
+	BGZF *fp = (BGZF*)data;
+	mtread_t *mt = (mtread_t*)fp->mt;
+	rslot_t *s;
+	pthread_mutex_lock(&mt->lock);
+	while (1) {
+		while (!mt->done && (mt->eof || mt->slots[mt->next_load].state != SLOT_EMPTY))
+			pthread_cond_wait(&mt->cv_load, &mt->lock);
+		if (mt->done) break;
+		s = &mt->slots[mt->next_load];
+		mt->next_load = (mt->next_load + 1) % mt->n_slots;
+		s->state = SLOT_LOADING;
+		mt_read_load(fp, s);
+		if (s->size > 0 && s->errcode == 0) {
+			// inflate without the lock, in parallel with other workers
+			pthread_mutex_unlock(&mt->lock);
+			s->length = bgzf_uncompress(s->uncompressed, s->compressed, s->size);
+			pthread_mutex_lock(&mt->lock);
+			if (s->length < 0) {
+				s->length = 0;
+				s->errcode = BGZF_ERR_ZLIB;
+			}
+		}
+		s->state = SLOT_READY;
+		pthread_cond_broadcast(&mt->cv_ready);
+	}
+	pthread_mutex_unlock(&mt->lock);
+	return 0;
+}
+
+static int mt_read_init(BGZF *fp, int n_threads, int n_slots)
+{
+	int i;
+	mtread_t *mt;
+	if (fp->is_write || fp->mt || n_threads < 1) return -1;
+	if (n_slots < n_threads) n_slots = n_threads;
+	mt = calloc(1, sizeof(mtread_t));
+	mt->n_threads = n_threads;
+	mt->n_slots = n_slots;
+	mt->slots = calloc(n_slots, sizeof(rslot_t));
+	for (i = 0; i < n_slots; ++i) {
+		mt->slots[i].compressed = malloc(BGZF_MAX_BLOCK_SIZE);
+		mt->slots[i].uncompressed = malloc(BGZF_MAX_BLOCK_SIZE);
+	}
+	mt->tid = calloc(n_threads, sizeof(pthread_t));
+	mt->next_address = _bgzf_tell((_bgzf_file_t)fp->fp);
+	pthread_mutex_init(&mt->lock, 0);
+	pthread_cond_init(&mt->cv_load, 0);
+	pthread_cond_init(&mt->cv_ready, 0);
+	fp->mt = mt;
+	for (i = 0; i < n_threads; ++i)
+		pthread_create(&mt->tid[i], 0, mt_read_worker, fp);
+	return 0;
+}
+
+static void mt_read_destroy(BGZF *fp)
+{
+	int i;
+	mtread_t *mt = (mtread_t*)fp->mt;
+	pthread_mutex_lock(&mt->lock);
+	mt->done = 1;
+	pthread_cond_broadcast(&mt->cv_load);
+	pthread_mutex_unlock(&mt->lock);
+	for (i = 0; i < mt->n_threads; ++i) pthread_join(mt->tid[i], 0);
+	for (i = 0; i < mt->n_slots; ++i) {
+		free(mt->slots[i].compressed);
+		free(mt->slots[i].uncompressed);
+	}
+	free(mt->slots); free(mt->tid);
+	pthread_cond_destroy(&mt->cv_load);
+	pthread_cond_destroy(&mt->cv_ready);
+	pthread_mutex_destroy(&mt->lock);
+	free(mt);
+	fp->mt = 0;
+}
+
+// Use the next inflated block, same as bgzf_read_block().
+static int mt_read_block(BGZF *fp)
+{
+	mtread_t *mt = (mtread_t*)fp->mt;
+	rslot_t *s = &mt->slots[mt->next_use];
+	pthread_mutex_lock(&mt->lock);
+	while (s->state != SLOT_READY)
+		pthread_cond_wait(&mt->cv_ready, &mt->lock);
+	pthread_mutex_unlock(&mt->lock);
+	// Slots with an error or end-of-file stay in place, so that further calls return the same.
+	if (s->errcode) {
+		fp->errcode |= s->errcode;
+		return -1;
+	}
+	if (s->size == 0) {
+		fp->block_length = 0;
+		return 0;
+	}
+	memcpy(fp->uncompressed_block, s->uncompressed, s->length);
+	if (fp->block_length != 0) fp->block_offset = 0; // Do not reset offset if this read follows a seek.
+	fp->block_address = s->address;
+	fp->block_length = s->length;
+	mt->next_address = s->address + s->size;
+	pthread_mutex_lock(&mt->lock);
+	s->state = SLOT_EMPTY;
+	mt->next_use = (mt->next_use + 1) % mt->n_slots;
+	pthread_cond_broadcast(&mt->cv_load);
+	pthread_mutex_unlock(&mt->lock);
+	return 0;
+}
+
+// Address of the block following the current one.
+static inline int64_t next_block_address(BGZF *fp)
+{
+	if (fp->mt && !fp->is_write) return ((mtread_t*)fp->mt)->next_address;
+	return _bgzf_tell((_bgzf_file_t)fp->fp);
+}
+
+/***** END: multi-threaded reading *****/
+
 int bgzf_read_block(BGZF *fp)
 {
 	uint8_t header[BLOCK_HEADER_LENGTH], *compressed_block;
 	int count, size = 0, block_length, remaining;
 	int64_t block_address;
+	if (fp->mt) return mt_read_block(fp);
 	block_address = _bgzf_tell((_bgzf_file_t)fp->fp);
 	if (fp->cache_size && load_block_from_cache(fp, block_address)) return 0;
 	count = _bgzf_read(fp->fp, header, sizeof(header));
@@ -361,7 +535,7 @@ ssize_t bgzf_read(BGZF *fp, void *data, ssize_t length)
 		bytes_read += copy_length;
 	}
 	if (fp->block_offset == fp->block_length) {
-		fp->block_address = _bgzf_tell((_bgzf_file_t)fp->fp);
+		fp->block_address = next_block_address(fp);
 		fp->block_offset = fp->block_length = 0;
 	}
 	return bytes_read;
@@ -421,7 +595,8 @@ int bgzf_mt(BGZF *fp, int n_threads, int n_sub_blks)
 	int i;
 	mtaux_t *mt;
 	pthread_attr_t attr;
-	if (!fp->is_write || fp->mt || n_threads <= 1) return -1;
+	if (!fp->is_write) return mt_read_init(fp, n_threads, n_threads * n_sub_blks);
+	if (fp->mt || n_threads <= 1) return -1;
 	mt = calloc(1, sizeof(mtaux_t));
 	mt->n_threads = n_threads;
 	mt->n_blks = n_threads * n_sub_blks;
@@ -581,7 +756,7 @@ int bgzf_close(BGZF* fp)
 			return -1;
 		}
 		if (fp->mt) mt_destroy(fp->mt);
-	}
+	} else if (fp->mt) mt_read_destroy(fp);
 	ret = fp->is_write? fclose(fp->fp) : _bgzf_close(fp->fp);
 	if (ret != 0) return -1;
 	free(fp->uncompressed_block);
@@ -601,31 +776,48 @@ int bgzf_check_EOF(BGZF *fp)
 	static uint8_t magic[28] = "\037\213\010\4\0\0\0\0\0\377\6\0\102\103\2\0\033\0\3\0\0\0\0\0\0\0\0\0";
 	uint8_t buf[28];
 	off_t offset;
+	int ret = 0;
+	mtread_t *mt = (fp->mt && !fp->is_write)? (mtread_t*)fp->mt : 0;
+	if (mt) pthread_mutex_lock(&mt->lock); // workers are reading the file
 	offset = _bgzf_tell((_bgzf_file_t)fp->fp);
-	if (_bgzf_seek(fp->fp, -28, SEEK_END) < 0) return 0;
-	_bgzf_read(fp->fp, buf, 28);
-	_bgzf_seek(fp->fp, offset, SEEK_SET);
-	return (memcmp(magic, buf, 28) == 0)? 1 : 0;
+	if (_bgzf_seek(fp->fp, -28, SEEK_END) >= 0) {
+		_bgzf_read(fp->fp, buf, 28);
+		_bgzf_seek(fp->fp, offset, SEEK_SET);
+		ret = (memcmp(magic, buf, 28) == 0)? 1 : 0;
+	}
+	if (mt) pthread_mutex_unlock(&mt->lock);
+	return ret;
 }
 
 int64_t bgzf_seek(BGZF* fp, int64_t pos, int where)
 {
-	int block_offset;
-	int64_t block_address;
+	int block_offset, n_threads = 0, n_slots = 0;
+	int64_t block_address, next_address = 0;
 
 	if (fp->is_write || where != SEEK_SET) {
 		fp->errcode |= BGZF_ERR_MISUSE;
 		return -1;
 	}
+	if (fp->mt) { // stop reading ahead, restart from the new position
+		n_threads = ((mtread_t*)fp->mt)->n_threads;
+		n_slots = ((mtread_t*)fp->mt)->n_slots;
+		next_address = ((mtread_t*)fp->mt)->next_address;
+		mt_read_destroy(fp);
+	}
 	block_offset = pos & 0xFFFF;
 	block_address = pos >> 16;
 	if (_bgzf_seek(fp->fp, block_address, SEEK_SET) < 0) {
 		fp->errcode |= BGZF_ERR_IO;
+		if (n_threads > 0) { // keep reading ahead from the block following the current one
+			_bgzf_seek(fp->fp, next_address, SEEK_SET);
+			mt_read_init(fp, n_threads, n_slots);
+		}
 		return -1;
 	}
 	fp->block_length = 0;  // indicates current block has not been loaded
 	fp->block_address = block_address;
 	fp->block_offset = block_offset;
+	if (n_threads > 0) mt_read_init(fp, n_threads, n_slots);
 	return 0;
 }
 
@@ -650,7 +842,7 @@ int bgzf_getc(BGZF *fp)
 	}
 	c = ((unsigned char*)fp->uncompressed_block)[fp->block_offset++];
     if (fp->block_offset == fp->block_length) {
-        fp->block_address = _bgzf_tell((_bgzf_file_t)fp->fp);
+        fp->block_address = next_block_address(fp);
         fp->block_offset = 0;
         fp->block_length = 0;
     }
@@ -683,7 +875,7 @@ int bgzf_getline(BGZF *fp, int delim, kstring_t *str)
 		str->l += l;
 		fp->block_offset += l + 1;
 		if (fp->block_offset >= fp->block_length) {
-			fp->block_address = _bgzf_tell((_bgzf_file_t)fp->fp);
+			fp->block_address = next_block_address(fp);
 			fp->block_offset = 0;
 			fp->block_length = 0;
 		} 
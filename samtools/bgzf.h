@@ -192,11 +192,14 @@ extern "C" {
 	int bgzf_read_block(BGZF *fp);
 
 	/**
-	 * Enable multi-threading (only effective on writing)
+	 * Enable multi-threading. On writing, blocks are compressed in parallel. On
+	 * reading, blocks following the current one are read and decompressed ahead
+	 * by a pool of threads, the data read are not affected.
 	 *
-	 * @param fp          BGZF file handler; must be opened for writing
-	 * @param n_threads   #threads used for writing
-	 * @param n_sub_blks  #blocks processed by each thread; a value 64-256 is recommended
+	 * @param fp          BGZF file handler
+	 * @param n_threads   #threads used for writing (at least 2) or for decompression (at least 1)
+	 * @param n_sub_blks  #blocks processed by each thread; a value 64-256 is recommended for
+	 *                    writing, a few blocks are enough for reading
 	 */
 	int bgzf_mt(BGZF *fp, int n_threads, int n_sub_blks);
 
@@ -0,0 +1,60 @@
+#!/bin/sh
+# Benchmark of NUMA placement: wall time of estimateExpression chains with
+# unpinned threads, pinned threads and pinned threads with per node copies of
+# the alignments (--numaReplicas), and of estimateVBExpression with unpinned
+# threads and pinned threads with rows placed on the node of the thread
+# processing them (placeRows).
+# If perf is available, node-loads and node-load-misses (loads served from
+# memory of another NUMA node) are reported as well.
+# On a machine with a single NUMA node all variants access local memory only,
+# so they should take about the same time.
+#
+# Usage: benchNuma.sh [readsN] [M] [threads]
+#   readsN  - reads of the generated .prob file (default 2000000),
+#   M       - transcripts (default 2000),
+#   threads - threads and MCMC chains (default all CPUs).
+
+BIN=`dirname $0`/..
+READS=${1:-2000000}
+M=${2:-2000}
+THREADS=${3:-`getconf _NPROCESSORS_ONLN`}
+DIR=`mktemp -d` || exit 1
+trap 'rm -rf "$DIR"' 0
+
+NODES=`ls -d /sys/devices/system/node/node[0-9]* 2>/dev/null | wc -l`
+[ "$NODES" -ge 1 ] || NODES=1
+echo "benchNuma: $NODES NUMA nodes, $THREADS threads, $READS reads, $M transcripts"
+[ "$NODES" -gt 1 ] || echo "benchNuma: single NUMA node, differences are only noise"
+
+PERF=""
+if perf stat -e node-loads,node-load-misses true > /dev/null 2>&1; then
+   PERF="perf stat -x , -e node-loads,node-load-misses -o $DIR/perf"
+fi
+
+$BIN/test/genProb $DIR/data.prob $READS $M 1 || exit 1
+
+# run <name> <command...>
+run(){
+   name=$1
+   shift
+   start=`date +%s.%N`
+   $PERF "$@" > $DIR/log 2>&1 || { cat $DIR/log; exit 1; }
+   end=`date +%s.%N`
+   misses=""
+   if [ -n "$PERF" ]; then
+      misses=`awk -F, '$3 == "node-loads" { l = $1 } $3 == "node-load-misses" { m = $1 }
+         END { if(l > 0) printf "  remote loads %.1f%%", 100 * m / l }' $DIR/perf`
+   fi
+   echo "$name $start $end" | awk -v misses="$misses" '{ printf "%-36s %8.2f s%s\n", $1, $3 - $2, misses }'
+}
+
+EE="$BIN/estimateExpression -o $DIR/ee -s 1 -P $THREADS --MCMC_chainsN $THREADS \
+   --MCMC_burnIn 200 --MCMC_samplesN 200 --MCMC_samplesSave 100 --MCMC_samplesDOmax --MCMC_samplesNmax 200"
+run estimateExpression $EE $DIR/data.prob
+run "estimateExpression/spread" $EE --pinThreads spread $DIR/data.prob
+run "estimateExpression/spread/replicas" $EE --pinThreads spread --numaReplicas $DIR/data.prob
+
+VB="$BIN/estimateVBExpression -o $DIR/vb -s 1 -P $THREADS --maxIter 200 --optLimit 0"
+run estimateVBExpression $VB $DIR/data.prob
+run "estimateVBExpression/close" $VB --pinThreads close $DIR/data.prob
+run "estimateVBExpression/spread" $VB --pinThreads spread $DIR/data.prob
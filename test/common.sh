@@ -0,0 +1,31 @@
+# Setup and helpers shared by the shell tests, sourced as
+#   . `dirname $0`/common.sh
+# BIN is the directory with the programs, DIR a temporary directory removed on
+# exit and TEST the name of the test used in messages.
+
+BIN=`dirname $0`/..
+TEST=`basename $0 .sh`
+DIR=`mktemp -d` || exit 1
+trap 'rm -rf "$DIR"' 0
+
+# gen_data <name> <readsN> <transcriptsN> <seed>
+# Generates $DIR/<name>.prob by genProb.
+gen_data(){
+   $BIN/test/genProb $DIR/$1.prob $2 $3 $4 || exit 1
+}
+
+# max_diff <name> <reference file> <file> <column> <relative> <absolute> <rows>
+# Compares the column of the files (lines starting with # are skipped) and
+# exits if a difference is larger than relative * (larger value) + absolute
+# or the files do not have the given number of rows; prints the maximal
+# difference.
+max_diff(){
+   grep -v '^#' $2 | awk -v c=$4 '{print $c}' > $DIR/max_diff.ref
+   grep -v '^#' $3 | awk -v c=$4 '{print $c}' | paste $DIR/max_diff.ref - | \
+   awk -v test=$TEST -v name="$1" -v rel=$5 -v abs=$6 -v rows=$7 '
+      { d = $1 - $2; if(d < 0) d = -d; m = ($1 > $2) ? $1 : $2;
+        if(d > maxD) maxD = d;
+        if(d > rel * m + abs){ print "FAIL " name ": row " NR " values " $1 " " $2; bad = 1 } }
+      END { if(NR != rows){ print "FAIL " name ": " NR " rows instead of " rows; bad = 1 }
+            print test ": " name " max difference " maxD + 0; exit bad }' || exit 1
+}
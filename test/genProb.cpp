@@ -0,0 +1,60 @@
+/*
+ * Generator of synthetic alignment probability (.prob) files for tests.
+ *
+ * Usage: genProb <outFile> [readsN] [M] [seed]
+ *
+ * Reads are drawn from transcripts 1..M with relative abundance proportional
+ * to (t % 7)^2, so that some transcripts are not expressed. Each read aligns
+ * to its transcript and with some probability also to one or both neighbours,
+ * which makes the assignment ambiguous, and to the noise transcript 0.
+ */
+#include<cmath>
+#include<cstdlib>
+#include<fstream>
+#include<vector>
+
+#include "boost/random/mersenne_twister.hpp"
+#include "boost/random/uniform_01.hpp"
+
+using namespace std;
+
+#include "common.h"
+
+int main(int argc, char *argv[]){
+   if(argc < 2){
+      error("Usage: %s <outFile> [readsN] [M] [seed]\n", argv[0]);
+      return 1;
+   }
+   long readsN = (argc > 2) ? atol(argv[2]) : 20000;
+   long M = (argc > 3) ? atol(argv[3]) : 40;
+   long seed = (argc > 4) ? atol(argv[4]) : 1;
+   long r, t, unmappedN = readsN / 100;
+   boost::random::mt11213b rng_mt(seed);
+   boost::random::uniform_01<double> uniformDistribution;
+   vector<double> cumTheta(M + 1, 0);
+   for(t = 1; t <= M; t++)cumTheta[t] = cumTheta[t - 1] + (t % 7) * (t % 7);
+   ofstream outF(argv[1]);
+   if(!outF.is_open()){
+      error("Unable to open output file %s.\n", argv[1]);
+      return 1;
+   }
+   outF.precision(9);
+   outF<<scientific;
+   outF<<"# Ntotal "<<readsN + unmappedN<<"\n# Nmap "<<readsN<<"\n# M "<<M<<"\n";
+   outF<<"# LOGFORMAT (probabilities saved on log scale.)\n# r_name num_alignments (tr_id prob )^*{num_alignments}\n";
+   double u;
+   bool left, right;
+   for(r = 0; r < readsN; r++){
+      u = uniformDistribution(rng_mt) * cumTheta[M];
+      for(t = 1; (t < M) && (cumTheta[t] < u); t++);
+      left = (t > 1) && (uniformDistribution(rng_mt) < 0.2);
+      right = (t < M) && (uniformDistribution(rng_mt) < 0.5);
+      outF<<"read"<<r<<" "<<2 + left + right;
+      outF<<" "<<t<<" "<<-7 - 2 * uniformDistribution(rng_mt);
+      if(left)outF<<" "<<t - 1<<" "<<-8 - 2 * uniformDistribution(rng_mt);
+      if(right)outF<<" "<<t + 1<<" "<<-7.5 - 2 * uniformDistribution(rng_mt);
+      outF<<" 0 "<<-62 - uniformDistribution(rng_mt)<<"\n";
+   }
+   outF.close();
+   return 0;
+}
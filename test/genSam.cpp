@@ -0,0 +1,142 @@
+/*
+ * Generator of transcript sequences and read alignments (SAM) for tests of
+ * parseAlignment.
+ *
+ * Usage: genSam <outPrefix> [readsN] [paired] [seed] [fragMu]
+ *
+ * Writes <outPrefix>.fa with 20 random transcripts of 1000 to 9000 bases and
+ * <outPrefix>.sam with readsN reads (paired-end unless paired is 0) of 50
+ * bases. Fragments have log-normal length with mean log length fragMu
+ * (default 5.5) and standard deviation 0.2 (at most the transcript length),
+ * reads have 1% substituted bases, a third of the reads has another
+ * alignment to a random transcript and 1% of the reads is not aligned.
+ * The same alignments are written in BAM format into <outPrefix>.bam.
+ */
+#include<cmath>
+#include<cstdlib>
+#include<fstream>
+#include<string>
+#include<vector>
+
+#include "boost/random/mersenne_twister.hpp"
+#include "boost/random/normal_distribution.hpp"
+#include "boost/random/uniform_01.hpp"
+
+using namespace std;
+
+#include "samtools/sam.h"
+
+#include "common.h"
+
+namespace ns_genSam {
+
+const long trN = 20;
+const long readLen = 50;
+const char bases[] = "ACGT";
+
+boost::random::mt11213b rng_mt;
+boost::random::uniform_01<double> uniformDistribution;
+boost::random::normal_distribution<double> normalDistribution;
+
+long uniform(long n){//{{{
+   return (long)(uniformDistribution(rng_mt) * n) % n;
+}//}}}
+
+string mutate(const string &seq){//{{{
+   string res = seq;
+   for(long i = 0; i < (long)res.size(); i++)
+      if(uniformDistribution(rng_mt) < 0.01)res[i] = bases[uniform(4)];
+   return res;
+}//}}}
+
+} // namespace ns_genSam
+
+using namespace ns_genSam;
+
+int main(int argc, char *argv[]){
+   if(argc < 2){
+      error("Usage: %s <outPrefix> [readsN] [paired] [seed] [fragMu]\n", argv[0]);
+      return 1;
+   }
+   string prefix = argv[1];
+   long readsN = (argc > 2) ? atol(argv[2]) : 3000;
+   bool paired = (argc > 3) ? (atol(argv[3]) != 0) : true;
+   rng_mt.seed((argc > 4) ? atol(argv[4]) : 1);
+   double fragMu = (argc > 5) ? atof(argv[5]) : 5.5;
+   long t, r, i, a;
+   vector<string> trs(trN);
+   ofstream faF((prefix + ".fa").c_str());
+   ofstream samF((prefix + ".sam").c_str());
+   if((!faF.is_open()) || (!samF.is_open())){
+      error("Unable to open output files %s.fa and %s.sam.\n", prefix.c_str(), prefix.c_str());
+      return 1;
+   }
+   for(t = 0; t < trN; t++){
+      trs[t].resize(1000 + uniform(8001));
+      for(i = 0; i < (long)trs[t].size(); i++)trs[t][i] = bases[uniform(4)];
+      faF<<">tr"<<t<<"\n"<<trs[t]<<"\n";
+   }
+   faF.close();
+   samF<<"@HD\tVN:1.0\n";
+   for(t = 0; t < trN; t++)samF<<"@SQ\tSN:tr"<<t<<"\tLN:"<<trs[t].size()<<"\n";
+   string quality(readLen, 'I'), seq1, seq2;
+   long fragLen, pos, alignmentsN;
+   for(r = 0; r < readsN; r++){
+      if(uniformDistribution(rng_mt) < 0.01){
+         if(paired){
+            samF<<"r"<<r<<"\t77\t*\t0\t0\t*\t*\t0\t0\t"<<string(readLen, 'A')<<"\t"<<quality<<"\n";
+            samF<<"r"<<r<<"\t141\t*\t0\t0\t*\t*\t0\t0\t"<<string(readLen, 'A')<<"\t"<<quality<<"\n";
+         }else{
+            samF<<"r"<<r<<"\t4\t*\t0\t0\t*\t*\t0\t0\t"<<string(readLen, 'A')<<"\t"<<quality<<"\n";
+         }
+         continue;
+      }
+      t = uniform(trN);
+      fragLen = (long)exp(fragMu + 0.2 * normalDistribution(rng_mt));
+      if(fragLen < readLen)fragLen = readLen;
+      if((long)trs[t].size() < fragLen)fragLen = trs[t].size();
+      pos = uniform(trs[t].size() - fragLen + 1);
+      seq1 = mutate(trs[t].substr(pos, readLen));
+      seq2 = mutate(trs[t].substr(pos + fragLen - readLen, readLen));
+      bool reverse = (uniformDistribution(rng_mt) < 0.5);
+      alignmentsN = (uniformDistribution(rng_mt) < 0.33) ? 2 : 1;
+      for(a = 0; a < alignmentsN; a++){
+         if(a > 0){
+            // Same read aligned to another transcript.
+            t = (t + 1 + uniform(trN - 1)) % trN;
+            if((long)trs[t].size() < fragLen)fragLen = trs[t].size();
+            pos = uniform(trs[t].size() - fragLen + 1);
+         }
+         long pos2 = pos + fragLen - readLen;
+         if(paired){
+            samF<<"r"<<r<<"\t99\ttr"<<t<<"\t"<<pos + 1<<"\t255\t"<<readLen<<"M\t=\t"<<pos2 + 1<<"\t"<<fragLen
+                <<"\t"<<seq1<<"\t"<<quality<<"\n";
+            samF<<"r"<<r<<"\t147\ttr"<<t<<"\t"<<pos2 + 1<<"\t255\t"<<readLen<<"M\t=\t"<<pos + 1<<"\t"<<-fragLen
+                <<"\t"<<seq2<<"\t"<<quality<<"\n";
+         }else if(!reverse){
+            samF<<"r"<<r<<"\t0\ttr"<<t<<"\t"<<pos + 1<<"\t255\t"<<readLen<<"M\t*\t0\t0\t"<<seq1<<"\t"<<quality<<"\n";
+         }else{
+            samF<<"r"<<r<<"\t16\ttr"<<t<<"\t"<<pos2 + 1<<"\t255\t"<<readLen<<"M\t*\t0\t0\t"<<seq2<<"\t"<<quality<<"\n";
+         }
+      }
+   }
+   samF.close();
+   // Convert to BAM.
+   samfile_t *samIn = samopen((prefix + ".sam").c_str(), "r", NULL);
+   if(samIn == NULL){
+      error("Unable to read %s.sam.\n", prefix.c_str());
+      return 1;
+   }
+   samfile_t *bamOut = samopen((prefix + ".bam").c_str(), "wb", samIn->header);
+   if(bamOut == NULL){
+      error("Unable to open output file %s.bam.\n", prefix.c_str());
+      samclose(samIn);
+      return 1;
+   }
+   bam1_t *b = bam_init1();
+   while(samread(samIn, b) >= 0)samwrite(bamOut, b);
+   bam_destroy1(b);
+   samclose(bamOut);
+   samclose(samIn);
+   return 0;
+}
@@ -0,0 +1,24 @@
+#!/bin/sh
+# Runs estimateVBExpression on a generated .prob file with and without the
+# active set mode and compares the mean theta of the .m_alphas files. Both
+# runs use a tight optimisation limit, so that the difference is within the
+# convergence error (bound 1e-4 relative plus 1e-8 absolute). activeTol 1e10
+# freezes all rows after every full pass (empty active set).
+
+. `dirname $0`/common.sh
+
+gen_data data 20000 40 2
+run(){
+   name=$1
+   shift
+   $BIN/estimateVBExpression -o $DIR/$name -s 1 --optLimit 1e-9 "$@" $DIR/data.prob \
+      > $DIR/$name.log 2>&1 || { cat $DIR/$name.log; exit 1; }
+}
+run full
+for tol in 1e-8 1e-4 1e10; do
+   for method in FR steepest; do
+      run active$method$tol --activeTol $tol -m $method
+      max_diff "$method activeTol $tol" $DIR/full.m_alphas $DIR/active$method$tol.m_alphas 1 1e-4 1e-8 41
+   done
+done
+echo "testActiveSet: OK"
@@ -0,0 +1,132 @@
+/*
+ * Test of AllReduce with several processes connected over localhost TCP.
+ *
+ * The ranks are forked processes of the test:
+ *  - ranks sum and max arrays and all get the exact results,
+ *  - rank 0 gives up after the timeout when a rank does not connect,
+ *  - a rank sending to rank 0 which already exited gets an error and is not
+ *    killed by SIGPIPE.
+ */
+#include<cstdio>
+#include<cstdlib>
+#include<sys/types.h>
+#include<sys/wait.h>
+#include<unistd.h>
+#include<vector>
+
+using namespace std;
+
+#include "AllReduce.h"
+
+#include "common.h"
+
+namespace ns_testAllReduce {
+
+const long ranksN = 4;
+const long valuesN = 100000;
+
+string address(long test){//{{{
+   char name[64];
+   // Port depends on pid so that concurrent runs do not collide.
+   sprintf(name, "localhost:%ld", 20000 + ((long)getpid() * 3 + test) % 40000);
+   return name;
+}//}}}
+
+// Each rank sums values v[i] = rank * valuesN + i and takes maximum of
+// (rank - i % ranksN)^2. Returns process exit code.
+int reduceRank(const string &addr, long rank){//{{{
+   AllReduce reducer;
+   if(!reducer.init(addr, rank, ranksN, 10))return 1;
+   vector<double> sum(valuesN), mx(valuesN);
+   long i, r;
+   for(i = 0; i < valuesN; i++){
+      sum[i] = rank * valuesN + i;
+      mx[i] = (double)((rank - i % ranksN) * (rank - i % ranksN));
+   }
+   if((!reducer.sum(&sum[0], valuesN)) || (!reducer.max(&mx[0], valuesN)))return 1;
+   long wrong = 0;
+   for(i = 0; i < valuesN; i++){
+      double expSum = 0, expMax = 0;
+      for(r = 0; r < ranksN; r++){
+         expSum += r * valuesN + i;
+         if((r - i % ranksN) * (r - i % ranksN) > expMax)expMax = (double)((r - i % ranksN) * (r - i % ranksN));
+      }
+      if((sum[i] != expSum) || (mx[i] != expMax))wrong++;
+   }
+   if(wrong > 0){
+      error("Rank %ld: %ld wrong values.\n", rank, wrong);
+      return 1;
+   }
+   return reducer.good() ? 0 : 1;
+}//}}}
+
+// Rank 0 waits for ranksN processes but only one connects.
+int timeoutRank(const string &addr, long rank){//{{{
+   AllReduce reducer;
+   bool ok = reducer.init(addr, rank, ranksN, 2);
+   if(rank == 0)return ok ? 1 : 0;
+   // Connected rank waits until rank 0 gives up.
+   double x = 1;
+   return (ok && (!reducer.sum(&x, 1))) ? 0 : 1;
+}//}}}
+
+// Rank 0 exits right after connecting, rank 1 then sends a large array.
+int closedRank(const string &addr, long rank){//{{{
+   AllReduce reducer;
+   if(!reducer.init(addr, rank, 2, 10))return 1;
+   if(rank == 0)return 0;
+   usleep(200000);
+   vector<double> x(10 * valuesN, 1);
+   for(long k = 0; k < 10; k++)
+      if(!reducer.sum(&x[0], x.size()))return 0;
+   return 1;
+}//}}}
+
+// Run ranks ranks of test in forked processes, returns false if any failed.
+bool runRanks(const char *name, int (*rankF)(const string &, long), long test, long ranks){//{{{
+   string addr = address(test);
+   vector<pid_t> pids(ranks);
+   long r, failed = 0;
+   for(r = 0; r < ranks; r++){
+      pids[r] = fork();
+      if(pids[r] == 0){
+         // Rank which hangs is killed by SIGALRM.
+         alarm(30);
+         _exit(rankF(addr, r));
+      }
+   }
+   for(r = 0; r < ranks; r++){
+      int status;
+      if(pids[r] < 0){
+         failed++;
+         continue;
+      }
+      waitpid(pids[r], &status, 0);
+      if(WIFSIGNALED(status)){
+         error("%s: rank %ld killed by signal %d.\n", name, r, WTERMSIG(status));
+         failed++;
+      }else if(WEXITSTATUS(status) != 0){
+         error("%s: rank %ld failed.\n", name, r);
+         failed++;
+      }
+   }
+   message("%s: %s\n", name, (failed == 0) ? "OK" : "FAILED");
+   return failed == 0;
+}//}}}
+
+} // namespace ns_testAllReduce
+
+using namespace ns_testAllReduce;
+
+int main(){
+   bool ok = true;
+   ok = runRanks("reduce", reduceRank, 0, ranksN) && ok;
+   ok = runRanks("timeout", timeoutRank, 1, 2) && ok;
+   ok = runRanks("closed peer", closedRank, 2, 2) && ok;
+   if(!ok){
+      error("testAllReduce: FAILED\n");
+      return 1;
+   }
+   message("testAllReduce: OK\n");
+   return 0;
+}
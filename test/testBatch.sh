@@ -0,0 +1,32 @@
+#!/bin/sh
+# Runs estimateVBExpression in batch mode on three generated .prob files,
+# with two concurrent samples and with all three concurrent under a memory
+# limit which lets only one of them be optimised at a time, and checks that
+# the .m_alphas files are the same as of separate runs.
+
+. `dirname $0`/common.sh
+
+for s in 1 2 3; do
+   gen_data data$s 20000 40 $s
+   $BIN/estimateVBExpression -o $DIR/single$s -s 1 $DIR/data$s.prob \
+      > $DIR/single$s.log 2>&1 || { cat $DIR/single$s.log; exit 1; }
+done
+
+# batch <name> <options...>
+batch(){
+   name=$1
+   shift
+   for s in 1 2 3; do echo "$DIR/data$s.prob $name$s"; done > $DIR/$name.manifest
+   $BIN/estimateVBExpression -o $DIR/ -s 1 -P 4 --batch "$@" $DIR/$name.manifest \
+      > $DIR/$name.log 2>&1 || { cat $DIR/$name.log; exit 1; }
+   for s in 1 2 3; do
+      if ! cmp -s $DIR/single$s.m_alphas $DIR/$name$s.m_alphas; then
+         echo "FAIL $name: sample $s differs from separate run"
+         exit 1
+      fi
+   done
+   echo "testBatch: $name OK"
+}
+batch jobs2 --batchJobs 2
+batch memLimit --batchJobs 3 --memLimit 1
+echo "testBatch: OK"
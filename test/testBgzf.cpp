@@ -0,0 +1,155 @@
+/*
+ * Test of seeking in BGZF files with and without the multi-threaded reader.
+ *
+ * A BGZF file with lines of random length spanning many blocks is written
+ * and the virtual offset (bgzf_tell) of each line is recorded. The file is
+ * then read with 0 (serial) and 4 reading threads:
+ *  - reading sequentially, bgzf_tell has to give the recorded offsets and
+ *    lines have to be the same as written,
+ *  - after bgzf_seek to the offset of a random line, the line has to be read
+ *    and bgzf_tell has to give the offset of the following line,
+ *  - bgzf_seek to an invalid offset has to fail and reading has to continue
+ *    with the line following the last one read.
+ */
+#include<cstdio>
+#include<cstdlib>
+#include<string>
+#include<unistd.h>
+#include<vector>
+
+#include "boost/random/mersenne_twister.hpp"
+
+using namespace std;
+
+#include "samtools/bgzf.h"
+
+#include "common.h"
+
+namespace ns_testBgzf {
+
+const long linesN = 50000;
+const long seeksN = 500;
+
+boost::random::mt19937 rng_mt(1);
+
+vector<string> lines;
+vector<int64_t> offsets;
+
+// Write lines into BGZF file, record their virtual offsets.
+bool writeFile(const char *name){//{{{
+   BGZF *fp = bgzf_open(name, "w");
+   if(fp == NULL){
+      error("Unable to open %s.\n", name);
+      return false;
+   }
+   char buf[32];
+   lines.resize(linesN);
+   offsets.resize(linesN);
+   for(long i = 0; i < linesN; i++){
+      sprintf(buf, "%ld ", i);
+      lines[i] = buf + string(rng_mt() % 80, 'a' + i % 26) + "\n";
+      offsets[i] = bgzf_tell(fp);
+      bgzf_write(fp, lines[i].c_str(), lines[i].size());
+   }
+   return bgzf_close(fp) == 0;
+}//}}}
+
+// Read line i at the current position, returns false if it differs or the
+// position is not the offset of the next line (the end of the last block is
+// the start of the next one for the reader, so the end of file is not checked).
+bool readLine(BGZF *fp, long i, const char *what){//{{{
+   char buf[128];
+   ssize_t len = lines[i].size();
+   if((bgzf_read(fp, buf, len) != len) || (lines[i].compare(0, len, buf, len) != 0)){
+      error("%s: line %ld differs.\n", what, i);
+      return false;
+   }
+   if((i + 1 < linesN) && (bgzf_tell(fp) != offsets[i + 1])){
+      error("%s: offset after line %ld is %lld instead of %lld.\n", what, i, (long long)bgzf_tell(fp), (long long)offsets[i + 1]);
+      return false;
+   }
+   return true;
+}//}}}
+
+// Returns number of failed checks reading with threadsN threads.
+long checkRead(const char *name, int threadsN){//{{{
+   long i, failed = 0;
+   BGZF *fp = bgzf_open(name, "r");
+   if(fp == NULL){
+      error("Unable to open %s.\n", name);
+      return 1;
+   }
+   if((threadsN > 0) && (bgzf_mt(fp, threadsN, 4) != 0)){
+      error("Unable to start %d reading threads.\n", threadsN);
+      bgzf_close(fp);
+      return 1;
+   }
+   // Sequential reading.
+   for(i = 0; i < linesN; i++){
+      if(bgzf_tell(fp) != offsets[i]){
+         error("sequential: offset of line %ld is %lld instead of %lld.\n", i, (long long)bgzf_tell(fp), (long long)offsets[i]);
+         failed++;
+         break;
+      }
+      if(!readLine(fp, i, "sequential")){
+         failed++;
+         break;
+      }
+   }
+   // Random seeks, reading two lines after each.
+   for(long s = 0; s < seeksN; s++){
+      i = rng_mt() % (linesN - 1);
+      if((bgzf_seek(fp, offsets[i], SEEK_SET) != 0) || (!readLine(fp, i, "seek")) || (!readLine(fp, i + 1, "seek"))){
+         failed++;
+         break;
+      }
+   }
+   // Failed seek keeps the position.
+   if(bgzf_seek(fp, offsets[10], SEEK_SET) != 0)failed++;
+   for(i = 10; i < 1000; i++){
+      if(!readLine(fp, i, "before failed seek")){
+         failed++;
+         break;
+      }
+   }
+   if(bgzf_seek(fp, -(1LL << 16), SEEK_SET) == 0){
+      error("Seek to invalid offset did not fail.\n");
+      failed++;
+   }
+   for(i = 1000; i < linesN; i++){
+      if(!readLine(fp, i, "after failed seek")){
+         failed++;
+         break;
+      }
+   }
+   bgzf_close(fp);
+   message("testBgzf: %d threads, %ld failed checks\n", threadsN, failed);
+   return failed;
+}//}}}
+
+} // namespace ns_testBgzf
+
+using namespace ns_testBgzf;
+
+int main(){
+   char name[] = "/tmp/testBgzfXXXXXX";
+   int fd = mkstemp(name);
+   if(fd < 0){
+      error("Unable to create temporary file.\n");
+      return 1;
+   }
+   close(fd);
+   long failed = 0;
+   if(!writeFile(name))failed++;
+   else{
+      message("testBgzf: %ld lines, last block at byte %lld\n", linesN, (long long)(offsets[linesN - 1] >> 16));
+      failed += checkRead(name, 0) + checkRead(name, 4);
+   }
+   remove(name);
+   if(failed > 0){
+      error("testBgzf: FAILED\n");
+      return 1;
+   }
+   message("testBgzf: OK\n");
+   return 0;
+}
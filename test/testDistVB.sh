@@ -0,0 +1,40 @@
+#!/bin/sh
+# Runs estimateVBExpression distributed over three processes connected by a
+# Unix socket and over two processes connected by localhost TCP and compares
+# the mean theta of the .m_alphas file written by process 0 with a single
+# process run. The processes sum their parts in a different order than the
+# single process, so the bound is 1e-5 relative plus 1e-9 absolute.
+# In active set mode (--activeTol) each process freezes rows of its own reads,
+# which is compared with the same bound as testActiveSet.sh (1e-4 relative plus
+# 1e-8 absolute); the processes use two threads each.
+
+. `dirname $0`/common.sh
+
+gen_data data 20000 40 1
+VB="$BIN/estimateVBExpression -s 1 --optLimit 1e-9"
+$VB -o $DIR/single $DIR/data.prob > $DIR/single.log 2>&1 || { cat $DIR/single.log; exit 1; }
+
+# dist <name> <address> <processes> <relative> <absolute> <options...>
+dist(){
+   name=$1
+   address=$2
+   size=$3
+   rel=$4
+   abs=$5
+   shift 5
+   rank=1
+   while [ $rank -lt $size ]; do
+      $VB -o $DIR/$name "$@" --distAddress $address --distRank $rank --distSize $size $DIR/data.prob \
+         > $DIR/$name$rank.log 2>&1 &
+      rank=`expr $rank + 1`
+   done
+   $VB -o $DIR/$name "$@" --distAddress $address --distRank 0 --distSize $size $DIR/data.prob \
+      > $DIR/${name}0.log 2>&1 || { cat $DIR/${name}0.log; exit 1; }
+   wait
+   max_diff $name $DIR/single.m_alphas $DIR/$name.m_alphas 1 $rel $abs 41
+}
+dist unix $DIR/socket 3 1e-5 1e-9
+# Port depends on pid so that concurrent runs do not collide.
+dist tcp localhost:`expr 20000 + $$ % 40000` 2 1e-5 1e-9
+dist active $DIR/socket 3 1e-4 1e-8 -P 2 --activeTol 1e-4 -m FR
+echo "testDistVB: OK"
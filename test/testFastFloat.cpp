@@ -0,0 +1,101 @@
+/*
+ * Round-trip test of fastFloat against the C library.
+ *
+ * Random doubles (random bit patterns, so that all exponents are covered) and
+ * extreme values (subnormals, DBL_MIN, DBL_MAX, powers of ten from 1e-324 to
+ * 1e308 and their neighbours) are:
+ *  - formatted by formatDouble with precisions 0 to 16 in both notations, which
+ *    has to give the same string as snprintf,
+ *  - written with 17 significant digits and parsed by parseDouble, which has to
+ *    give the same value as strtod (the original double).
+ */
+#include<cfloat>
+#include<cmath>
+#include<cstdio>
+#include<cstdlib>
+#include<cstring>
+#include<stdint.h>
+#include<vector>
+
+#include "boost/random/mersenne_twister.hpp"
+
+using namespace std;
+
+#include "fastFloat.h"
+
+#include "common.h"
+
+namespace ns_testFastFloat {
+
+const long randomN = 200000;
+
+boost::random::mt19937 rng_mt(1);
+
+double randomDouble(){//{{{
+   uint64_t bits = ((uint64_t)rng_mt() << 32) | rng_mt();
+   double x;
+   memcpy(&x, &bits, sizeof(x));
+   return x;
+}//}}}
+
+// Returns number of conversions of x which differ from the C library.
+long check(double x){//{{{
+   char fast[64], ref[64];
+   long wrong = 0, precision, len;
+   for(precision = 0; precision <= 16; precision++){
+      for(int scientific = 0; scientific < 2; scientific++){
+         len = ns_fastFloat::formatDouble(x, precision, scientific, fast);
+         snprintf(ref, sizeof(ref), scientific ? "%.*e" : "%.*g", (int)precision, x);
+         if((strcmp(fast, ref) != 0) || (len != (long)strlen(ref))){
+            if(wrong == 0)error("Formatting %.17g with precision %ld (%s): %s instead of %s.\n", x, precision, scientific ? "e" : "g", fast, ref);
+            wrong++;
+         }
+      }
+   }
+   if(x != x)return wrong;
+   snprintf(ref, sizeof(ref), "%.17g", x);
+   double val;
+   const char *end = ns_fastFloat::parseDouble(ref, ref + strlen(ref), &val);
+   if((end != ref + strlen(ref)) || (memcmp(&val, &x, sizeof(x)) != 0)){
+      error("Parsing %s gives %.17g.\n", ref, val);
+      wrong++;
+   }
+   return wrong;
+}//}}}
+
+} // namespace ns_testFastFloat
+
+using namespace ns_testFastFloat;
+
+int main(){
+   long i, wrong = 0, valuesN = 0;
+   vector<double> extreme;
+   extreme.push_back(0);
+   extreme.push_back(DBL_MIN);
+   extreme.push_back(DBL_MAX);
+   extreme.push_back(DBL_EPSILON);
+   extreme.push_back(nextafter(0.0, 1.0));
+   extreme.push_back(nextafter(DBL_MIN, 0.0));
+   extreme.push_back(HUGE_VAL);
+   for(i = -324; i <= 308; i++){
+      char num[16];
+      sprintf(num, "1e%ld", i);
+      double p = strtod(num, NULL);
+      extreme.push_back(p);
+      extreme.push_back(nextafter(p, 0.0));
+      extreme.push_back(nextafter(p, HUGE_VAL));
+      extreme.push_back(5 * p);
+   }
+   for(i = 0; i < (long)extreme.size(); i++){
+      wrong += check(extreme[i]) + check(-extreme[i]);
+      valuesN += 2;
+   }
+   for(i = 0; i < randomN; i++, valuesN++)wrong += check(randomDouble());
+   message("testFastFloat: %ld values, %ld wrong conversions\n", valuesN, wrong);
+   if(wrong > 0){
+      error("testFastFloat: FAILED\n");
+      return 1;
+   }
+   message("testFastFloat: OK\n");
+   return 0;
+}
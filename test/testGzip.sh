@@ -0,0 +1,66 @@
+#!/bin/sh
+# Checks reading and writing of compressed files:
+#  - estimateVBExpression gives the same estimates for a .prob file compressed
+#    by gzip as for the plain file,
+#  - parseAlignment writes BGZF for an output name ending with .gz, with the
+#    same content as the plain output, and estimateVBExpression gives the
+#    same estimates for it,
+#  - estimateExpression --gzip writes BGZF samples with the same values as
+#    without it and getVariance reads them (by virtual offsets) with the same
+#    result.
+# Headers are not compared, they contain the file names.
+
+. `dirname $0`/common.sh
+
+# same_data <name> <file> <reference file>
+same_data(){
+   zcat -f $DIR/$2 | grep -v '^#' > $DIR/same.a
+   zcat -f $DIR/$3 | grep -v '^#' > $DIR/same.b
+   if ! cmp -s $DIR/same.a $DIR/same.b; then
+      echo "FAIL $1: $2 differs from $3"
+      exit 1
+   fi
+   echo "testGzip: $1 OK"
+}
+
+# bgzf <file>
+bgzf(){
+   # BGZF blocks are gzip members with the BC extra field.
+   if [ "`od -An -c -j12 -N2 $DIR/$1 | tr -d ' '`" != "BC" ]; then
+      echo "FAIL $1 is not BGZF"
+      exit 1
+   fi
+}
+
+# run <program> <name> <options...>
+run(){
+   program=$1
+   name=$2
+   shift 2
+   $BIN/$program -o $DIR/$name "$@" > $DIR/$name.log 2>&1 || { cat $DIR/$name.log; exit 1; }
+}
+
+gen_data data 20000 40 1
+gzip -c $DIR/data.prob > $DIR/gzip.prob.gz
+run estimateVBExpression plain -s 1 $DIR/data.prob
+run estimateVBExpression gzip -s 1 $DIR/gzip.prob.gz
+same_data "gzip input" gzip.m_alphas plain.m_alphas
+
+$BIN/test/genSam $DIR/sam 3000 1 || exit 1
+run parseAlignment sam.prob -f SAM -s $DIR/sam.fa $DIR/sam.sam
+run parseAlignment sam.prob.gz -f SAM -s $DIR/sam.fa $DIR/sam.sam
+bgzf sam.prob.gz
+same_data "BGZF output" sam.prob.gz sam.prob
+run estimateVBExpression samPlain -s 1 $DIR/sam.prob
+run estimateVBExpression samBgzf -s 1 $DIR/sam.prob.gz
+same_data "BGZF input" samBgzf.m_alphas samPlain.m_alphas
+
+EE="-s 1 --MCMC_burnIn 200 --MCMC_samplesN 200 --MCMC_samplesSave 50 $DIR/data.prob"
+run estimateExpression ee $EE
+run estimateExpression eeGzip --gzip $EE
+bgzf eeGzip.theta.gz
+same_data "samples" eeGzip.theta.gz ee.theta
+run getVariance variance $DIR/ee.theta
+run getVariance varianceGzip $DIR/eeGzip.theta.gz
+same_data "BGZF samples" varianceGzip variance
+echo "testGzip: OK"
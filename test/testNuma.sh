@@ -0,0 +1,49 @@
+#!/bin/sh
+# Checks that NUMA placement does not change results: estimateVBExpression
+# with threads pinned close and spread (rows placed on the nodes of their
+# threads) gives the same .m_alphas file as with unpinned threads and
+# estimateExpression with pinned threads and per node copies of the
+# alignments (--numaReplicas) gives the same posterior means. --numaReplicas
+# without pinned threads is ignored with a warning.
+# Timing of the variants is measured by benchNuma.sh (make bench-numa).
+
+. `dirname $0`/common.sh
+
+gen_data data 20000 40 1
+
+# run <program> <name> <options...>
+run(){
+   program=$1
+   name=$2
+   shift 2
+   $BIN/$program -o $DIR/$name -s 1 "$@" $DIR/data.prob > $DIR/$name.log 2>&1 || { cat $DIR/$name.log; exit 1; }
+}
+
+# same <file> <reference file>
+same(){
+   if ! cmp -s $DIR/$1 $DIR/$2; then
+      echo "FAIL $1 differs from $2"
+      exit 1
+   fi
+   echo "testNuma: $1 OK"
+}
+
+for pin in none close spread; do
+   run estimateVBExpression vb_$pin -P 4 --pinThreads $pin
+done
+same vb_close.m_alphas vb_none.m_alphas
+same vb_spread.m_alphas vb_none.m_alphas
+
+EE="-P 2 --MCMC_chainsN 2 --MCMC_burnIn 200 --MCMC_samplesN 200 --MCMC_samplesSave 50"
+run estimateExpression ee_none $EE
+run estimateExpression ee_spread $EE --pinThreads spread
+run estimateExpression ee_replicas $EE --pinThreads spread --numaReplicas
+same ee_spread.thetaMeans ee_none.thetaMeans
+same ee_replicas.thetaMeans ee_none.thetaMeans
+run estimateExpression ee_unpinned $EE --numaReplicas
+same ee_unpinned.thetaMeans ee_none.thetaMeans
+if ! grep -q "numaReplicas is ignored" $DIR/ee_unpinned.log; then
+   echo "FAIL --numaReplicas without --pinThreads was not warned about"
+   exit 1
+fi
+echo "testNuma: OK"
@@ -0,0 +1,175 @@
+/*
+ * Test of 64-bit alignment offsets in TagAlignments and SimpleSparse.
+ *
+ * Usage: testOffsets [alignmentsN]
+ *
+ * TagAlignments is filled with alignmentsN generated alignments (default 1e6)
+ * and every read offset, transcript id and probability is checked against the
+ * generator. With alignmentsN above 2^31 (make test-large) this exercises the
+ * 64-bit read offsets; the alignments are stored quantised, which needs about
+ * 7 bytes per alignment (15GB for 2.2e9 alignments).
+ *
+ * SimpleSparse is always tested with rows placed after offset 2^31: the value
+ * and column arrays are reserved with mmap(MAP_NORESERVE) and only the pages
+ * holding the rows are touched, so the test needs little memory.
+ */
+#include<cmath>
+#include<cstdlib>
+#include<sys/mman.h>
+#include<vector>
+
+using namespace std;
+
+#include "SimpleSparse.h"
+#include "TagAlignments.h"
+
+#include "common.h"
+
+namespace ns_testOffsets {
+
+long failedN = 0;
+
+void check(bool ok, const char *what, long i = -1){//{{{
+   if(ok)return;
+   if(failedN < 10){
+      if(i >= 0){error("Check failed: %s (%ld).\n", what, i);}
+      else {error("Check failed: %s.\n", what);}
+   }
+   failedN++;
+}//}}}
+
+// Generated read r has alignmentsN(r) alignments to transcripts
+// (r + j) % trM with probabilities proportional to j+1.
+const long trM = 1000;
+const long maxAlignments = 16;
+long alignmentsN(long r){ return 1 + (r * 7) % maxAlignments; }
+
+void testTagAlignments(long total){//{{{
+   long r, j, k, readsN = 0, hitsN = 0;
+   for(readsN = 0; hitsN < total; readsN++)hitsN += alignmentsN(readsN);
+   bool quantised = (hitsN > 100000000);
+   message("TagAlignments: %ld reads with %ld alignments (%s storage).\n",
+           readsN, hitsN, quantised ? "quantised" : "double");
+   TagAlignments *alignments = new TagAlignments(true,
+      quantised ? ns_tagAlignments::QUANTISED_STORAGE : ns_tagAlignments::DOUBLE_STORAGE);
+   alignments->init(readsN, hitsN, trM);
+   for(r = 0; r < readsN; r++){
+      k = alignmentsN(r);
+      for(j = 0; j < k; j++)alignments->pushAlignment((r + j) % trM, j + 1);
+      alignments->pushRead();
+   }
+   long M, Nreads, Ntotal;
+   alignments->finalizeRead(&M, &Nreads, &Ntotal);
+   check(M == trM, "number of transcripts");
+   check(Nreads == readsN, "number of reads");
+   check(Ntotal == hitsN, "number of alignments");
+   int_least64_t offset = 0;
+   double lProb, lNorm, tolerance = quantised ? 0.5 / ns_tagAlignments::quantScale + 1e-9 : 1e-12;
+   for(r = 0; r < readsN; r++){
+      check(alignments->getReadsI(r) == offset, "read offset", r);
+      k = alignmentsN(r);
+      lNorm = quantised ? log(k * (k + 1) / 2.0) : 0;
+      for(j = 0; j < k; j++){
+         check(alignments->getTrId(offset + j) == (r + j) % trM, "transcript id", offset + j);
+         lProb = log(j + 1.0) - lNorm;
+         check(fabs(alignments->getProb(offset + j) - lProb) <= tolerance, "probability", offset + j);
+      }
+      offset += k;
+   }
+   check(alignments->getReadsI(readsN) == hitsN, "end offset");
+   message("TagAlignments: last offset %ld.\n", (long)alignments->getReadsI(readsN));
+   delete alignments;
+}//}}}
+
+template<typename Real>
+Real *reserveArray(long n){//{{{
+   void *arr = mmap(NULL, n * sizeof(Real), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+   if(arr == MAP_FAILED){
+      error("Cannot reserve %ld bytes of address space.\n", (long)(n * sizeof(Real)));
+      exit(1);
+   }
+   return (Real*)arr;
+}//}}}
+
+void testSimpleSparse(){//{{{
+   // Rows 0 and 2 are identical, so that collapseRows() merges them.
+   const long N = 6, M = 5, rowLen[N] = {3, 2, 3, 1, 2, 3};
+   const int_least64_t first = (1LL << 31) + 7;
+   long r, i, m, b, T = 0;
+   for(r = 0; r < N; r++)T += rowLen[r];
+   SimpleSparseF *beta = new SimpleSparseF(N, M, T);
+   SimpleSparseF *res = new SimpleSparseF(N, M, T);
+   // Swap in arrays with rows placed after offset 2^31.
+   float *betaVal = beta->val, *resVal = res->val;
+   int_least32_t *betaCol = beta->col, *resCol = res->col;
+   int_least64_t *resStart = res->rowStart;
+   double *resWeight = res->rowWeight;
+   int_least64_t end = first + T;
+   beta->val = reserveArray<float>(end);
+   beta->col = reserveArray<int_least32_t>(end);
+   res->val = reserveArray<float>(end);
+   beta->T = res->T = end;
+   res->col = beta->col;
+   res->rowStart = beta->rowStart;
+   res->rowWeight = beta->rowWeight;
+   vector<double> lse(N), colSum(M, 0);
+   beta->rowStart[0] = first;
+   for(r = 0; r < N; r++){
+      beta->rowStart[r + 1] = beta->rowStart[r] + rowLen[r];
+      lse[r] = 0;
+      b = (r == 2) ? 0 : r;
+      for(i = 0; i < rowLen[r]; i++){
+         beta->col[beta->rowStart[r] + i] = (b + i) % M;
+         beta->val[beta->rowStart[r] + i] = log(b + i + 1.0);
+         lse[r] += b + i + 1.0;
+      }
+      lse[r] = log(lse[r]);
+   }
+   check(beta->rowStart[N] == end, "end offset");
+   for(r = 0; r < N; r++){
+      check(fabs(beta->logSumExpVal(beta->rowStart[r], beta->rowStart[r + 1]) - lse[r]) < 1e-6,
+            "logSumExpVal", r);
+      for(i = beta->rowStart[r]; i < beta->rowStart[r + 1]; i++)
+         colSum[beta->col[i]] += exp(beta->val[i] - lse[r]);
+   }
+   beta->softmax(res);
+   vector<double> sums(N), cols(M);
+   res->sumRows(&sums[0]);
+   for(r = 0; r < N; r++)check(fabs(sums[r] - 1) < 1e-6, "softmax row sum", r);
+   res->sumCols(&cols[0]);
+   for(m = 0; m < M; m++)check(fabs(cols[m] - colSum[m]) < 1e-6, "column sum", m);
+   // Collapsing moves the rows to the start of the arrays.
+   check(beta->collapseRows() == N - 1, "collapsed rows");
+   check((beta->rowStart[0] == 0) && (beta->T == T - rowLen[2]), "collapsed offsets");
+   check(beta->rowWeight[0] == 2, "collapsed row weight");
+   check(fabs(beta->logSumExpVal(beta->rowStart[1], beta->rowStart[2]) - lse[1]) < 1e-6, "collapsed row");
+   message("SimpleSparse: rows at offsets %ld to %ld.\n", (long)first, (long)end);
+   munmap(beta->val, end * sizeof(float));
+   munmap(beta->col, end * sizeof(int_least32_t));
+   munmap(res->val, end * sizeof(float));
+   beta->val = betaVal;
+   beta->col = betaCol;
+   res->val = resVal;
+   res->col = resCol;
+   res->rowStart = resStart;
+   res->rowWeight = resWeight;
+   delete res;
+   delete beta;
+}//}}}
+
+} // namespace ns_testOffsets
+
+using namespace ns_testOffsets;
+
+int main(int argc, char *argv[]){
+   long total = 1000000;
+   if(argc > 1)total = atol(argv[1]);
+   testTagAlignments(total);
+   testSimpleSparse();
+   if(failedN > 0){
+      error("testOffsets: %ld checks failed.\n", failedN);
+      return 1;
+   }
+   message("testOffsets: OK\n");
+   return 0;
+}
@@ -0,0 +1,127 @@
+#!/bin/sh
+# Runs parseAlignment on generated paired-end and single-end SAM files in
+# several modes and checks that the .prob files do not change:
+#  - probabilities computed by the pipeline with 4 threads are the same as
+#    with 1 thread,
+#  - bias model trained with 4 threads gives probabilities within 1e-6
+#    (relative) of the ones trained with 1 thread; merged accumulators sum
+#    in different order, so the last digits may differ,
+#  - BAM input (read by several threads with -P 4) gives the same
+#    probabilities as the SAM file with uniform model and within 1e-6 of
+#    1 thread with bias model,
+#  - --singlePass gives the same probabilities as reading the file twice and
+#    removes its spill file,
+#  - bias model trained on a sample larger than the number of fragments, or
+#    with tolerance that is never reached, is the same as the full one; a
+#    sample of 1000 fragments gives the same model with 1 and 4 threads and
+#    with large tolerance training stops at the second checkpoint (the first
+#    one has no previous profile to compare with),
+#  - model saved with --saveModel and used with --loadModel gives the same
+#    probabilities and model with another format version is rejected,
+#  - with fragments of about 4000 bases, for which weight norms of the longest
+#    fragments are computed directly instead of being tabulated, probabilities
+#    are finite and the same with 1 and 4 threads.
+# On a machine with fewer CPUs -P is capped and the checks compare serial runs.
+
+. `dirname $0`/common.sh
+
+# run <data> <name> <options...>
+run(){
+   data=$1
+   name=$2
+   shift 2
+   $BIN/parseAlignment -f SAM -s $DIR/$data.fa -o $DIR/$data.$name.prob "$@" $DIR/$data.sam \
+      > $DIR/$data.$name.log 2>&1 || { cat $DIR/$data.$name.log; exit 1; }
+}
+
+# runBam <data> <name> <options...>
+runBam(){
+   data=$1
+   name=$2
+   shift 2
+   $BIN/parseAlignment -f BAM -s $DIR/$data.fa -o $DIR/$data.$name.prob "$@" $DIR/$data.bam \
+      > $DIR/$data.$name.log 2>&1 || { cat $DIR/$data.$name.log; exit 1; }
+}
+
+# same <data> <name> <reference name>
+same(){
+   if ! cmp -s $DIR/$1.$2.prob $DIR/$1.$3.prob; then
+      echo "FAIL $1: $2 differs from $3"
+      exit 1
+   fi
+   echo "testParseAlignment: $1 $2 OK"
+}
+
+# close <data> <name> <reference name> <relative tolerance>
+close(){
+   awk -v tol=$4 -v name="$1 $2" -v ref=$DIR/$1.$3.prob '
+      /^#/ { next }
+      { while(((ok = getline line < ref) > 0) && (line ~ /^#/));
+        if(ok <= 0){ print "FAIL " name ": more reads"; bad = 1; exit }
+        n = split(line, b, " ");
+        if((n != NF) || ($1 != b[1])){ print "FAIL " name ": read " $1 " differs"; bad = 1; exit }
+        for(i = 3; i < NF; i += 2){
+           if($i != b[i]){ print "FAIL " name ": read " $1 " alignments differ"; bad = 1; exit }
+           d = $(i + 1) - b[i + 1]; if(d < 0) d = -d;
+           m = (b[i + 1] < 0) ? -b[i + 1] : b[i + 1];
+           if(d > maxD) maxD = d;
+           if((d > tol * m) && (!bad)){ print "FAIL " name ": read " $1 " log probabilities " $(i + 1) " " b[i + 1]; bad = 1 }
+        } }
+      END { if((!bad) && ((getline line < ref) > 0)){ print "FAIL " name ": fewer reads"; bad = 1 }
+            print "testParseAlignment: " name " max difference " maxD + 0; exit bad }' $DIR/$1.$2.prob
+}
+
+for data in paired single; do
+   paired=1
+   [ $data = paired ] || paired=0
+   $BIN/test/genSam $DIR/$data 3000 $paired || exit 1
+   run $data uniform1 --uniform -P 1
+   run $data uniform4 --uniform -P 4
+   same $data uniform4 uniform1
+   run $data bias1 -P 1
+   run $data bias4 -P 4
+   close $data bias4 bias1 1e-6 || exit 1
+   runBam $data bamUniform4 --uniform -P 4
+   same $data bamUniform4 uniform1
+   runBam $data bam1 -P 1
+   runBam $data bam4 -P 4
+   close $data bam4 bam1 1e-6 || exit 1
+   close $data bam4 bias1 1e-6 || exit 1
+   run $data singlePass -P 4 --singlePass --spillFile $DIR/$data.spill
+   same $data singlePass bias4
+   if [ -e $DIR/$data.spill ]; then
+      echo "FAIL $data: spill file not removed"
+      exit 1
+   fi
+   run $data sampleAll -P 4 --observeSample 1000000
+   same $data sampleAll bias4
+   run $data sample1 -P 1 --observeSample 1000 --seed 3
+   run $data sample4 -P 4 --observeSample 1000 --seed 3
+   close $data sample4 sample1 1e-6 || exit 1
+   run $data tolSmall -P 4 --observeTol 1e-300 --observeCheck 500
+   close $data tolSmall bias4 1e-6 || exit 1
+   run $data tolLarge -P 4 --observeTol 1 --observeCheck 500 -v
+   if ! grep -q "converged after 1000 reads" $DIR/$data.tolLarge.log; then
+      echo "FAIL $data: training did not stop at the second checkpoint"
+      exit 1
+   fi
+   run $data saved -P 4 --saveModel $DIR/$data.model
+   same $data saved bias4
+   run $data loaded -P 4 --loadModel $DIR/$data.model
+   same $data loaded bias4
+   # Format version follows the 8 byte magic and the byte order marker.
+   printf '\377' | dd of=$DIR/$data.model bs=1 seek=12 conv=notrunc 2> /dev/null
+   if $BIN/parseAlignment -f SAM -s $DIR/$data.fa -o $DIR/$data.bad.prob --loadModel $DIR/$data.model \
+      $DIR/$data.sam > $DIR/$data.bad.log 2>&1 || ! grep -q "format version" $DIR/$data.bad.log; then
+      echo "FAIL $data: model with another format version was not rejected"
+      exit 1
+   fi
+done
+
+$BIN/test/genSam $DIR/wide 1000 1 1 8.3 || exit 1
+run wide bias1 -P 1
+run wide bias4 -P 4
+close wide bias4 bias1 1e-6 || exit 1
+awk '!/^#/ { for(i = 4; i <= NF; i += 2) if(($i !~ /^-?[0-9]/) || ($i ~ /inf|nan/)) bad = 1 }
+   END { if(bad) print "FAIL wide: probabilities are not finite"; exit bad }' $DIR/wide.bias4.prob || exit 1
+echo "testParseAlignment: OK"
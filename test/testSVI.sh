@@ -0,0 +1,19 @@
+#!/bin/sh
+# Runs stochastic VB (--svi) on a generated .prob file and compares the mean
+# theta of the .m_alphas file with full VB. Stochastic VB only approaches the
+# optimum with the decreasing step size, so the bound is 5% relative plus
+# 1e-4 absolute (the mean theta of expressed transcripts is 1e-3 to 8e-2).
+
+. `dirname $0`/common.sh
+
+gen_data data 20000 40 2
+run(){
+   name=$1
+   shift
+   $BIN/estimateVBExpression -o $DIR/$name -s 1 "$@" $DIR/data.prob \
+      > $DIR/$name.log 2>&1 || { cat $DIR/$name.log; exit 1; }
+}
+run full --optLimit 1e-9
+run svi --svi --sviEpochs 10 --sviBatch 2000
+max_diff svi $DIR/full.m_alphas $DIR/svi.m_alphas 1 0.05 1e-4 41
+echo "testSVI: OK"
@@ -0,0 +1,19 @@
+#!/bin/sh
+# Runs estimateExpression on the same generated .prob file with double, float
+# and quantised probability storage and bounds the differences of posterior
+# mean theta. Float storage has to give the same means as double (up to
+# rounding), the quantised ones differ through the Monte Carlo error of the
+# diverging chains, so the bound is 2% relative plus 2e-4 absolute.
+
+. `dirname $0`/common.sh
+
+gen_data data 20000 40 1
+for storage in double float quantised; do
+   $BIN/estimateExpression -o $DIR/$storage --probStorage $storage -s 7 \
+      --MCMC_burnIn 500 --MCMC_samplesN 500 --MCMC_samplesSave 100 \
+      $DIR/data.prob > $DIR/$storage.log 2>&1 || { cat $DIR/$storage.log; exit 1; }
+done
+
+max_diff float $DIR/double.thetaMeans $DIR/float.thetaMeans 2 1e-6 1e-9 40
+max_diff quantised $DIR/double.thetaMeans $DIR/quantised.thetaMeans 2 0.02 2e-4 40
+echo "testStorage: OK"
@@ -0,0 +1,106 @@
+/*
+ * Test of CPU detection of ns_threads on cgroup fixture files.
+ *
+ * A temporary directory is populated with /proc/self/cgroup-like files and
+ * cgroup v1 and v2 hierarchies, and cgroupCPUs() has to find the quota of the
+ * process' cgroup (rounded up), fall back to the root cgroup and report no
+ * limit for "max" (v2) and -1 (v1) quotas. availableCPUs() has to be at least
+ * one and at most the number of CPUs.
+ */
+#include<cstdio>
+#include<cstdlib>
+#include<fstream>
+#include<string>
+#include<sys/stat.h>
+#include<unistd.h>
+
+using namespace std;
+
+#include "Threads.h"
+
+#include "common.h"
+
+namespace ns_testThreads {
+
+string root;
+
+// Create directories of path (relative to root) and write contents into file.
+void writeFile(const string &path, const string &contents){//{{{
+   for(size_t slash = path.find('/', 1); slash != string::npos; slash = path.find('/', slash + 1))
+      mkdir((root + path.substr(0, slash)).c_str(), 0700);
+   ofstream outF((root + path).c_str());
+   outF<<contents;
+}//}}}
+
+// Remove fixture files and directories.
+void cleanUp(){//{{{
+   if(root.empty())return;
+   string cmd = "rm -rf '" + root + "'";
+   if(system(cmd.c_str()) != 0)warning("Unable to remove %s.\n", root.c_str());
+}//}}}
+
+// Check quota found for cgroup file (relative to root), returns false if wrong.
+bool check(const char *name, const string &cgroupFile, long expected){//{{{
+   long cpus = ns_threads::cgroupCPUs(root + "/fs", root + cgroupFile);
+   if(cpus != expected){
+      error("%s: %ld CPUs instead of %ld.\n", name, cpus, expected);
+      return false;
+   }
+   message("%s: OK\n", name);
+   return true;
+}//}}}
+
+} // namespace ns_testThreads
+
+using namespace ns_testThreads;
+
+int main(){
+   char dirName[] = "/tmp/testThreadsXXXXXX";
+   if(mkdtemp(dirName) == NULL){
+      error("Unable to create temporary directory.\n");
+      return 1;
+   }
+   root = dirName;
+   bool ok = true;
+
+   // cgroup v2: quota of the process' cgroup, 1.5 CPUs is rounded up.
+   writeFile("/v2.cgroup", "0::/user.slice/job1\n");
+   writeFile("/fs/user.slice/job1/cpu.max", "150000 100000\n");
+   ok = check("v2 quota", "/v2.cgroup", 2) && ok;
+   // No limit in the process' cgroup.
+   writeFile("/v2max.cgroup", "0::/user.slice/job2\n");
+   writeFile("/fs/user.slice/job2/cpu.max", "max 100000\n");
+   ok = check("v2 max", "/v2max.cgroup", 0) && ok;
+   // Process' cgroup is not visible (namespace), quota of the root is used.
+   writeFile("/v2root.cgroup", "0::/hidden\n");
+   writeFile("/fs/cpu.max", "300000 100000\n");
+   ok = check("v2 root", "/v2root.cgroup", 3) && ok;
+   unlink((root + "/fs/cpu.max").c_str());
+
+   // cgroup v1 with combined cpu,cpuacct controllers.
+   writeFile("/v1.cgroup", "12:memory:/docker/abc\n4:cpu,cpuacct:/docker/abc\n1:name=systemd:/docker/abc\n");
+   writeFile("/fs/cpu,cpuacct/docker/abc/cpu.cfs_quota_us", "250000\n");
+   writeFile("/fs/cpu,cpuacct/docker/abc/cpu.cfs_period_us", "100000\n");
+   ok = check("v1 quota", "/v1.cgroup", 3) && ok;
+   // Separate cpu controller, quota -1 means no limit.
+   writeFile("/v1none.cgroup", "3:cpuacct,cpu:/batch\n");
+   writeFile("/fs/cpu/batch/cpu.cfs_quota_us", "-1\n");
+   writeFile("/fs/cpu/batch/cpu.cfs_period_us", "100000\n");
+   ok = check("v1 no limit", "/v1none.cgroup", 0) && ok;
+   // Missing files.
+   ok = check("no cgroup", "/missing.cgroup", 0) && ok;
+   cleanUp();
+
+   long cpus = ns_threads::availableCPUs(), procs = sysconf(_SC_NPROCESSORS_CONF);
+   message("Available CPUs: %ld of %ld\n", cpus, procs);
+   if((cpus < 1) || (cpus > procs)){
+      error("availableCPUs() out of range.\n");
+      ok = false;
+   }
+   if(!ok){
+      error("testThreads: FAILED\n");
+      return 1;
+   }
+   message("testThreads: OK\n");
+   return 0;
+}
@@ -0,0 +1,57 @@
+#!/bin/sh
+# Runs estimateVBExpression with options which change how the optimisation
+# is computed but not its result and compares the mean theta of the
+# .m_alphas files with the regular FR run. All runs use a tight optimisation
+# limit, so that the difference is within the convergence error (bound 1e-4
+# relative plus 1e-8 absolute):
+#  - --collapseReads, on a .prob file with log probabilities rounded to
+#    integers, so that many reads have identical alignments and are collapsed
+#    into fewer rows,
+#  - --precision float, where phi and the log probabilities are stored in
+#    single precision and the optimum moves by their rounding (about 1e-7
+#    relative), so the absolute bound is 1e-7,
+#  - --lowMemory with the FR and steepest methods, which recompute phi and
+#    the gradient instead of storing them,
+#  - vectorised exp/log/digamma kernels against the scalar libm functions
+#    (selected by BITSEQ_ISA=sse2), which differ in the last bits only; the
+#    bound is 1e-6 relative plus 1e-10 absolute, as the optimisation may stop
+#    an iteration earlier or later. On CPUs without AVX2 both runs use libm.
+
+. `dirname $0`/common.sh
+
+gen_data generated 20000 40 1
+awk '/^#/ { print; next } { for(i = 4; i <= NF; i += 2) $i = sprintf("%.0f", $i); print }' \
+   $DIR/generated.prob > $DIR/data.prob
+
+# run <name> <options...>
+run(){
+   name=$1
+   shift
+   $BIN/estimateVBExpression -o $DIR/$name -s 1 --optLimit 1e-9 -v "$@" $DIR/data.prob \
+      > $DIR/$name.log 2>&1 || { cat $DIR/$name.log; exit 1; }
+}
+run full
+
+run collapse --collapseReads
+classes=`sed -n 's/^Reads collapsed into \([0-9]*\) classes.*/\1/p' $DIR/collapse.log`
+if [ -z "$classes" ] || [ "$classes" -ge 20000 ]; then
+   echo "FAIL collapse: reads were not collapsed ($classes classes)"
+   exit 1
+fi
+max_diff "collapseReads ($classes classes)" $DIR/full.m_alphas $DIR/collapse.m_alphas 1 1e-4 1e-8 41
+
+run float --precision float
+max_diff "precision float" $DIR/full.m_alphas $DIR/float.m_alphas 1 1e-4 1e-7 41
+
+for method in FR steepest; do
+   run lowMemory$method --lowMemory -m $method
+   max_diff "lowMemory $method" $DIR/full.m_alphas $DIR/lowMemory$method.m_alphas 1 1e-4 1e-8 41
+done
+
+BITSEQ_ISA=sse2
+export BITSEQ_ISA
+run scalar
+unset BITSEQ_ISA
+isa=`sed -n 's/^Initializing VB (\(.*\) math kernels).*/\1/p' $DIR/full.log`
+max_diff "$isa kernels" $DIR/scalar.m_alphas $DIR/full.m_alphas 1 1e-6 1e-10 41
+echo "testVBOptions: OK"
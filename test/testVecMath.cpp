@@ -0,0 +1,157 @@
+/*
+ * Accuracy test of the vectorised kernels of VecMath against libm.
+ *
+ * Checks the bounds documented in VecMath.h for the instruction set selected
+ * on this CPU: exp, log and log1p within 2 ulp, digamma within 1e-14
+ * (relative, absolute near its root) of a long double reference.
+ */
+#include<cmath>
+#include<cfloat>
+#include<vector>
+
+#include "boost/random/mersenne_twister.hpp"
+#include "boost/random/uniform_01.hpp"
+
+using namespace std;
+
+#include "VecMath.h"
+
+#include "common.h"
+
+namespace ns_testVecMath {
+
+const long valuesN = 1000000;
+
+boost::random::mt11213b rng_mt(1);
+boost::random::uniform_01<double> uniformDistribution;
+
+double uniform(double a, double b){//{{{
+   return a + (b - a) * uniformDistribution(rng_mt);
+}//}}}
+
+// Error of x in ulps of the reference.
+double ulps(double x, double ref){//{{{
+   if((x != x) && (ref != ref))return 0;
+   if(x == ref)return 0;
+   if(std::isinf(ref) || std::isinf(x))return HUGE_VAL;
+   double ulp = nextafter(fabs(ref), HUGE_VAL) - fabs(ref);
+   if(ref == 0)ulp = DBL_MIN;
+   return fabs(x - ref) / ulp;
+}//}}}
+
+// Digamma by recurrence up to x >= 20 and asymptotic expansion, in long double.
+double digammaRef(double x){//{{{
+   long double xl = x, res = 0, x2;
+   while(xl < 20){
+      res -= 1 / xl;
+      xl += 1;
+   }
+   x2 = 1 / (xl * xl);
+   res += logl(xl) - 0.5L / xl
+      - x2 * (1.0L/12 - x2 * (1.0L/120 - x2 * (1.0L/252 - x2 * (1.0L/240 - x2 * (1.0L/132 - x2 * (691.0L/32760 - x2 / 12.0L))))));
+   return (double)res;
+}//}}}
+
+// Report maximal error, returns false if it exceeds the bound.
+bool report(const char *name, const vector<double> &x, const vector<double> &res, const vector<double> &ref, bool useUlps, double bound){//{{{
+   double err, maxErr = 0, at = 0;
+   for(long i = 0; i < (long)x.size(); i++){
+      if(useUlps)err = ulps(res[i], ref[i]);
+      else err = fabs(res[i] - ref[i]) / (fabs(ref[i]) > 1 ? fabs(ref[i]) : 1);
+      if(err > maxErr){
+         maxErr = err;
+         at = x[i];
+      }
+   }
+   message("%-8s max error %.3g%s (at %.17g)\n", name, maxErr, useUlps ? " ulp" : "", at);
+   if(maxErr > bound){
+      error("%s error exceeds %g.\n", name, bound);
+      return false;
+   }
+   return true;
+}//}}}
+
+} // namespace ns_testVecMath
+
+using namespace ns_testVecMath;
+
+int main(){
+   long i;
+   bool ok = true;
+   vector<double> x(valuesN), res, ref(valuesN);
+   message("Instruction set: %s\n", ns_vecMath::isaName());
+
+   // exp over the whole range where the result is normal, plus specials.
+   for(i = 0; i < valuesN; i++)x[i] = uniform(-708, 709.7);
+   x[0] = 0; x[1] = -HUGE_VAL; x[2] = HUGE_VAL; x[3] = 1e-300; x[4] = -800; x[5] = 710;
+   for(i = 0; i < valuesN; i++)ref[i] = exp(x[i]);
+   res = x;
+   ns_vecMath::expArray(&res[0], valuesN);
+   ok = report("exp", x, res, ref, true, 2) && ok;
+
+   // exp of floats against correctly rounded exp.
+   vector<float> xf(valuesN), resF;
+   for(i = 0; i < valuesN; i++){
+      xf[i] = (float)uniform(-87, 88);
+      ref[i] = (float)exp((double)xf[i]);
+   }
+   resF = xf;
+   ns_vecMath::expArray(&resF[0], valuesN);
+   double maxF = 0;
+   for(i = 0; i < valuesN; i++){
+      double ulp = nextafterf((float)ref[i], HUGE_VALF) - (float)ref[i];
+      if(fabs(resF[i] - ref[i]) / ulp > maxF)maxF = fabs(resF[i] - ref[i]) / ulp;
+   }
+   message("%-8s max error %.3g ulp\n", "expF", maxF);
+   if(maxF > 2){
+      error("expF error exceeds 2.\n");
+      ok = false;
+   }
+
+   // expSum with shift.
+   double sum = 0, sumV;
+   for(i = 0; i < valuesN; i++){
+      x[i] = uniform(-50, 0);
+      sum += exp(x[i] + 10);
+   }
+   sumV = ns_vecMath::expSum(&x[0], valuesN, -10);
+   message("%-8s relative error %.3g\n", "expSum", fabs(sumV - sum) / sum);
+   if(fabs(sumV - sum) > 1e-11 * sum){
+      error("expSum error exceeds 1e-11.\n");
+      ok = false;
+   }
+
+   // log over normal and subnormal numbers.
+   for(i = 0; i < valuesN; i++)x[i] = pow(10.0, uniform(-310, 308));
+   x[0] = 1; x[1] = 0; x[2] = HUGE_VAL; x[3] = DBL_MIN / 3; x[4] = 1 + DBL_EPSILON;
+   for(i = 0; i < valuesN; i++)ref[i] = log(x[i]);
+   res = x;
+   ns_vecMath::logArray(&res[0], valuesN);
+   ok = report("log", x, res, ref, true, 2) && ok;
+
+   // log1p around zero and for large values.
+   for(i = 0; i < valuesN; i++){
+      if(i % 2)x[i] = uniform(-1, 1);
+      else if(i % 4)x[i] = pow(10.0, uniform(-20, 20));
+      else x[i] = - pow(10.0, uniform(-20, -0.01));
+   }
+   for(i = 0; i < valuesN; i++)ref[i] = log1p(x[i]);
+   res = x;
+   ns_vecMath::log1pArray(&res[0], valuesN);
+   ok = report("log1p", x, res, ref, true, 2) && ok;
+
+   // digamma for positive arguments (alpha + phiHat in VB).
+   for(i = 0; i < valuesN; i++)x[i] = (i % 2) ? pow(10.0, uniform(-10, 10)) : uniform(0.5, 3);
+   x[0] = 1.4616321449683623;
+   for(i = 0; i < valuesN; i++)ref[i] = digammaRef(x[i]);
+   res = x;
+   ns_vecMath::digammaArray(&res[0], valuesN);
+   ok = report("digamma", x, res, ref, false, 1e-14) && ok;
+
+   if(!ok){
+      error("testVecMath: FAILED\n");
+      return 1;
+   }
+   message("testVecMath: OK\n");
+   return 0;
+}
@@ -0,0 +1,53 @@
+#!/bin/sh
+# Runs estimateVBExpression warm started (--init) from its own converged
+# result, which has to give the same mean theta (1e-6 relative plus 1e-9
+# absolute) in fewer iterations, and incrementally (--incremental) on the last
+# quarter of the reads with the result of the first three quarters as the
+# prior. Previous reads are not reassigned in the incremental run, so its mean
+# theta is bounded by 5% relative plus 1e-4 absolute, but the Dirichlet
+# parameters have to account for all reads.
+
+. `dirname $0`/common.sh
+
+gen_data data 20000 40 2
+# Split the reads into 15000 and 5000 (genProb writes 5 header lines and
+# Ntotal with 1% of unmapped reads).
+{ sed -n '1,5p' $DIR/data.prob | sed 's/^# Ntotal .*/# Ntotal 15150/; s/^# Nmap .*/# Nmap 15000/'
+  sed -n '6,15005p' $DIR/data.prob; } > $DIR/first.prob
+{ sed -n '1,5p' $DIR/data.prob | sed 's/^# Ntotal .*/# Ntotal 5050/; s/^# Nmap .*/# Nmap 5000/'
+  sed '1,15005d' $DIR/data.prob; } > $DIR/last.prob
+
+# run <name> <prob file> <options...>
+run(){
+   name=$1
+   prob=$2
+   shift 2
+   $BIN/estimateVBExpression -o $DIR/$name -s 1 --optLimit 1e-9 "$@" $DIR/$prob.prob \
+      > $DIR/$name.log 2>&1 || { cat $DIR/$name.log; exit 1; }
+}
+run full data
+run warm data --init $DIR/full.m_alphas
+run first first
+run incremental last --init $DIR/first.m_alphas --incremental
+
+# iterations <name>
+iterations(){
+   sed -n 's/^VB: \([0-9]*\) iterations.*/\1/p' $DIR/$1.log
+}
+if [ "`iterations warm`" -ge "`iterations full`" ]; then
+   echo "FAIL warm: `iterations warm` iterations, full run `iterations full`"
+   exit 1
+fi
+
+# compare <name> <relative> <absolute>
+compare(){
+   max_diff $1 $DIR/full.m_alphas $DIR/$1.m_alphas 1 $2 $3 41
+   # Sums of alphas, the number of reads they account for.
+   for f in full $1; do grep -v '^#' $DIR/$f.m_alphas | awk '{ s += $2 } END { print s }'; done | \
+   awk -v name=$1 '{ sum[NR] = $1 }
+      END { d = sum[1] - sum[2]; if(d < 0) d = -d;
+            if(d > 1e-6 * sum[1]){ print "FAIL " name ": sums of alphas " sum[1] " " sum[2]; exit 1 } }' || exit 1
+}
+compare warm 1e-6 1e-9
+compare incremental 0.05 1e-4
+echo "testWarmStart: OK"
@@ -16,14 +16,14 @@ bool transposeFiles(vector<string> inFileNames, string outFileName, bool verbose
    vector<long> N;
    bufMax=BUFFER_DEFAULT;
 
-   ofstream outFile(outFileName.c_str());
+   OGzStream outFile(outFileName.c_str());
    if(!outFile.is_open()){//{{{
       error("TransposeFile: Unable to open output file\n");
       return 0;
    }//}}}
    //{{{ Opening input
    fileN = inFileNames.size();
-   ifstream *inFile = new ifstream[fileN];
+   IGzStream *inFile = new IGzStream[fileN];
    totalN=0;
    FileHeader fh;
    for(i=0;i<fileN;i++){